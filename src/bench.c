@@ -0,0 +1,1162 @@
+/**
+ * bench.c
+ * Benchmarks of structure packing services.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "struct.h"
+#include "struct_inline.h"
+#include "struct_proto.h"
+#include "struct_registry.h"
+#include "struct_transcode.h"
+#include "struct_typed.h"
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+//
+// Private Definitions
+//
+
+/** Default count of iterations of each benchmark */
+#define BENCH_ITERATIONS	1000000
+
+/** Format of message benchmarks */
+#define BENCH_MESSAGE		"<Ih8s2xd2f3H?Q"
+
+/** Count of records packed by single call of array benchmarks */
+#define BENCH_ARRAY_COUNT	(64 * 1024)
+
+/** Count of records packed by single call of streaming benchmarks, output exceeds cache */
+#define BENCH_STREAM_COUNT	(512 * 1024)
+
+/** Size of records unpacked by tile benchmarks in sizes of last level cache, exceeds cache */
+#define BENCH_TILE_CACHES	4
+
+/** Size of records unpacked by tile benchmarks when size of last level cache is unknown */
+#define BENCH_TILE_SIZE		(1024 * 1024 * 1024)
+
+/** Prefetch distance of tile benchmarks */
+#define BENCH_TILE_PREFETCH	(16 * 1024)
+
+/** Size of records read by huge page benchmarks, exceeds reach of TLB with small pages */
+#define BENCH_HUGE_SIZE		(512 * 1024 * 1024)
+
+/** Count of threads packing records to shared array */
+#define BENCH_THREADS		4
+
+/** Count of records of shared array */
+#define BENCH_SHARED_COUNT	4096
+
+/** Size of table read by workload running along with streaming benchmarks, fits into cache */
+#define BENCH_TABLE_SIZE	(1024 * 1024)
+
+//
+// Private Types
+//
+
+/** Performance counter of benchmark mode with counters */
+typedef struct _bench_counter
+{
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+	int fd;
+} bench_counter;
+
+/** Object of gather benchmarks, only few members of which are packed */
+typedef struct _bench_object
+{
+	uint64_t id;
+	double values[12];
+	uint32_t version;
+	char name[16];
+	int16_t state;
+} bench_object;
+
+/** Thread packing every BENCH_THREADS-th record of shared array */
+typedef struct _bench_thread
+{
+	pthread_t thread;
+	const struct_format *format;
+	uint8_t *records;
+	size_t first;
+	size_t iterations;
+} bench_thread;
+
+/** Benchmark case, returns count of processed bytes */
+typedef struct _bench_case
+{
+	const char *name;
+	size_t (*run)(size_t iterations);
+} bench_case;
+
+//
+// Forward Declarations
+//
+
+static size_t bench_calcsize(size_t iterations);
+static size_t bench_calcsize_inline(size_t iterations);
+static size_t bench_message_pack(size_t iterations);
+static size_t bench_message_unpack(size_t iterations);
+static size_t bench_message_pack_template(size_t iterations);
+static size_t bench_message_pack_typed(size_t iterations);
+static size_t bench_message_unpack_typed(size_t iterations);
+static size_t bench_message_pack_typed_compiled(size_t iterations);
+static size_t bench_message_unpack_typed_compiled(size_t iterations);
+static size_t bench_array_pack_columns(size_t iterations);
+static size_t bench_array_pack_blocks(size_t iterations);
+static size_t bench_array_unpack_columns(size_t iterations);
+static size_t bench_array_unpack_blocks(size_t iterations);
+static size_t bench_tile_16_columns(size_t iterations);
+static size_t bench_tile_16_blocks(size_t iterations);
+static size_t bench_tile_16_prefetch(size_t iterations);
+static size_t bench_tile_64_columns(size_t iterations);
+static size_t bench_tile_64_blocks(size_t iterations);
+static size_t bench_tile_64_prefetch(size_t iterations);
+static size_t bench_tile_256_columns(size_t iterations);
+static size_t bench_tile_256_blocks(size_t iterations);
+static size_t bench_tile_256_prefetch(size_t iterations);
+static size_t bench_huge_small_pages(size_t iterations);
+static size_t bench_huge_huge_pages(size_t iterations);
+static size_t bench_shared_compact(size_t iterations);
+static size_t bench_shared_padded(size_t iterations);
+static size_t bench_stream_pack_blocks(size_t iterations);
+static size_t bench_stream_pack_stream(size_t iterations);
+static size_t bench_stream_table_blocks(size_t iterations);
+static size_t bench_stream_table_stream(size_t iterations);
+static size_t bench_gather_pack(size_t iterations);
+static size_t bench_gather_pack_loop(size_t iterations);
+static size_t bench_widen_rows(size_t iterations);
+static size_t bench_widen_rows_two_pass(size_t iterations);
+static size_t bench_widen_column(size_t iterations);
+static size_t bench_widen_column_two_pass(size_t iterations);
+static size_t bench_validate_array(size_t iterations);
+static size_t bench_registry_format(size_t iterations);
+static size_t bench_registry_compiled(size_t iterations);
+static size_t bench_proto_encode(size_t iterations);
+static size_t bench_proto_decode(size_t iterations);
+static size_t bench_msgpack_encode(size_t iterations);
+static size_t bench_msgpack_decode(size_t iterations);
+static size_t bench_cbor_encode(size_t iterations);
+static size_t bench_cbor_decode(size_t iterations);
+
+//
+// Private Variables
+//
+
+/** Benchmark cases */
+static const bench_case bench_cases[] = {
+		{ "calcsize", bench_calcsize },
+		{ "calcsize inline", bench_calcsize_inline },
+		{ "message pack", bench_message_pack },
+		{ "message unpack", bench_message_unpack },
+		{ "message pack template", bench_message_pack_template },
+		{ "message pack typed", bench_message_pack_typed },
+		{ "message unpack typed", bench_message_unpack_typed },
+		{ "message pack typed compiled", bench_message_pack_typed_compiled },
+		{ "message unpack typed compiled", bench_message_unpack_typed_compiled },
+		{ "array pack columns", bench_array_pack_columns },
+		{ "array pack blocks", bench_array_pack_blocks },
+		{ "array unpack columns", bench_array_unpack_columns },
+		{ "array unpack blocks", bench_array_unpack_blocks },
+		{ "tile unpack 16B columns", bench_tile_16_columns },
+		{ "tile unpack 16B blocks", bench_tile_16_blocks },
+		{ "tile unpack 16B prefetch", bench_tile_16_prefetch },
+		{ "tile unpack 64B columns", bench_tile_64_columns },
+		{ "tile unpack 64B blocks", bench_tile_64_blocks },
+		{ "tile unpack 64B prefetch", bench_tile_64_prefetch },
+		{ "tile unpack 256B columns", bench_tile_256_columns },
+		{ "tile unpack 256B blocks", bench_tile_256_blocks },
+		{ "tile unpack 256B prefetch", bench_tile_256_prefetch },
+		{ "random unpack small pages", bench_huge_small_pages },
+		{ "random unpack huge pages", bench_huge_huge_pages },
+		{ "shared pack compact", bench_shared_compact },
+		{ "shared pack padded", bench_shared_padded },
+		{ "stream pack blocks + table", bench_stream_pack_blocks },
+		{ "stream pack stream + table", bench_stream_pack_stream },
+		{ "stream table after blocks", bench_stream_table_blocks },
+		{ "stream table after stream", bench_stream_table_stream },
+		{ "gather pack members", bench_gather_pack },
+		{ "gather pack members by record", bench_gather_pack_loop },
+		{ "widen unpack rows", bench_widen_rows },
+		{ "widen unpack rows two pass", bench_widen_rows_two_pass },
+		{ "widen unpack column", bench_widen_column },
+		{ "widen unpack column two pass", bench_widen_column_two_pass },
+		{ "validate array", bench_validate_array },
+		{ "registry format", bench_registry_format },
+		{ "registry format kept", bench_registry_compiled },
+		{ "message proto encode", bench_proto_encode },
+		{ "message proto decode", bench_proto_decode },
+		{ "message msgpack encode", bench_msgpack_encode },
+		{ "message msgpack decode", bench_msgpack_decode },
+		{ "message cbor encode", bench_cbor_encode },
+		{ "message cbor decode", bench_cbor_decode },
+		/* end of cases */
+		{ NULL, NULL }
+};
+
+/** Field numbers of message for protocol buffers benchmarks */
+static const unsigned bench_message_numbers[] = { 1, 2, 3, 0, 4, 5, 6, 7, 8 };
+
+/** Sink for results which must not be optimized out */
+static volatile size_t bench_sink;
+
+/** Count of iterations done by running benchmark, benchmark may do more than requested */
+static size_t bench_count;
+
+/** Start time of running benchmark */
+static double bench_start;
+
+/** Time when measurement of running benchmark was paused */
+static double bench_paused;
+
+/** Counters of benchmark mode with counters, unavailable counters are skipped */
+static bench_counter bench_counters[] = {
+		{ "dTLB miss", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+				(PERF_COUNT_HW_CACHE_RESULT_MISS << 16), -1 },
+		{ "fault", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, -1 },
+		/* end of counters */
+		{ NULL, 0, 0, -1 }
+};
+
+//
+// Private Services
+//
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Open performance counter of current thread in user space
+ * @return File descriptor of disabled counter or negative when failed
+ */
+static int bench_counter_open(const bench_counter *counter)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = counter->type;
+	attr.config = counter->config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * Exclude preparation of benchmark data from measured time and counters
+ */
+static void bench_restart(void)
+{
+	bench_counter *counter;
+
+	for (counter = bench_counters; counter->name != NULL; counter++)
+		if (counter->fd >= 0)
+			ioctl(counter->fd, PERF_EVENT_IOC_RESET, 0);
+	bench_start = bench_now();
+}
+
+/**
+ * Exclude following work from measured time and counters until bench_resume()
+ */
+static void bench_pause(void)
+{
+	bench_counter *counter;
+
+	for (counter = bench_counters; counter->name != NULL; counter++)
+		if (counter->fd >= 0)
+			ioctl(counter->fd, PERF_EVENT_IOC_DISABLE, 0);
+	bench_paused = bench_now();
+}
+
+/**
+ * Continue measurement paused by bench_pause()
+ */
+static void bench_resume(void)
+{
+	bench_counter *counter;
+
+	bench_start += bench_now() - bench_paused;
+	for (counter = bench_counters; counter->name != NULL; counter++)
+		if (counter->fd >= 0)
+			ioctl(counter->fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+static ssize_t bench_message(uint8_t *record, size_t size, uint32_t seq)
+{
+	return struct_pack(record, size, BENCH_MESSAGE, seq, (int16_t) -seq, "EURUSD", seq * 0.5,
+			1.5f, 2.5f, seq & 0xffff, 300, 7, seq & 1, (uint64_t) seq << 20);
+}
+
+static size_t bench_calcsize(size_t iterations)
+{
+	size_t i;
+
+	for (i = 0; i < iterations; i++)
+		bench_sink += (struct_calcsize)(BENCH_MESSAGE);
+	return 0;
+}
+
+static size_t bench_calcsize_inline(size_t iterations)
+{
+	size_t i;
+
+	// size of constant format is folded to constant by compiler
+	for (i = 0; i < iterations; i++)
+		bench_sink += struct_calcsize(BENCH_MESSAGE);
+	return 0;
+}
+
+static size_t bench_message_pack(size_t iterations)
+{
+	uint8_t record[64];
+	size_t i;
+
+	for (i = 0; i < iterations; i++)
+		bench_sink += bench_message(record, sizeof(record), i);
+	return i * struct_calcsize(BENCH_MESSAGE);
+}
+
+static size_t bench_message_unpack(size_t iterations)
+{
+	uint8_t record[64];
+	uint32_t I;
+	int16_t h;
+	char s[9];
+	double d;
+	float f[2];
+	uint16_t H[3];
+	uint8_t b;
+	uint64_t Q;
+	size_t i;
+
+	bench_message(record, sizeof(record), 12345);
+	for (i = 0; i < iterations; i++)
+	{
+		bench_sink += struct_unpack(record, sizeof(record), BENCH_MESSAGE, &I, &h, s, sizeof(s), &d,
+				&f[0], &f[1], &H[0], &H[1], &H[2], &b, &Q);
+		bench_sink += I;
+	}
+	return i * struct_calcsize(BENCH_MESSAGE);
+}
+
+static size_t bench_message_pack_template(size_t iterations)
+{
+	const size_t bound[] = { 1, 2, 5 };
+	struct_format *format = struct_compile(BENCH_MESSAGE);
+	struct_template *template;
+	uint8_t record[64];
+	size_t i;
+
+	bench_message(record, sizeof(record), 12345);
+	template = struct_bind(format, bound, 3, record);
+	for (i = 0; i < iterations; i++)
+		bench_sink += struct_pack_template(record, sizeof(record), template, (uint32_t) i, i * 0.5,
+				(int) (i & 0xffff), 300, 7, (int) (i & 1), (uint64_t) i << 20);
+
+	struct_template_free(template);
+	struct_free(format);
+	return i * struct_calcsize(BENCH_MESSAGE);
+}
+
+static size_t bench_message_pack_typed(size_t iterations)
+{
+	uint8_t record[64];
+	size_t i;
+
+	for (i = 0; i < iterations; i++)
+		bench_sink += STRUCT_PACK(record, sizeof(record), BENCH_MESSAGE, (uint32_t) i, (int16_t) -i, "EURUSD",
+				i * 0.5, 1.5f, 2.5f, (uint16_t) i, 300, 7, (bool) (i & 1), (uint64_t) i << 20);
+	return i * struct_calcsize(BENCH_MESSAGE);
+}
+
+static size_t bench_message_unpack_typed(size_t iterations)
+{
+	uint8_t record[64];
+	uint32_t I;
+	int16_t h;
+	char s[9];
+	double d;
+	float f[2];
+	uint16_t H[3];
+	bool b;
+	uint64_t Q;
+	size_t i;
+
+	bench_message(record, sizeof(record), 12345);
+	for (i = 0; i < iterations; i++)
+	{
+		bench_sink += STRUCT_UNPACK(record, sizeof(record), BENCH_MESSAGE, &I, &h, s, &d,
+				&f[0], &f[1], &H[0], &H[1], &H[2], &b, &Q);
+		bench_sink += I;
+	}
+	return i * struct_calcsize(BENCH_MESSAGE);
+}
+
+static size_t bench_message_pack_typed_compiled(size_t iterations)
+{
+	struct_format *format = struct_compile(BENCH_MESSAGE);
+	uint8_t record[64];
+	size_t i;
+
+	for (i = 0; i < iterations; i++)
+		bench_sink += STRUCT_PACK_COMPILED(record, sizeof(record), format, (uint32_t) i, (int16_t) -i, "EURUSD",
+				i * 0.5, 1.5f, 2.5f, (uint16_t) i, 300, 7, (bool) (i & 1), (uint64_t) i << 20);
+
+	struct_free(format);
+	return i * struct_calcsize(BENCH_MESSAGE);
+}
+
+static size_t bench_message_unpack_typed_compiled(size_t iterations)
+{
+	struct_format *format = struct_compile(BENCH_MESSAGE);
+	uint8_t record[64];
+	uint32_t I;
+	int16_t h;
+	char s[9];
+	double d;
+	float f[2];
+	uint16_t H[3];
+	bool b;
+	uint64_t Q;
+	size_t i;
+
+	bench_message(record, sizeof(record), 12345);
+	for (i = 0; i < iterations; i++)
+	{
+		bench_sink += STRUCT_UNPACK_COMPILED(record, sizeof(record), format, &I, &h, s, &d,
+				&f[0], &f[1], &H[0], &H[1], &H[2], &b, &Q);
+		bench_sink += I;
+	}
+
+	struct_free(format);
+	return i * struct_calcsize(BENCH_MESSAGE);
+}
+
+/**
+ * Pack or unpack array of messages with given strategy, iteration is single record
+ * @param unpack Non-zero to measure unpacking
+ */
+static size_t bench_array(size_t iterations, int strategy, int unpack)
+{
+	struct_format *format = struct_compile(BENCH_MESSAGE);
+	uint8_t *records = calloc(BENCH_ARRAY_COUNT, format->size);
+	uint32_t *I = calloc(BENCH_ARRAY_COUNT, sizeof(*I));
+	int16_t *h = calloc(BENCH_ARRAY_COUNT, sizeof(*h));
+	char *s = calloc(BENCH_ARRAY_COUNT, 8);
+	double *d = calloc(BENCH_ARRAY_COUNT, sizeof(*d));
+	float *f = calloc(BENCH_ARRAY_COUNT, 2 * sizeof(*f));
+	uint16_t *H = calloc(BENCH_ARRAY_COUNT, 3 * sizeof(*H));
+	uint8_t *b = calloc(BENCH_ARRAY_COUNT, sizeof(*b));
+	uint64_t *Q = calloc(BENCH_ARRAY_COUNT, sizeof(*Q));
+	size_t i, count;
+
+	format->strategy = strategy;
+	for (i = 0; i < iterations; i += count)
+	{
+		count = iterations - i < BENCH_ARRAY_COUNT ? iterations - i : BENCH_ARRAY_COUNT;
+		if (unpack)
+			bench_sink += struct_unpack_array(records, BENCH_ARRAY_COUNT * format->size, format, count,
+					I, h, s, d, f, H, b, Q);
+		else
+			bench_sink += struct_pack_array(records, BENCH_ARRAY_COUNT * format->size, format, count,
+					I, h, s, d, f, H, b, Q);
+	}
+
+	free(Q);
+	free(b);
+	free(H);
+	free(f);
+	free(d);
+	free(s);
+	free(h);
+	free(I);
+	free(records);
+	struct_free(format);
+	return iterations * struct_calcsize(BENCH_MESSAGE);
+}
+
+static size_t bench_array_pack_columns(size_t iterations)
+{
+	return bench_array(iterations, STRUCT_STRATEGY_COLUMNS, 0);
+}
+
+static size_t bench_array_pack_blocks(size_t iterations)
+{
+	return bench_array(iterations, STRUCT_STRATEGY_BLOCKS, 0);
+}
+
+static size_t bench_array_unpack_columns(size_t iterations)
+{
+	return bench_array(iterations, STRUCT_STRATEGY_COLUMNS, 1);
+}
+
+static size_t bench_array_unpack_blocks(size_t iterations)
+{
+	return bench_array(iterations, STRUCT_STRATEGY_BLOCKS, 1);
+}
+
+/**
+ * Unpack records with one 'Q' field per 8 bytes from memory exceeding cache
+ * Iteration is single record, records are unpacked by arrays of 64K records.
+ * All records are unpacked at least once, so less iterations than records are raised.
+ * @param size Size of record
+ */
+static size_t bench_tile(size_t iterations, size_t size, int strategy, size_t prefetch)
+{
+	const long cache = sysconf(_SC_LEVEL3_CACHE_SIZE);
+	const size_t count = (cache > 0 ? (size_t) cache * BENCH_TILE_CACHES : BENCH_TILE_SIZE) / size;
+	const size_t batch = 64 * 1024;
+	struct_format *format;
+	uint8_t *records = calloc(count, size);
+	uint64_t *Q = calloc(batch, size);
+	uint64_t *columns[32];
+	char pattern[2 * 32 + 1];
+	size_t i, n, first;
+
+	if (iterations < count)
+		iterations = count;
+	bench_count = iterations;
+
+	for (i = 0; i < size / 8; i++)
+	{
+		pattern[2 * i] = 'Q';
+		pattern[2 * i + 1] = ' ';
+		columns[i] = Q + i * batch;
+	}
+	pattern[2 * i] = '\0';
+
+	// pages of records are mapped before measurement, only their end stays in cache
+	memset(records, 1, count * size);
+	memset(Q, 0, batch * size);
+
+	format = struct_compile(pattern);
+	format->strategy = strategy;
+	format->prefetch = prefetch;
+	bench_restart();
+
+	// variable arguments take all 32 pointers, formats use only first of them
+	for (i = 0, first = 0; i < iterations; i += n, first = (first + n) % count)
+	{
+		n = iterations - i < batch ? iterations - i : batch;
+		if (n > count - first)
+			n = count - first;
+		bench_sink += struct_unpack_array(records + first * size, (count - first) * size, format, n,
+				columns[0], columns[1], columns[2], columns[3], columns[4], columns[5], columns[6], columns[7],
+				columns[8], columns[9], columns[10], columns[11], columns[12], columns[13], columns[14],
+				columns[15], columns[16], columns[17], columns[18], columns[19], columns[20], columns[21],
+				columns[22], columns[23], columns[24], columns[25], columns[26], columns[27], columns[28],
+				columns[29], columns[30], columns[31]);
+	}
+
+	free(Q);
+	free(records);
+	struct_free(format);
+	return iterations * size;
+}
+
+static size_t bench_tile_16_columns(size_t iterations)
+{
+	return bench_tile(iterations, 16, STRUCT_STRATEGY_COLUMNS, 0);
+}
+
+static size_t bench_tile_16_blocks(size_t iterations)
+{
+	return bench_tile(iterations, 16, STRUCT_STRATEGY_BLOCKS, 0);
+}
+
+static size_t bench_tile_16_prefetch(size_t iterations)
+{
+	return bench_tile(iterations, 16, STRUCT_STRATEGY_BLOCKS, BENCH_TILE_PREFETCH);
+}
+
+static size_t bench_tile_64_columns(size_t iterations)
+{
+	return bench_tile(iterations, 64, STRUCT_STRATEGY_COLUMNS, 0);
+}
+
+static size_t bench_tile_64_blocks(size_t iterations)
+{
+	return bench_tile(iterations, 64, STRUCT_STRATEGY_BLOCKS, 0);
+}
+
+static size_t bench_tile_64_prefetch(size_t iterations)
+{
+	return bench_tile(iterations, 64, STRUCT_STRATEGY_BLOCKS, BENCH_TILE_PREFETCH);
+}
+
+static size_t bench_tile_256_columns(size_t iterations)
+{
+	return bench_tile(iterations, 256, STRUCT_STRATEGY_COLUMNS, 0);
+}
+
+static size_t bench_tile_256_blocks(size_t iterations)
+{
+	return bench_tile(iterations, 256, STRUCT_STRATEGY_BLOCKS, 0);
+}
+
+static size_t bench_tile_256_prefetch(size_t iterations)
+{
+	return bench_tile(iterations, 256, STRUCT_STRATEGY_BLOCKS, BENCH_TILE_PREFETCH);
+}
+
+/**
+ * Unpack records at random positions of buffer exceeding reach of TLB
+ * Iteration is single record.
+ * @param huge Non-zero to allocate buffer with huge pages
+ */
+static size_t bench_huge(size_t iterations, int huge)
+{
+	struct_format *format = struct_compile("<4Q");
+	const size_t count = BENCH_HUGE_SIZE / 32;
+	uint8_t *records = huge ? struct_alloc(BENCH_HUGE_SIZE, STRUCT_ALLOC_HUGE) : malloc(BENCH_HUGE_SIZE);
+	uint64_t Q[4], x = 88172645463325252ull;
+	size_t i;
+
+	// pages are mapped before measurement
+	memset(records, 1, BENCH_HUGE_SIZE);
+	bench_restart();
+
+	for (i = 0; i < iterations; i++)
+	{
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		bench_sink += struct_unpack_array(records + x % count * 32, 32, format, 1, Q);
+		bench_sink += Q[0];
+	}
+
+	if (huge)
+		struct_alloc_free(records, BENCH_HUGE_SIZE, STRUCT_ALLOC_HUGE);
+	else
+		free(records);
+	struct_free(format);
+	return iterations * 32;
+}
+
+static size_t bench_huge_small_pages(size_t iterations)
+{
+	return bench_huge(iterations, 0);
+}
+
+static size_t bench_huge_huge_pages(size_t iterations)
+{
+	return bench_huge(iterations, 1);
+}
+
+static void *bench_shared_thread(void *arg)
+{
+	bench_thread *thread = arg;
+	uint64_t Q[4] = { 1, 2, 3, 4 };
+	size_t i, n = thread->first;
+
+	for (i = 0; i < thread->iterations; i++)
+	{
+		struct_pack_array(thread->records + n * thread->format->size, thread->format->size, thread->format, 1, Q);
+		n = (n + BENCH_THREADS) % BENCH_SHARED_COUNT;
+	}
+	return NULL;
+}
+
+/**
+ * Pack records by several threads to adjacent positions of shared array
+ * Iteration is single record. Padded records are compacted after all threads finish.
+ * @param padded Non-zero to pad records to cache line
+ */
+static size_t bench_shared(size_t iterations, int padded)
+{
+	struct_format *format = struct_compile("<4Q");
+	struct_format *slot = padded ? struct_pad(format, 64) : format;
+	uint8_t *records = slot != NULL ? struct_alloc(BENCH_SHARED_COUNT * slot->size, 0) : NULL;
+	bench_thread threads[BENCH_THREADS];
+	size_t t, started = 0;
+	int failed = records == NULL;
+
+	for (t = 0; !failed && t < BENCH_THREADS; t++)
+	{
+		threads[t].format = slot;
+		threads[t].records = records;
+		threads[t].first = t;
+		threads[t].iterations = iterations / BENCH_THREADS;
+		failed = pthread_create(&threads[t].thread, NULL, bench_shared_thread, &threads[t]) != 0;
+		if (!failed)
+			started++;
+	}
+	for (t = 0; t < started; t++)
+		pthread_join(threads[t].thread, NULL);
+
+	if (!failed && padded)
+		bench_sink += struct_compact(records, BENCH_SHARED_COUNT * slot->size, records, slot, format,
+				BENCH_SHARED_COUNT);
+
+	struct_alloc_free(records, BENCH_SHARED_COUNT * slot->size, 0);
+	if (padded)
+		struct_free(slot);
+	struct_free(format);
+
+	// partial results of threads which were started are not comparable
+	if (failed)
+	{
+		fprintf(stderr, "shared pack: cannot allocate records or start threads\n");
+		exit(EXIT_FAILURE);
+	}
+	return iterations * 32;
+}
+
+static size_t bench_shared_compact(size_t iterations)
+{
+	return bench_shared(iterations, 0);
+}
+
+static size_t bench_shared_padded(size_t iterations)
+{
+	return bench_shared(iterations, 1);
+}
+
+/**
+ * Pack large arrays of messages interleaved with reading table which should stay in cache
+ * Iteration is single record, table is read after each packed array.
+ * @param table_only Non-zero to measure only reading of table, otherwise both packing and reading
+ * @return Count of packed bytes, or count of bytes of table cache lines read when table_only
+ */
+static size_t bench_stream(size_t iterations, int strategy, int table_only)
+{
+	const size_t values = BENCH_STREAM_COUNT * 4;
+	const size_t lines = BENCH_TABLE_SIZE / 64;
+	struct_format *format = struct_compile("<4Q");
+	uint8_t *records = calloc(BENCH_STREAM_COUNT, format->size);
+	uint64_t *Q = calloc(BENCH_STREAM_COUNT, format->size);
+	uint64_t *table = calloc(BENCH_TABLE_SIZE / sizeof(uint64_t), sizeof(uint64_t));
+	size_t i, j, count, passes = 0;
+	uint64_t sum = 0;
+
+	// pages are mapped and table is in cache before measurement
+	for (i = 0; i < values; i++)
+		Q[i] = i * 0x9e3779b97f4a7c15ull;
+	for (i = 0; i < BENCH_TABLE_SIZE / sizeof(uint64_t); i++)
+		table[i] = i;
+	memset(records, 0, BENCH_STREAM_COUNT * format->size);
+
+	format->strategy = strategy;
+	bench_restart();
+	for (i = 0; i < iterations; i += count)
+	{
+		count = iterations - i < BENCH_STREAM_COUNT ? iterations - i : BENCH_STREAM_COUNT;
+		if (table_only)
+			bench_pause();
+		bench_sink += struct_pack_array(records, BENCH_STREAM_COUNT * format->size, format, count, Q);
+		if (table_only)
+			bench_resume();
+
+		// one value per cache line in scattered order, as hash table lookups would do
+		for (j = 0; j < lines; j++)
+			sum += table[(j * 7919) % lines * 8];
+		passes++;
+	}
+	bench_sink += sum;
+
+	free(table);
+	free(Q);
+	free(records);
+	struct_free(format);
+	return table_only ? passes * lines * 64 : iterations * 32;
+}
+
+static size_t bench_stream_pack_blocks(size_t iterations)
+{
+	return bench_stream(iterations, STRUCT_STRATEGY_BLOCKS, 0);
+}
+
+static size_t bench_stream_pack_stream(size_t iterations)
+{
+	return bench_stream(iterations, STRUCT_STRATEGY_STREAM, 0);
+}
+
+static size_t bench_stream_table_blocks(size_t iterations)
+{
+	return bench_stream(iterations, STRUCT_STRATEGY_BLOCKS, 1);
+}
+
+static size_t bench_stream_table_stream(size_t iterations)
+{
+	return bench_stream(iterations, STRUCT_STRATEGY_STREAM, 1);
+}
+
+/**
+ * Pack id, version and state of objects
+ * @param gather Non-zero to pack all objects by one call, otherwise object by object
+ */
+static size_t bench_gather(size_t iterations, int gather)
+{
+	const size_t count = 4096;
+	bench_object *objects = calloc(count, sizeof(*objects));
+	struct_format *format = struct_compile("<QIh");
+	uint8_t *records = calloc(count, format->size);
+	struct_column columns[3] = {
+			{ &objects[0].id, sizeof(objects[0]), 0 },
+			{ &objects[0].version, sizeof(objects[0]), 0 },
+			{ &objects[0].state, sizeof(objects[0]), 0 }
+	};
+	size_t i, n;
+
+	bench_restart();
+	for (i = 0; i < iterations; i += count)
+	{
+		if (gather)
+		{
+			bench_sink += struct_pack_gather(records, count * format->size, format, count, columns);
+			continue;
+		}
+		for (n = 0; n < count; n++)
+			bench_sink += struct_pack(records + n * format->size, format->size, "<QIh", objects[n].id,
+					objects[n].version, objects[n].state);
+	}
+
+	free(records);
+	struct_free(format);
+	free(objects);
+	return iterations * 14;
+}
+
+static size_t bench_gather_pack(size_t iterations)
+{
+	return bench_gather(iterations, 1);
+}
+
+static size_t bench_gather_pack_loop(size_t iterations)
+{
+	return bench_gather(iterations, 0);
+}
+
+/**
+ * Unpack records of "<hif" format or "<h" column to int64 and double columns
+ * @param rows Non-zero to unpack records of three fields, otherwise single field
+ * @param fused Non-zero to convert values while unpacked, otherwise by second pass
+ */
+static size_t bench_widen(size_t iterations, int rows, int fused)
+{
+	const size_t count = 4096;
+	struct_format *format = struct_compile(rows ? "<hif" : "<h");
+	uint8_t *records = calloc(count, format->size);
+	int64_t *shorts = calloc(count, sizeof(int64_t));
+	int64_t *ints = calloc(count, sizeof(int64_t));
+	double *floats = calloc(count, sizeof(double));
+	int16_t *shorts_tmp = calloc(count, sizeof(int16_t));
+	int32_t *ints_tmp = calloc(count, sizeof(int32_t));
+	float *floats_tmp = calloc(count, sizeof(float));
+	struct_column columns[3] = {
+			{ shorts, sizeof(int64_t), 'q' },
+			{ ints, sizeof(int64_t), 'q' },
+			{ floats, sizeof(double), 'd' }
+	};
+	size_t i, n;
+
+	for (n = 0; n < count; n++)
+	{
+		shorts_tmp[n] = n - count / 2;
+		ints_tmp[n] = n * 1000;
+		floats_tmp[n] = n * 0.5f;
+	}
+	if (rows)
+		struct_pack_array(records, count * format->size, format, count, shorts_tmp, ints_tmp, floats_tmp);
+	else
+		struct_pack_array(records, count * format->size, format, count, shorts_tmp);
+
+	bench_restart();
+	for (i = 0; i < iterations; i += count)
+	{
+		if (fused)
+		{
+			bench_sink += struct_unpack_scatter(records, count * format->size, format, count, columns);
+			continue;
+		}
+
+		if (rows)
+			struct_unpack_array(records, count * format->size, format, count, shorts_tmp, ints_tmp, floats_tmp);
+		else
+			struct_unpack_array(records, count * format->size, format, count, shorts_tmp);
+		for (n = 0; n < count; n++)
+			shorts[n] = shorts_tmp[n];
+		if (rows)
+		{
+			for (n = 0; n < count; n++)
+				ints[n] = ints_tmp[n];
+			for (n = 0; n < count; n++)
+				floats[n] = floats_tmp[n];
+		}
+		bench_sink += shorts[count - 1];
+	}
+
+	free(floats_tmp);
+	free(ints_tmp);
+	free(shorts_tmp);
+	free(floats);
+	free(ints);
+	free(shorts);
+	free(records);
+	struct_free(format);
+	return iterations * (rows ? 10 : 2);
+}
+
+static size_t bench_widen_rows(size_t iterations)
+{
+	return bench_widen(iterations, 1, 1);
+}
+
+static size_t bench_widen_rows_two_pass(size_t iterations)
+{
+	return bench_widen(iterations, 1, 0);
+}
+
+static size_t bench_widen_column(size_t iterations)
+{
+	return bench_widen(iterations, 0, 1);
+}
+
+static size_t bench_widen_column_two_pass(size_t iterations)
+{
+	return bench_widen(iterations, 0, 0);
+}
+
+static size_t bench_validate_array(size_t iterations)
+{
+	const size_t count = 4096;
+	struct_format *format = struct_compile("<I?3xh8s4T");
+	uint8_t *records = calloc(count, format->size);
+	uint8_t bits[4] = { 1, 0, 1, 1 };
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		struct_pack(records + i * format->size, format->size, "<I?3xh8s&4T", i, i % 2, 0, "name", bits);
+
+	bench_restart();
+	for (i = 0; i < iterations; i += count)
+		bench_sink += struct_validate_array(format, records, count * format->size, count, STRUCT_VALIDATE_ALL);
+
+	free(records);
+	struct_free(format);
+	return iterations * 19;
+}
+
+/**
+ * Get formats from registry
+ * @param kept Non-zero to take formats kept by registry, otherwise expand format on each use
+ */
+static size_t bench_registry(size_t iterations, int kept)
+{
+	struct_registry *registry = struct_registry_create();
+	char format[64];
+	size_t i;
+
+	// formats differ by leading fields and share common tail
+	for (i = 0; i < 1000; i++)
+	{
+		snprintf(format, sizeof(format), "<%zus%zuH%s", i % 40 + 1, i / 40, BENCH_MESSAGE + 1);
+		struct_registry_add(registry, format);
+	}
+	bench_restart();
+
+	for (i = 0; i < iterations; i++)
+	{
+		struct_format *compiled;
+
+		if (kept)
+		{
+			bench_sink += struct_registry_compiled(registry, i % 1000)->size;
+			continue;
+		}
+
+		compiled = struct_registry_format(registry, i % 1000);
+		bench_sink += compiled->size;
+		struct_free(compiled);
+	}
+
+	bench_sink += struct_registry_memory(registry);
+	struct_registry_free(registry);
+	return 0;
+}
+
+static size_t bench_registry_format(size_t iterations)
+{
+	return bench_registry(iterations, 0);
+}
+
+static size_t bench_registry_compiled(size_t iterations)
+{
+	return bench_registry(iterations, 1);
+}
+
+static size_t bench_proto_encode(size_t iterations)
+{
+	struct_format *format = struct_compile(BENCH_MESSAGE);
+	struct_proto *proto = struct_proto_create(format, bench_message_numbers);
+	uint8_t record[64], message[128];
+	size_t i;
+
+	bench_message(record, sizeof(record), 12345);
+	for (i = 0; i < iterations; i++)
+		bench_sink += struct_proto_encode(message, sizeof(message), proto, record);
+
+	struct_proto_free(proto);
+	struct_free(format);
+	return i * struct_calcsize(BENCH_MESSAGE);
+}
+
+static size_t bench_proto_decode(size_t iterations)
+{
+	struct_format *format = struct_compile(BENCH_MESSAGE);
+	struct_proto *proto = struct_proto_create(format, bench_message_numbers);
+	uint8_t record[64], message[128];
+	ssize_t size;
+	size_t i;
+
+	bench_message(record, sizeof(record), 12345);
+	size = struct_proto_encode(message, sizeof(message), proto, record);
+	for (i = 0; i < iterations; i++)
+		bench_sink += struct_proto_decode(record, sizeof(record), proto, message, size);
+
+	struct_proto_free(proto);
+	struct_free(format);
+	return i * size;
+}
+
+/**
+ * Transcode message with given encoder and decoder
+ * @param decode Non-zero to measure decoder
+ */
+static size_t bench_transcode(size_t iterations, int decode,
+		ssize_t (*encoder)(void *, size_t, const struct_format *, const void *),
+		ssize_t (*decoder)(void *, size_t, const struct_format *, const void *, size_t))
+{
+	struct_format *format = struct_compile(BENCH_MESSAGE);
+	uint8_t record[64], message[128];
+	ssize_t size;
+	size_t i;
+
+	bench_message(record, sizeof(record), 12345);
+	size = encoder(message, sizeof(message), format, record);
+	for (i = 0; i < iterations; i++)
+	{
+		if (decode)
+			bench_sink += decoder(record, sizeof(record), format, message, size);
+		else
+			bench_sink += encoder(message, sizeof(message), format, record);
+	}
+
+	struct_free(format);
+	return i * struct_calcsize(BENCH_MESSAGE);
+}
+
+static size_t bench_msgpack_encode(size_t iterations)
+{
+	return bench_transcode(iterations, 0, struct_to_msgpack, struct_from_msgpack);
+}
+
+static size_t bench_msgpack_decode(size_t iterations)
+{
+	return bench_transcode(iterations, 1, struct_to_msgpack, struct_from_msgpack);
+}
+
+static size_t bench_cbor_encode(size_t iterations)
+{
+	return bench_transcode(iterations, 0, struct_to_cbor, struct_from_cbor);
+}
+
+static size_t bench_cbor_decode(size_t iterations)
+{
+	return bench_transcode(iterations, 1, struct_to_cbor, struct_from_cbor);
+}
+
+//
+// Public Services
+//
+
+/**
+ * Run benchmarks
+ * Usage: struct-bench [-p] [name filter] [iterations]
+ * With -p user space performance counters per iteration are printed.
+ */
+int main(int argc, char *argv[])
+{
+	int counters = argc > 1 && strcmp(argv[1], "-p") == 0;
+	const char *filter = argc > 1 + counters ? argv[1 + counters] : "";
+	size_t iterations = argc > 2 + counters ? strtoul(argv[2 + counters], NULL, 0) : BENCH_ITERATIONS;
+	const bench_case *c;
+	bench_counter *counter;
+
+	for (counter = bench_counters; counters && counter->name != NULL; counter++)
+		counter->fd = bench_counter_open(counter);
+
+	for (c = bench_cases; c->name != NULL; c++)
+	{
+		double elapsed;
+		size_t bytes;
+
+		if (strstr(c->name, filter) == NULL)
+			continue;
+
+		for (counter = bench_counters; counter->name != NULL; counter++)
+			if (counter->fd >= 0)
+				ioctl(counter->fd, PERF_EVENT_IOC_ENABLE, 0);
+
+		bench_count = iterations;
+		bench_restart();
+		bytes = c->run(iterations);
+		elapsed = bench_now() - bench_start;
+
+		printf("%-40s %10.2f ns/op", c->name, elapsed * 1e9 / bench_count);
+		if (bytes > 0)
+			printf(" %10.1f MB/s", bytes / elapsed / 1e6);
+		for (counter = bench_counters; counter->name != NULL; counter++)
+		{
+			uint64_t value;
+
+			if (counter->fd < 0)
+				continue;
+			ioctl(counter->fd, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(counter->fd, &value, sizeof(value)) == sizeof(value))
+				printf(" %10.4f %s/op", (double) value / bench_count, counter->name);
+		}
+		printf("\n");
+	}
+
+	for (counter = bench_counters; counter->name != NULL; counter++)
+		if (counter->fd >= 0)
+			close(counter->fd);
+	return 0;
+}
@@ -25,16 +25,63 @@
  */
 
 #include "struct.h"
+#include "struct_internal.h"
 #include <ctype.h>
 #include <endian.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 //
 // Private Definitions
 //
 
+/** Modifier of repeated field taking single pointer to array of values */
+#define STRUCT_ARRAY_MODIFIER	'&'
+
+/** Beginning of optional fields group */
+#define STRUCT_GROUP_BEGIN		'{'
+
+/** End of optional fields group */
+#define STRUCT_GROUP_END		'}'
+
+/** Maximal count of values in optional fields group */
+#define STRUCT_GROUP_SLOTS		64
+
+/** Count of column pointers of array packing kept on stack */
+#define STRUCT_ARRAY_COLUMNS	32
+
+/** Default size of records block copied at once by blocked strategies, fits into L1 data cache */
+#define STRUCT_BLOCK_SIZE		(16 * 1024)
+
+/** Size of cache line */
+#define STRUCT_CACHE_LINE		64
+
+/** Size of huge page */
+#define STRUCT_HUGE_PAGE_SIZE	(2 * 1024 * 1024)
+
+/** Minimal size of output streamed to memory by STRUCT_STRATEGY_STREAM packing */
+#ifndef STRUCT_STREAM_SIZE
+#define STRUCT_STREAM_SIZE		(8 * 1024 * 1024)
+#endif
+
+/** Count of values converted at once between field and column types */
+#define STRUCT_CONVERT_CHUNK	256
+
+/** Count of records checked at once by struct_validate_array() */
+#define STRUCT_VALIDATE_RECORDS	16
+
+/** Size of records packed by struct_tune() to measure each strategy */
+#define STRUCT_TUNE_SIZE		(1024 * 1024)
+
+/** Count of measurements of each strategy by struct_tune(), the fastest one is taken */
+#define STRUCT_TUNE_ROUNDS		3
+
 /**
  * Calculate count of padding bytes needed to align field with given type
  */
@@ -53,6 +100,11 @@ typedef struct _struct_context
 	int native_size;
 	size_t offset;
 	size_t repeat;
+	int array;
+	int optional;		/**< Fields are parsed inside optional group */
+	size_t slots;		/**< Count of values in optional group */
+	size_t slot;		/**< Number of next value in optional group */
+	uint64_t present;	/**< Presence bitmap of optional group values */
 } struct_context;
 
 /**
@@ -75,6 +127,23 @@ typedef struct _struct_format_field
 	struct_calcsize_basic calcsize;
 } struct_format_field;
 
+/** Field of template packed from arguments */
+typedef struct _struct_template_field
+{
+	const struct_format_field *field;
+	size_t repeat;
+	size_t offset;
+} struct_template_field;
+
+struct _struct_template
+{
+	int byte_order;
+	size_t size;
+	size_t count;					/**< Count of fields which are not bound */
+	uint8_t *record;				/**< Record with packed values of bound fields */
+	struct_template_field fields[];
+};
+
 /**
  * Float to 32-bit integer value conversation
  */
@@ -93,6 +162,16 @@ typedef union _double64
 	uint64_t	i;
 } double64;
 
+/**
+ * Numeric value widened to 64 bits during conversion between field and column types
+ */
+typedef union _struct_number
+{
+	int64_t		i;
+	uint64_t	u;
+	double		d;
+} struct_number;
+
 //
 // Forward Declarations
 //
@@ -109,6 +188,10 @@ static ssize_t struct_pack_bool(void *buffer, struct_context *context, va_list *
 static ssize_t struct_unpack_bool(const void *buffer, struct_context *context, va_list *vl);
 static ssize_t struct_calcsize_bool(struct_context *context);
 
+static ssize_t struct_pack_bits(void *buffer, struct_context *context, va_list *vl);
+static ssize_t struct_unpack_bits(const void *buffer, struct_context *context, va_list *vl);
+static ssize_t struct_calcsize_bits(struct_context *context);
+
 static ssize_t struct_pack_short(void *buffer, struct_context *context, va_list *vl);
 static ssize_t struct_unpack_short(const void *buffer, struct_context *context, va_list *vl);
 static ssize_t struct_calcsize_short(struct_context *context);
@@ -144,6 +227,7 @@ static const struct_format_field struct_format_fields[] = {
 		{ 'b', struct_pack_byte, struct_unpack_byte, struct_calcsize_byte },
 		{ 'B', struct_pack_byte, struct_unpack_byte, struct_calcsize_byte },
 		{ '?', struct_pack_bool, struct_unpack_bool, struct_calcsize_bool },
+		{ 'T', struct_pack_bits, struct_unpack_bits, struct_calcsize_bits },
 		{ 'h', struct_pack_short, struct_unpack_short, struct_calcsize_short },
 		{ 'H', struct_pack_short, struct_unpack_short, struct_calcsize_short },
 		{ 'i', struct_pack_int, struct_unpack_int, struct_calcsize_int },
@@ -312,6 +396,168 @@ static inline uint64_t swab_64(uint64_t v)
 	return result;
 }
 
+/**
+ * Copy array of 16-bit values optionally swapping bytes
+ * @param dst Data destination
+ * @param src Data source
+ * @param count Count of values
+ * @param swap Non-zero to swap bytes of values
+ */
+static void struct_copy_16(void *dst, const void *src, size_t count, int swap)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	size_t i = 0;
+
+	if (!swap)
+	{
+		memcpy(dst, src, count * sizeof(uint16_t));
+		return;
+	}
+
+#ifdef __SSE2__
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *) &s[i * sizeof(uint16_t)]);
+		_mm_storeu_si128((__m128i *) &d[i * sizeof(uint16_t)],
+				_mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+	}
+#endif
+	for (; i < count; i++)
+		stor_16(&d[i * sizeof(uint16_t)], swab_16(load_16(&s[i * sizeof(uint16_t)])));
+}
+
+#ifdef STRUCT_TARGET_SSSE3
+/**
+ * Swap bytes of array of 32-bit values with SSSE3
+ * @return Count of swapped values, the rest are left for scalar copy
+ */
+STRUCT_TARGET_SSSE3 static size_t struct_swap_32_ssse3(uint8_t *d, const uint8_t *s, size_t count)
+{
+	const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	size_t i;
+
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *) &s[i * sizeof(uint32_t)]);
+		_mm_storeu_si128((__m128i *) &d[i * sizeof(uint32_t)], _mm_shuffle_epi8(v, mask));
+	}
+	return i;
+}
+
+/**
+ * Swap bytes of array of 64-bit values with SSSE3
+ * @see struct_swap_32_ssse3()
+ */
+STRUCT_TARGET_SSSE3 static size_t struct_swap_64_ssse3(uint8_t *d, const uint8_t *s, size_t count)
+{
+	const __m128i mask = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	size_t i;
+
+	for (i = 0; i + 2 <= count; i += 2)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *) &s[i * sizeof(uint64_t)]);
+		_mm_storeu_si128((__m128i *) &d[i * sizeof(uint64_t)], _mm_shuffle_epi8(v, mask));
+	}
+	return i;
+}
+#endif
+
+/**
+ * Copy array of 32-bit values optionally swapping bytes
+ * @see struct_copy_16()
+ */
+static void struct_copy_32(void *dst, const void *src, size_t count, int swap)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	size_t i = 0;
+
+	if (!swap)
+	{
+		memcpy(dst, src, count * sizeof(uint32_t));
+		return;
+	}
+
+#ifdef STRUCT_TARGET_SSSE3
+	if (struct_has_ssse3())
+		i = struct_swap_32_ssse3(d, s, count);
+#endif
+	for (; i < count; i++)
+		stor_32(&d[i * sizeof(uint32_t)], swab_32(load_32(&s[i * sizeof(uint32_t)])));
+}
+
+/**
+ * Copy array of 64-bit values optionally swapping bytes
+ * @see struct_copy_16()
+ */
+static void struct_copy_64(void *dst, const void *src, size_t count, int swap)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	size_t i = 0;
+
+	if (!swap)
+	{
+		memcpy(dst, src, count * sizeof(uint64_t));
+		return;
+	}
+
+#ifdef STRUCT_TARGET_SSSE3
+	if (struct_has_ssse3())
+		i = struct_swap_64_ssse3(d, s, count);
+#endif
+	for (; i < count; i++)
+		stor_64(&d[i * sizeof(uint64_t)], swab_64(load_64(&s[i * sizeof(uint64_t)])));
+}
+
+/**
+ * Copy array of boolean values normalizing them to 0 and 1
+ * @param dst Data destination
+ * @param src Data source
+ * @param count Count of values
+ */
+static void struct_copy_bool(void *dst, const void *src, size_t count)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		d[i] = s[i] != 0;
+}
+
+/**
+ * Unpack bitset to array of boolean values
+ * @param dst Boolean values destination
+ * @param src Bitset, least significant bit first
+ * @param count Count of values
+ */
+static void struct_bits_to_bool(void *dst, const void *src, size_t count)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	const __m128i one = _mm_set1_epi8(1);
+
+	// broadcast each of two bitset bytes to eight lanes and test one bit per lane
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i v = _mm_cvtsi32_si128(s[i / 8] | s[i / 8 + 1] << 8);
+		v = _mm_unpacklo_epi8(v, v);
+		v = _mm_unpacklo_epi16(v, v);
+		v = _mm_unpacklo_epi32(v, v);
+		v = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+		_mm_storeu_si128((__m128i *) &d[i], _mm_and_si128(v, one));
+	}
+#endif
+	for (; i < count; i++)
+		d[i] = (s[i / 8] >> (i % 8)) & 1;
+}
+
 static ssize_t struct_pack_pad(void *buffer, struct_context *context, va_list *vl)
 {
 	memset(buffer, 0, context->repeat);
@@ -333,6 +579,12 @@ static ssize_t struct_pack_byte(void *buffer, struct_context *context, va_list *
 	uint8_t *p = buffer;
 	size_t i;
 
+	if (context->array)
+	{
+		memcpy(p, va_arg(*vl, const uint8_t *), context->repeat);
+		return context->repeat * sizeof(uint8_t);
+	}
+
 	for (i = 0; i < context->repeat; i++)
 		*p++ = va_arg(*vl, int);
 
@@ -344,6 +596,12 @@ static ssize_t struct_unpack_byte(const void *buffer, struct_context *context, v
 	const int8_t *p = buffer;
 	size_t i;
 
+	if (context->array)
+	{
+		memcpy(va_arg(*vl, int8_t *), p, context->repeat);
+		return context->repeat * sizeof(int8_t);
+	}
+
 	for (i = 0; i < context->repeat; i++)
 		*va_arg(*vl, int8_t*) = *p++;
 
@@ -360,6 +618,12 @@ static ssize_t struct_pack_bool(void *buffer, struct_context *context, va_list *
 	int8_t *p = buffer;
 	size_t i;
 
+	if (context->array)
+	{
+		struct_copy_bool(p, va_arg(*vl, const uint8_t *), context->repeat);
+		return context->repeat * sizeof(int8_t);
+	}
+
 	for (i = 0; i < context->repeat; i++)
 		*p++ = va_arg(*vl, int) != 0;
 
@@ -371,6 +635,12 @@ static ssize_t struct_unpack_bool(const void *buffer, struct_context *context, v
 	const int8_t *p = buffer;
 	size_t i;
 
+	if (context->array)
+	{
+		struct_copy_bool(va_arg(*vl, uint8_t *), p, context->repeat);
+		return context->repeat * sizeof(int8_t);
+	}
+
 	for (i = 0; i < context->repeat; i++)
 		*va_arg(*vl, int8_t*) = (*p++ != 0);
 
@@ -382,6 +652,46 @@ static ssize_t struct_calcsize_bool(struct_context *context)
 	return context->repeat * sizeof(uint8_t);
 }
 
+static ssize_t struct_pack_bits(void *buffer, struct_context *context, va_list *vl)
+{
+	uint8_t *p = buffer;
+	size_t i;
+
+	if (context->array)
+	{
+		struct_bits_from_bool(p, va_arg(*vl, const uint8_t *), context->repeat);
+		return (context->repeat + 7) / 8;
+	}
+
+	memset(p, 0, (context->repeat + 7) / 8);
+	for (i = 0; i < context->repeat; i++)
+		p[i / 8] |= (va_arg(*vl, int) != 0) << (i % 8);
+
+	return (context->repeat + 7) / 8;
+}
+
+static ssize_t struct_unpack_bits(const void *buffer, struct_context *context, va_list *vl)
+{
+	const uint8_t *p = buffer;
+	size_t i;
+
+	if (context->array)
+	{
+		struct_bits_to_bool(va_arg(*vl, uint8_t *), p, context->repeat);
+		return (context->repeat + 7) / 8;
+	}
+
+	for (i = 0; i < context->repeat; i++)
+		*va_arg(*vl, int8_t*) = (p[i / 8] >> (i % 8)) & 1;
+
+	return (context->repeat + 7) / 8;
+}
+
+static ssize_t struct_calcsize_bits(struct_context *context)
+{
+	return (context->repeat + 7) / 8;
+}
+
 static ssize_t struct_pack_short(void *buffer, struct_context *context, va_list *vl)
 {
 	int16_t *p;
@@ -391,6 +701,12 @@ static ssize_t struct_pack_short(void *buffer, struct_context *context, va_list
 	memset(buffer, 0, padding);
 	p = buffer + padding;
 
+	if (context->array)
+	{
+		struct_copy_16(p, va_arg(*vl, const int16_t *), context->repeat, context->byte_order != BYTE_ORDER);
+		return (void *) (p + context->repeat) - buffer;
+	}
+
 	for (i = 0; i < context->repeat; i++)
 	{
 		int16_t v = va_arg(*vl, int);
@@ -410,6 +726,12 @@ static ssize_t struct_unpack_short(const void *buffer, struct_context *context,
 
 	p = buffer + struct_field_padding(context, int16_t);
 
+	if (context->array)
+	{
+		struct_copy_16(va_arg(*vl, int16_t *), p, context->repeat, context->byte_order != BYTE_ORDER);
+		return (void *) (p + context->repeat) - buffer;
+	}
+
 	for (i = 0; i < context->repeat; i++)
 	{
 		int16_t v = load_16(p);
@@ -436,6 +758,12 @@ static ssize_t struct_pack_int(void *buffer, struct_context *context, va_list *v
 	memset(buffer, 0, padding);
 	p = buffer + padding;
 
+	if (context->array)
+	{
+		struct_copy_32(p, va_arg(*vl, const uint32_t *), context->repeat, context->byte_order != BYTE_ORDER);
+		return (void *) (p + context->repeat) - buffer;
+	}
+
 	for (i = 0; i < context->repeat; i++)
 	{
 		uint32_t v = va_arg(*vl, uint32_t);
@@ -455,6 +783,12 @@ static ssize_t struct_unpack_int(const void *buffer, struct_context *context, va
 
 	p = buffer + struct_field_padding(context, uint32_t);
 
+	if (context->array)
+	{
+		struct_copy_32(va_arg(*vl, uint32_t *), p, context->repeat, context->byte_order != BYTE_ORDER);
+		return (void *) (p + context->repeat) - buffer;
+	}
+
 	for (i = 0; i < context->repeat; i++)
 	{
 		uint32_t v = load_32(p);
@@ -481,6 +815,12 @@ static ssize_t struct_pack_quad(void *buffer, struct_context *context, va_list *
 	memset(buffer, 0, padding);
 	p = buffer + padding;
 
+	if (context->array)
+	{
+		struct_copy_64(p, va_arg(*vl, const uint64_t *), context->repeat, context->byte_order != BYTE_ORDER);
+		return (void *) (p + context->repeat) - buffer;
+	}
+
 	for (i = 0; i < context->repeat; i++)
 	{
 		uint64_t v = va_arg(*vl, uint64_t);
@@ -500,6 +840,12 @@ static ssize_t struct_unpack_quad(const void *buffer, struct_context *context, v
 
 	p = buffer + struct_field_padding(context, uint64_t);
 
+	if (context->array)
+	{
+		struct_copy_64(va_arg(*vl, uint64_t *), p, context->repeat, context->byte_order != BYTE_ORDER);
+		return (void *) (p + context->repeat) - buffer;
+	}
+
 	for (i = 0; i < context->repeat; i++)
 	{
 		uint64_t v = load_64(p);
@@ -526,6 +872,12 @@ static ssize_t struct_pack_float(void *buffer, struct_context *context, va_list
 	memset(buffer, 0, padding);
 	p = buffer + padding;
 
+	if (context->array)
+	{
+		struct_copy_32(p, va_arg(*vl, const float *), context->repeat, context->byte_order != BYTE_ORDER);
+		return (void *) (p + context->repeat) - buffer;
+	}
+
 	for (i = 0; i < context->repeat; i++)
 	{
 		float32 v;
@@ -546,6 +898,12 @@ static ssize_t struct_unpack_float(const void *buffer, struct_context *context,
 
 	p = buffer + struct_field_padding(context, float);
 
+	if (context->array)
+	{
+		struct_copy_32(va_arg(*vl, float *), p, context->repeat, context->byte_order != BYTE_ORDER);
+		return (void *) (p + context->repeat) - buffer;
+	}
+
 	for (i = 0; i < context->repeat; i++)
 	{
 		float32 v;
@@ -573,6 +931,12 @@ static ssize_t struct_pack_double(void *buffer, struct_context *context, va_list
 	memset(buffer, 0, padding);
 	p = buffer + padding;
 
+	if (context->array)
+	{
+		struct_copy_64(p, va_arg(*vl, const double *), context->repeat, context->byte_order != BYTE_ORDER);
+		return (void *) (p + context->repeat) - buffer;
+	}
+
 	for (i = 0; i < context->repeat; i++)
 	{
 		double64 v;
@@ -594,6 +958,12 @@ static ssize_t struct_unpack_double(const void *buffer, struct_context *context,
 
 	p = buffer + padding;
 
+	if (context->array)
+	{
+		struct_copy_64(va_arg(*vl, double *), p, context->repeat, context->byte_order != BYTE_ORDER);
+		return (void *) (p + context->repeat) - buffer;
+	}
+
 	for (i = 0; i < context->repeat; i++)
 	{
 		double64 v;
@@ -659,6 +1029,11 @@ const char* struct_parse_field(const char *format, struct_context *context, cons
 	// whitespace characters between formats are ignored
 	while (isspace(*c)) c++;
 
+	// array modifier before repeat count
+	context->array = (*c == STRUCT_ARRAY_MODIFIER);
+	if (context->array)
+		c++;
+
 	// read integral repeat count
 	if (isdigit(*c))
 	{
@@ -681,6 +1056,10 @@ const char* struct_parse_field(const char *format, struct_context *context, cons
 	else
 		*field = NULL;
 
+	// padding and strings never take values by array
+	if (*field != NULL && context->array && ((*field)->format == 'x' || (*field)->format == 's'))
+		*field = NULL;
+
 	return c;
 }
 
@@ -725,131 +1104,2277 @@ const char* struct_parse_prefix(const char *format, struct_context *context)
 	return c;
 }
 
-//
-// Public Services
-//
+/**
+ * Calculate size of field values without alignment padding
+ * @param field Field format definition
+ * @param context Struct parsing context with field repeat count
+ * @return Size of field values or negative when failed
+ */
+static ssize_t struct_field_size(const struct_format_field *field, struct_context *context)
+{
+	int native_alignment = context->native_alignment;
+	ssize_t result;
 
-ssize_t struct_pack(void *buffer, size_t size, const char *format, ...)
+	context->native_alignment = 0;
+	result = field->calcsize(context);
+	context->native_alignment = native_alignment;
+
+	return result;
+}
+
+/**
+ * Count values of optional group, each value of repeated field is separate
+ * optional value except strings, padding and bitsets are not allowed in group
+ * @param format Format string after beginning of group
+ * @return Count of values or negative for malformed group
+ */
+static ssize_t struct_group_slots(const char *format)
 {
-	const char *c, *next;
+	const char *c = format;
 	struct_context context;
 	const struct_format_field *field;
-	ssize_t field_size;
-	uint8_t *p;
-	va_list vl;
-
-	if (buffer == NULL || format == NULL)
-		return -1;
+	size_t slots = 0;
 
 	memset(&context, 0, sizeof(context));
-	c = struct_parse_prefix(format, &context);
-	p = buffer;
-	va_start(vl, format);
-
-	while (*c != '\0')
+	for (;;)
 	{
-		next = struct_parse_field(c, &context, &field);
-		if (field == NULL)
+		while (isspace(*c)) c++;
+		if (*c == STRUCT_GROUP_END)
 			break;
 
-		field_size = field->calcsize(&context);
-		if ((uint8_t *) buffer + size - p < field_size)
-			break;
+		c = struct_parse_field(c, &context, &field);
+		if (field == NULL || field->format == 'x' || field->format == 'T' || context.array)
+			return -1;
+		slots += field->format == 's' ? 1 : context.repeat;
+	}
 
-		if (field->pack(p, &context, &vl) != field_size)
-			break;
+	return slots <= STRUCT_GROUP_SLOTS ? (ssize_t) slots : -1;
+}
 
-		p += field_size;
-		context.offset += field_size;
-		c = next;
-	}
+/**
+ * Start or finish optional group
+ * @param group Beginning or end of group character in format string
+ * @param context Struct parsing context
+ * @return Size of presence bitmap or negative for malformed group
+ */
+static ssize_t struct_parse_group(const char *group, struct_context *context)
+{
+	ssize_t slots;
 
-	va_end(vl);
+	if (*group == STRUCT_GROUP_END)
+	{
+		if (!context->optional)
+			return -1;
+		context->optional = 0;
+		return 0;
+	}
 
-	// not parse whole format string
-	if (*c != '\0')
+	if (context->optional)
+		return -1;
+	slots = struct_group_slots(group + 1);
+	if (slots < 0)
 		return -1;
 
-	return p - (uint8_t *) buffer;
+	context->optional = 1;
+	context->slots = slots;
+	context->slot = 0;
+	context->present = 0;
+	return (slots + 7) / 8;
 }
 
-ssize_t struct_unpack(const void *buffer, size_t size, const char *format, ...)
+/**
+ * Pack values of optional group field which are marked in presence bitmap
+ * @param buffer Destination buffer
+ * @param size Size of destination buffer
+ * @param field Field format definition
+ * @param context Struct parsing context
+ * @param vl Values of present fields
+ * @return Size of packed values or negative when failed
+ */
+static ssize_t struct_pack_optional(void *buffer, size_t size, const struct_format_field *field,
+		struct_context *context, va_list *vl)
 {
-	const char *c, *next;
-	struct_context context;
-	const struct_format_field *field;
+	size_t values = field->format == 's' ? 1 : context->repeat;
+	size_t repeat = context->repeat;
+	uint8_t *p = buffer;
 	ssize_t field_size;
-	const uint8_t *p;
-	va_list vl;
-
-	if (buffer == NULL || format == NULL)
-		return -1;
+	size_t i;
 
-	memset(&context, 0, sizeof(context));
-	c = struct_parse_prefix(format, &context);
-	p = buffer;
-	va_start(vl, format);
+	if (field->format != 's')
+		context->repeat = 1;
 
-	while (*c != '\0')
+	for (i = 0; i < values; i++, context->slot++)
 	{
-		next = struct_parse_field(c, &context, &field);
-		if (field == NULL)
-			break;
-
-		field_size = field->calcsize(&context);
-		if ((const uint8_t *) buffer + size - p < field_size)
-			break;
-
-		if (field->unpack(p, &context, &vl) != field_size)
-			break;
+		if (!(context->present & (1ULL << context->slot)))
+			continue;
 
+		field_size = field->calcsize(context);
+		if ((uint8_t *) buffer + size - p < field_size || field->pack(p, context, vl) != field_size)
+			return -1;
 		p += field_size;
-		context.offset += field_size;
-		c = next;
+		context->offset += field_size;
 	}
 
-	va_end(vl);
-
-	// not parse whole format string
-	if (*c != '\0')
-		return -1;
-
+	context->repeat = repeat;
 	return p - (uint8_t *) buffer;
 }
 
-ssize_t struct_calcsize(const char *format)
-{
-	const char *c, *next;
+/**
+ * Unpack values of optional group field, destinations of absent values are filled by zeros
+ * @param buffer Source buffer
+ * @param size Size of source buffer
+ * @param field Field format definition
+ * @param context Struct parsing context
+ * @param vl Destinations for all values
+ * @return Size of unpacked values or negative when failed
+ */
+static ssize_t struct_unpack_optional(const void *buffer, size_t size, const struct_format_field *field,
+		struct_context *context, va_list *vl)
+{
+	size_t values = field->format == 's' ? 1 : context->repeat;
+	size_t repeat = context->repeat;
+	const uint8_t *p = buffer;
+	ssize_t field_size;
+	size_t i;
+
+	if (field->format != 's')
+		context->repeat = 1;
+
+	for (i = 0; i < values; i++, context->slot++)
+	{
+		if (!(context->present & (1ULL << context->slot)))
+		{
+			if (field->format == 's')
+			{
+				char *str = va_arg(*vl, char *);
+				if (va_arg(*vl, size_t) > 0)
+					*str = '\0';
+			}
+			else
+			{
+				memset(va_arg(*vl, void *), 0, struct_field_size(field, context));
+			}
+			continue;
+		}
+
+		field_size = field->calcsize(context);
+		if ((const uint8_t *) buffer + size - p < field_size || field->unpack(p, context, vl) != field_size)
+			return -1;
+		p += field_size;
+		context->offset += field_size;
+	}
+
+	context->repeat = repeat;
+	return p - (const uint8_t *) buffer;
+}
+
+/**
+ * Copy values of compiled field between packed records and array
+ * Fields with single value are copied by direct loads and stores, repeated
+ * fields by array copy for each record.
+ * @param dst Data destination
+ * @param dst_stride Distance between values of consecutive records in destination
+ * @param src Data source
+ * @param src_stride Distance between values of consecutive records in source
+ * @param field Compiled field
+ * @param count Count of records
+ * @param swap Non-zero to swap bytes of values
+ */
+static void struct_copy_column(uint8_t *dst, size_t dst_stride, const uint8_t *src, size_t src_stride,
+		const struct_field *field, size_t count, int swap)
+{
+	size_t width = field->size / field->repeat;
+	size_t n;
+
+	if (field->format == '?')
+	{
+		for (n = 0; n < count; n++)
+			struct_copy_bool(dst + n * dst_stride, src + n * src_stride, field->repeat);
+		return;
+	}
+
+	if (field->repeat == 1)
+	{
+		switch (width)
+		{
+		case sizeof(uint8_t):
+			for (n = 0; n < count; n++)
+				dst[n * dst_stride] = src[n * src_stride];
+			return;
+		case sizeof(uint16_t):
+			for (n = 0; n < count; n++)
+			{
+				uint16_t v = load_16(src + n * src_stride);
+				stor_16(dst + n * dst_stride, swap ? swab_16(v) : v);
+			}
+			return;
+		case sizeof(uint32_t):
+			for (n = 0; n < count; n++)
+			{
+				uint32_t v = load_32(src + n * src_stride);
+				stor_32(dst + n * dst_stride, swap ? swab_32(v) : v);
+			}
+			return;
+		case sizeof(uint64_t):
+			for (n = 0; n < count; n++)
+			{
+				uint64_t v = load_64(src + n * src_stride);
+				stor_64(dst + n * dst_stride, swap ? swab_64(v) : v);
+			}
+			return;
+		}
+	}
+
+	for (n = 0; n < count; n++)
+	{
+		switch (width)
+		{
+		case sizeof(uint16_t):
+			struct_copy_16(dst + n * dst_stride, src + n * src_stride, field->repeat, swap);
+			break;
+		case sizeof(uint32_t):
+			struct_copy_32(dst + n * dst_stride, src + n * src_stride, field->repeat, swap);
+			break;
+		case sizeof(uint64_t):
+			struct_copy_64(dst + n * dst_stride, src + n * src_stride, field->repeat, swap);
+			break;
+		default:
+			memcpy(dst + n * dst_stride, src + n * src_stride, field->size);
+			break;
+		}
+	}
+}
+
+/**
+ * Get kind of numeric format character
+ * @param format Format character
+ * @return 'i' for signed integers, 'u' for unsigned integers and booleans,
+ * 'f' for floating point or zero for other formats
+ */
+static int struct_number_kind(char format)
+{
+	switch (format)
+	{
+	case 'b': case 'h': case 'i': case 'l': case 'q':
+		return 'i';
+	case 'B': case 'H': case 'I': case 'L': case 'Q': case '?':
+		return 'u';
+	case 'f': case 'd':
+		return 'f';
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Get size of numeric value in standard size
+ */
+static size_t struct_number_size(char format)
+{
+	switch (format)
+	{
+	case 'h': case 'H':
+		return sizeof(uint16_t);
+	case 'i': case 'I': case 'l': case 'L': case 'f':
+		return sizeof(uint32_t);
+	case 'q': case 'Q': case 'd':
+		return sizeof(uint64_t);
+	default:
+		return sizeof(uint8_t);
+	}
+}
+
+/**
+ * Load numeric values to 64-bit integers or doubles
+ * Values are accessed by memcpy(), which is compiled to single unaligned access.
+ * @param dst Loaded values
+ * @param src First value
+ * @param stride Distance between values
+ * @param format Format character of values
+ * @param count Count of values
+ * @param swap Non-zero to swap bytes of values
+ */
+static void struct_load_numbers(struct_number *dst, const uint8_t *src, size_t stride, char format, size_t count,
+		int swap)
+{
+	float32 f32;
+	double64 d64;
+	size_t n;
+
+	switch (format)
+	{
+	case 'b':
+		for (n = 0; n < count; n++)
+			dst[n].i = (int8_t) src[n * stride];
+		return;
+	case '?':
+		for (n = 0; n < count; n++)
+			dst[n].u = src[n * stride] != 0;
+		return;
+	case 'B':
+		for (n = 0; n < count; n++)
+			dst[n].u = src[n * stride];
+		return;
+	case 'h':
+		for (n = 0; n < count; n++)
+		{
+			uint16_t v;
+
+			memcpy(&v, src + n * stride, sizeof(v));
+			dst[n].i = (int16_t) (swap ? swab_16(v) : v);
+		}
+		return;
+	case 'H':
+		for (n = 0; n < count; n++)
+		{
+			uint16_t v;
+
+			memcpy(&v, src + n * stride, sizeof(v));
+			dst[n].u = swap ? swab_16(v) : v;
+		}
+		return;
+	case 'i':
+	case 'l':
+		for (n = 0; n < count; n++)
+		{
+			uint32_t v;
+
+			memcpy(&v, src + n * stride, sizeof(v));
+			dst[n].i = (int32_t) (swap ? swab_32(v) : v);
+		}
+		return;
+	case 'f':
+		for (n = 0; n < count; n++)
+		{
+			uint32_t v;
+
+			memcpy(&v, src + n * stride, sizeof(v));
+			f32.i = swap ? swab_32(v) : v;
+			dst[n].d = f32.f;
+		}
+		return;
+	case 'd':
+		for (n = 0; n < count; n++)
+		{
+			uint64_t v;
+
+			memcpy(&v, src + n * stride, sizeof(v));
+			d64.i = swap ? swab_64(v) : v;
+			dst[n].d = d64.d;
+		}
+		return;
+	case 'q':
+	case 'Q':
+		for (n = 0; n < count; n++)
+		{
+			uint64_t v;
+
+			memcpy(&v, src + n * stride, sizeof(v));
+			dst[n].u = swap ? swab_64(v) : v;
+		}
+		return;
+	default:
+		for (n = 0; n < count; n++)
+		{
+			uint32_t v;
+
+			memcpy(&v, src + n * stride, sizeof(v));
+			dst[n].u = swap ? swab_32(v) : v;
+		}
+		return;
+	}
+}
+
+/**
+ * Store 64-bit integers or doubles as numeric values
+ * @see struct_load_numbers()
+ */
+static void struct_store_numbers(uint8_t *dst, size_t stride, char format, const struct_number *src, size_t count,
+		int swap)
+{
+	float32 f32;
+	double64 d64;
+	uint16_t v16;
+	uint32_t v32;
+	uint64_t v64;
+	size_t n;
+
+	switch (format)
+	{
+	case '?':
+		for (n = 0; n < count; n++)
+			dst[n * stride] = src[n].u != 0;
+		return;
+	case 'f':
+		for (n = 0; n < count; n++)
+		{
+			f32.f = src[n].d;
+			v32 = swap ? swab_32(f32.i) : f32.i;
+			memcpy(dst + n * stride, &v32, sizeof(v32));
+		}
+		return;
+	case 'd':
+		for (n = 0; n < count; n++)
+		{
+			d64.d = src[n].d;
+			v64 = swap ? swab_64(d64.i) : d64.i;
+			memcpy(dst + n * stride, &v64, sizeof(v64));
+		}
+		return;
+	}
+
+	switch (struct_number_size(format))
+	{
+	case sizeof(uint8_t):
+		for (n = 0; n < count; n++)
+			dst[n * stride] = src[n].u;
+		return;
+	case sizeof(uint16_t):
+		for (n = 0; n < count; n++)
+		{
+			v16 = swap ? swab_16(src[n].u) : src[n].u;
+			memcpy(dst + n * stride, &v16, sizeof(v16));
+		}
+		return;
+	case sizeof(uint32_t):
+		for (n = 0; n < count; n++)
+		{
+			v32 = swap ? swab_32(src[n].u) : src[n].u;
+			memcpy(dst + n * stride, &v32, sizeof(v32));
+		}
+		return;
+	default:
+		for (n = 0; n < count; n++)
+		{
+			v64 = swap ? swab_64(src[n].u) : src[n].u;
+			memcpy(dst + n * stride, &v64, sizeof(v64));
+		}
+		return;
+	}
+}
+
+#ifdef __SSE2__
+/**
+ * Interleave integers with their sign or zero extension
+ * @param v Integers
+ * @param width Size of integer
+ * @param sign Non-zero to extend sign
+ * @param lo Lower half of integers widened twice
+ * @param hi Upper half of integers widened twice
+ */
+static inline void struct_widen_step(__m128i v, size_t width, int sign, __m128i *lo, __m128i *hi)
+{
+	__m128i ext = _mm_setzero_si128();
+
+	if (sign)
+	{
+		if (width == sizeof(uint8_t))
+			ext = _mm_cmplt_epi8(v, ext);
+		else if (width == sizeof(uint16_t))
+			ext = _mm_srai_epi16(v, 15);
+		else
+			ext = _mm_srai_epi32(v, 31);
+	}
+
+	if (width == sizeof(uint8_t))
+	{
+		*lo = _mm_unpacklo_epi8(v, ext);
+		*hi = _mm_unpackhi_epi8(v, ext);
+	}
+	else if (width == sizeof(uint16_t))
+	{
+		*lo = _mm_unpacklo_epi16(v, ext);
+		*hi = _mm_unpackhi_epi16(v, ext);
+	}
+	else
+	{
+		*lo = _mm_unpacklo_epi32(v, ext);
+		*hi = _mm_unpackhi_epi32(v, ext);
+	}
+}
+
+/**
+ * Widen contiguous integers with SSE2 sign or zero extension
+ * @param dst Destination of wide values
+ * @param dst_size Size of wide value
+ * @param src Source values in system order
+ * @param src_size Size of source value
+ * @param sign Non-zero to extend sign
+ * @param count Count of values
+ * @return Count of converted values, the rest are left for scalar conversion
+ */
+static size_t struct_widen_128(uint8_t *dst, size_t dst_size, const uint8_t *src, size_t src_size, int sign,
+		size_t count)
+{
+	const size_t step = sizeof(__m128i) / src_size;
+	size_t n, i;
+
+	for (n = 0; n + step <= count; n += step)
+	{
+		__m128i *out = (__m128i *) (dst + n * dst_size);
+		__m128i v[8];
+
+		struct_widen_step(_mm_loadu_si128((const __m128i *) (src + n * src_size)), src_size, sign, &v[0], &v[1]);
+		if (dst_size == 2 * src_size)
+		{
+			_mm_storeu_si128(out, v[0]);
+			_mm_storeu_si128(out + 1, v[1]);
+			continue;
+		}
+
+		struct_widen_step(v[1], 2 * src_size, sign, &v[2], &v[3]);
+		struct_widen_step(v[0], 2 * src_size, sign, &v[0], &v[1]);
+		if (dst_size == 4 * src_size)
+		{
+			_mm_storeu_si128(out, v[0]);
+			_mm_storeu_si128(out + 1, v[1]);
+			_mm_storeu_si128(out + 2, v[2]);
+			_mm_storeu_si128(out + 3, v[3]);
+			continue;
+		}
+
+		// bytes to 64-bit integers
+		struct_widen_step(v[3], sizeof(uint32_t), sign, &v[6], &v[7]);
+		struct_widen_step(v[2], sizeof(uint32_t), sign, &v[4], &v[5]);
+		struct_widen_step(v[1], sizeof(uint32_t), sign, &v[2], &v[3]);
+		struct_widen_step(v[0], sizeof(uint32_t), sign, &v[0], &v[1]);
+		for (i = 0; i < 8; i++)
+			_mm_storeu_si128(out + i, v[i]);
+	}
+	return n;
+}
+#endif
+
+/**
+ * Convert run of numeric values
+ * Widening of contiguous integers and floats in system order is done by SSE2,
+ * other values are converted through small buffer of 64-bit values in cache.
+ * @param dst First destination value
+ * @param dst_stride Distance between destination values
+ * @param dst_format Format character of destination values
+ * @param dst_swap Non-zero to swap bytes of destination values
+ * @param src First source value
+ * @param src_stride Distance between source values
+ * @param src_format Format character of source values
+ * @param src_swap Non-zero to swap bytes of source values
+ * @param count Count of values
+ */
+static void struct_convert_numbers(uint8_t *dst, size_t dst_stride, char dst_format, int dst_swap,
+		const uint8_t *src, size_t src_stride, char src_format, int src_swap, size_t count)
+{
+	struct_number buffer[STRUCT_CONVERT_CHUNK];
+	int dst_kind = struct_number_kind(dst_format);
+	int src_kind = struct_number_kind(src_format);
+	size_t dst_size = struct_number_size(dst_format);
+	size_t src_size = struct_number_size(src_format);
+	size_t chunk, n;
+
+#ifdef __SSE2__
+	if (!dst_swap && !src_swap && dst_stride == dst_size && src_stride == src_size)
+	{
+		size_t done = 0;
+
+		if (src_kind != 'f' && dst_kind != 'f' && dst_format != '?' && src_format != '?' && dst_size > src_size)
+			done = struct_widen_128(dst, dst_size, src, src_size, src_kind == 'i', count);
+
+		if (src_format == 'f' && dst_format == 'd')
+		{
+			for (; done + 4 <= count; done += 4)
+			{
+				__m128 v = _mm_loadu_ps((const float *) src + done);
+
+				_mm_storeu_pd((double *) dst + done, _mm_cvtps_pd(v));
+				_mm_storeu_pd((double *) dst + done + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+			}
+		}
+
+		dst += done * dst_size;
+		src += done * src_size;
+		count -= done;
+	}
+#endif
+
+	// aligned contiguous 64-bit values of the same kind are loaded in place
+	if (!dst_swap && dst_stride == sizeof(struct_number) && dst_size == sizeof(struct_number) &&
+			(uintptr_t) dst % __alignof__(struct_number) == 0 && (src_kind == 'f') == (dst_kind == 'f'))
+	{
+		struct_load_numbers((struct_number *) dst, src, src_stride, src_format, count, src_swap);
+		return;
+	}
+
+	for (; count > 0; count -= chunk)
+	{
+		chunk = count < STRUCT_CONVERT_CHUNK ? count : STRUCT_CONVERT_CHUNK;
+		struct_load_numbers(buffer, src, src_stride, src_format, chunk, src_swap);
+
+		if (src_kind != 'f' && dst_kind == 'f')
+			for (n = 0; n < chunk; n++)
+				buffer[n].d = src_kind == 'i' ? (double) buffer[n].i : (double) buffer[n].u;
+
+		struct_store_numbers(dst, dst_stride, dst_format, buffer, chunk, dst_swap);
+		dst += chunk * dst_stride;
+		src += chunk * src_stride;
+	}
+}
+
+/**
+ * Copy values of field between records and column of other type
+ * @param p First record
+ * @param format Compiled format
+ * @param field Compiled field
+ * @param column Values of first record in memory
+ * @param stride Distance between values of consecutive records in memory
+ * @param type Format character of values in memory
+ * @param count Count of records
+ * @param unpack Non-zero to copy from records to column
+ */
+static void struct_convert_column(uint8_t *p, const struct_format *format, const struct_field *field,
+		uint8_t *column, size_t stride, char type, size_t count, int unpack)
+{
+	int swap = format->byte_order != BYTE_ORDER;
+	size_t width = struct_number_size(field->format);
+	size_t size = struct_number_size(type);
+	size_t n;
+
+	// single values are converted over all records, repeated values record by record
+	if (field->repeat == 1)
+	{
+		if (unpack)
+			struct_convert_numbers(column, stride, type, 0, p + field->offset, format->size, field->format, swap,
+					count);
+		else
+			struct_convert_numbers(p + field->offset, format->size, field->format, swap, column, stride, type, 0,
+					count);
+		return;
+	}
+
+	for (n = 0; n < count; n++)
+	{
+		uint8_t *record = p + n * format->size + field->offset;
+
+		if (unpack)
+			struct_convert_numbers(column + n * stride, size, type, 0, record, width, field->format, swap,
+					field->repeat);
+		else
+			struct_convert_numbers(record, width, field->format, swap, column + n * stride, size, type, 0,
+					field->repeat);
+	}
+}
+
+/**
+ * Check if values of field can be copied from or to column of given type
+ * @param field Compiled field
+ * @param type Format character of column values, zero for type of field
+ * @param unpack Non-zero to copy from records to column
+ * @return Non-zero when supported
+ */
+static int struct_column_type_valid(const struct_field *field, char type, int unpack)
+{
+	int field_kind = struct_number_kind(field->format);
+	int type_kind = struct_number_kind(type);
+
+	if (type == '\0' || type == field->format)
+		return 1;
+	if (field_kind == 0 || type_kind == 0)
+		return 0;
+
+	// floating point values are not converted to integers
+	if (unpack)
+		return field_kind != 'f' || type_kind == 'f';
+	return type_kind != 'f' || field_kind == 'f';
+}
+
+/**
+ * Fill bytes not belonging to field values in array of packed records with zeros
+ * @param records Packed records
+ * @param format Compiled format
+ * @param count Count of records
+ */
+static void struct_clear_padding(uint8_t *records, const struct_format *format, size_t count)
+{
+	size_t end = 0;
+	size_t i, n;
+
+	for (i = 0; i < format->count; i++)
+	{
+		const struct_field *f = &format->fields[i];
+		size_t start = f->offset + (f->format == 'x' ? f->size : 0);
+
+		if (start > end)
+			for (n = 0; n < count; n++)
+				memset(records + n * format->size + end, 0, start - end);
+		end = f->offset + f->size;
+	}
+}
+
+/**
+ * Copy values of all fields between block of packed records and arrays
+ * @param p First record of block
+ * @param format Compiled format
+ * @param columns Values of each field, base is NULL for fields without values
+ * @param first Index of first record of block in columns
+ * @param count Count of records in block
+ * @param unpack Non-zero to copy from records to columns
+ */
+static void struct_copy_block(uint8_t *p, const struct_format *format, const struct_column *columns,
+		size_t first, size_t count, int unpack)
+{
+	int swap = format->byte_order != BYTE_ORDER;
+	size_t i, n;
+
+	if (!unpack)
+		struct_clear_padding(p, format, count);
+
+	for (i = 0; i < format->count; i++)
+	{
+		const struct_field *f = &format->fields[i];
+		size_t stride = columns[i].stride;
+		uint8_t *column;
+
+		if (columns[i].base == NULL)
+			continue;
+		column = (uint8_t *) columns[i].base + first * stride;
+
+		if (columns[i].type != '\0' && columns[i].type != f->format)
+		{
+			struct_convert_column(p, format, f, column, stride, columns[i].type, count, unpack);
+			continue;
+		}
+
+		// bitset field takes array of booleans, one byte per value
+		if (f->format == 'T')
+		{
+			for (n = 0; n < count; n++)
+			{
+				if (unpack)
+					struct_bits_to_bool(column + n * stride, p + n * format->size + f->offset, f->repeat);
+				else
+					struct_bits_from_bool(p + n * format->size + f->offset, column + n * stride, f->repeat);
+			}
+			continue;
+		}
+
+		if (unpack)
+			struct_copy_column(column, stride, p + f->offset, format->size, f, count, swap);
+		else
+			struct_copy_column(p + f->offset, format->size, column, stride, f, count, swap);
+	}
+}
+
+/**
+ * Prefetch data to cache
+ * @param p Data
+ * @param size Size of data
+ */
+static void struct_prefetch(const uint8_t *p, size_t size)
+{
+#ifdef __SSE2__
+	const uint8_t *end;
+
+	for (end = p + size; p < end; p += STRUCT_CACHE_LINE)
+		_mm_prefetch((const char *) p, _MM_HINT_T0);
+#endif
+}
+
+#ifdef __SSE2__
+/**
+ * Copy data to memory with non-temporal stores, bypassing cache
+ * Caller must issue store fence after all copies.
+ * @param dst Destination
+ * @param src Source aligned to 16 bytes
+ * @param size Size of data
+ */
+static void struct_copy_stream(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t head = -(uintptr_t) dst & (sizeof(__m128i) - 1);
+	const uint8_t *end;
+
+	if (head > size)
+		head = size;
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	size -= head;
+
+	for (end = src + (size & ~(sizeof(__m128i) - 1)); src < end; src += sizeof(__m128i), dst += sizeof(__m128i))
+		_mm_stream_si128((__m128i *) dst, _mm_loadu_si128((const __m128i *) src));
+	memcpy(dst, src, size & (sizeof(__m128i) - 1));
+}
+#endif
+
+/**
+ * Copy values of all fields between packed records and arrays
+ * Blocks of records are copied field by field, size of block depends on
+ * packing strategy of format. Large output of STRUCT_STRATEGY_STREAM
+ * packing is prepared block by block in cache and streamed to memory.
+ * When unpacking by blocks, records at prefetch distance of format ahead
+ * of block are requested to cache before copying block.
+ * @param records Packed records
+ * @param format Compiled format
+ * @param columns Values of each field, base is NULL for fields without values
+ * @param count Count of records
+ * @param unpack Non-zero to copy from records to columns
+ */
+static void struct_copy_records(uint8_t *records, const struct_format *format, const struct_column *columns,
+		size_t count, int unpack)
+{
+	size_t bytes = format->block > 0 ? format->block : STRUCT_BLOCK_SIZE;
+	size_t block = count;
+	size_t first;
+
+	if (format->strategy != STRUCT_STRATEGY_COLUMNS && format->size > 0)
+		block = format->size < bytes ? bytes / format->size : 1;
+
+#ifdef __SSE2__
+	if (format->strategy == STRUCT_STRATEGY_STREAM && !unpack && format->size <= STRUCT_BLOCK_SIZE &&
+			count * format->size >= STRUCT_STREAM_SIZE)
+	{
+		__m128i staging[STRUCT_BLOCK_SIZE / sizeof(__m128i)];
+
+		// staging buffer limits size of block
+		block = STRUCT_BLOCK_SIZE / format->size;
+		for (first = 0; first < count; first += block)
+		{
+			if (block > count - first)
+				block = count - first;
+			struct_copy_block((uint8_t *) staging, format, columns, first, block, 0);
+			struct_copy_stream(records + first * format->size, (const uint8_t *) staging, block * format->size);
+		}
+		_mm_sfence();
+		return;
+	}
+#endif
+
+	for (first = 0; first < count; first += block)
+	{
+		uint8_t *p = records + first * format->size;
+
+		if (block > count - first)
+			block = count - first;
+
+		if (unpack && format->strategy != STRUCT_STRATEGY_COLUMNS && format->prefetch > 0 &&
+				format->prefetch < (count - first) * format->size)
+		{
+			size_t ahead = (count - first) * format->size - format->prefetch;
+			struct_prefetch(p + format->prefetch, ahead < block * format->size ? ahead : block * format->size);
+		}
+
+		struct_copy_block(p, format, columns, first, block, unpack);
+	}
+}
+
+/**
+ * Check if compiled field takes values
+ */
+static inline int struct_value_field(const struct_field *field)
+{
+	return field->format != 'x' && field->repeat > 0;
+}
+
+/**
+ * Get distance between values of consecutive records in contiguous array of field values
+ */
+static inline size_t struct_column_stride(const struct_field *field)
+{
+	return field->format == 'T' ? field->repeat : field->size;
+}
+
+/**
+ * Collect pointers to arrays of field values from arguments of array packing
+ * @param columns Array for format->count columns
+ * @param format Compiled format
+ * @param vl Pointers to arrays of field values
+ */
+static void struct_collect_columns(struct_column *columns, const struct_format *format, va_list *vl)
+{
+	size_t i;
+
+	for (i = 0; i < format->count; i++)
+	{
+		const struct_field *f = &format->fields[i];
+
+		columns[i].base = struct_value_field(f) ? va_arg(*vl, void *) : NULL;
+		columns[i].stride = struct_column_stride(f);
+		columns[i].type = '\0';
+	}
+}
+
+/**
+ * Get time elapsed since given moment
+ * @param start Moment of time
+ * @return Elapsed time in nanoseconds
+ */
+static uint64_t struct_elapsed(const struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) * 1000000000ull + end.tv_nsec - start->tv_nsec;
+}
+
+/**
+ * Measure packing and unpacking of about STRUCT_TUNE_SIZE bytes of records with strategy of format
+ * @param format Compiled format
+ * @param elapsed Fastest times of packing and unpacking in nanoseconds
+ * @return Count of measured records or negative when failed
+ */
+static ssize_t struct_measure(const struct_format *format, uint64_t elapsed[2])
+{
+	uint8_t *records = NULL, *values = NULL;
+	struct_column *columns = NULL;
+	size_t count, size, offset, i, r;
+	ssize_t result = -1;
+
+	elapsed[0] = elapsed[1] = 0;
+
+	// nothing to measure for records without values
+	count = format->size > 0 ? STRUCT_TUNE_SIZE / format->size + 1 : 0;
+	if (count == 0)
+		return 0;
+
+	// arrays of all fields share single allocation
+	for (i = 0, size = 0; i < format->count; i++)
+		size += count * struct_column_stride(&format->fields[i]);
+
+	// pages are touched before measurement
+	records = calloc(count, format->size);
+	values = calloc(size + 1, 1);
+	columns = malloc(format->count * sizeof(columns[0]));
+	if (records == NULL || values == NULL || columns == NULL)
+		goto out;
+
+	for (i = 0, offset = 0; i < format->count; i++)
+	{
+		const struct_field *f = &format->fields[i];
+
+		columns[i].base = struct_value_field(f) ? values + offset : NULL;
+		columns[i].stride = struct_column_stride(f);
+		columns[i].type = '\0';
+		offset += count * columns[i].stride;
+	}
+
+	for (r = 0; r < STRUCT_TUNE_ROUNDS; r++)
+	{
+		struct timespec start;
+		uint64_t pack, unpack;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		struct_copy_records(records, format, columns, count, 0);
+		pack = struct_elapsed(&start);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		struct_copy_records(records, format, columns, count, 1);
+		unpack = struct_elapsed(&start);
+
+		if (r == 0 || pack < elapsed[0])
+			elapsed[0] = pack;
+		if (r == 0 || unpack < elapsed[1])
+			elapsed[1] = unpack;
+	}
+	result = count;
+
+out:
+	free(columns);
+	free(values);
+	free(records);
+	return result;
+}
+
+/**
+ * Copy values of all fields between packed records and columns given by caller
+ * @param records Packed records
+ * @param size Size of records buffer
+ * @param format Compiled format
+ * @param count Count of records
+ * @param columns Values of each field, columns of fields without values are ignored
+ * @param unpack Non-zero to copy from records to columns
+ * @return Size of records or negative when failed
+ */
+static ssize_t struct_copy_strided(uint8_t *records, size_t size, const struct_format *format, size_t count,
+		const struct_column *columns, int unpack)
+{
+	struct_column stack[STRUCT_ARRAY_COLUMNS];
+	struct_column *used = stack;
+	ssize_t result = -1;
+	size_t i;
+
+	if (records == NULL || format == NULL || (columns == NULL && format->count > 0))
+		return -1;
+	if (format->size > 0 && size / format->size < count)
+		return -1;
+
+	if (format->count > STRUCT_ARRAY_COLUMNS)
+	{
+		used = malloc(format->count * sizeof(used[0]));
+		if (used == NULL)
+			return -1;
+	}
+
+	memcpy(used, columns, format->count * sizeof(used[0]));
+	for (i = 0; i < format->count; i++)
+	{
+		if (!struct_value_field(&format->fields[i]))
+			used[i].base = NULL;
+		else if (!struct_column_type_valid(&format->fields[i], used[i].type, unpack))
+			goto out;
+	}
+
+	struct_copy_records(records, format, used, count, unpack);
+	result = count * format->size;
+
+out:
+	if (used != stack)
+		free(used);
+	return result;
+}
+
+/**
+ * Build masks of record checks
+ * @param mask Mask of bits which must be zero in valid record, format->size bytes
+ * @param strings Mask of string bytes which must be zero after zero byte, format->size bytes
+ * @param format Compiled format
+ * @param flags Checks of record values, STRUCT_VALIDATE_* flags
+ */
+static void struct_validate_mask(uint8_t *mask, uint8_t *strings, const struct_format *format, unsigned flags)
+{
+	size_t end = 0;
+	size_t i;
+
+	memset(mask, 0, format->size);
+	memset(strings, 0, format->size);
+	for (i = 0; i < format->count; i++)
+	{
+		const struct_field *f = &format->fields[i];
+		size_t start = f->offset + (f->format == 'x' ? f->size : 0);
+
+		if ((flags & STRUCT_VALIDATE_PADDING) && start > end)
+			memset(mask + end, 0xff, start - end);
+		end = f->offset + f->size;
+
+		if ((flags & STRUCT_VALIDATE_BOOLS) && f->format == '?')
+			memset(mask + f->offset, 0xfe, f->size);
+
+		// bits of bitset are packed least significant first
+		if ((flags & STRUCT_VALIDATE_PADDING) && f->format == 'T' && f->repeat % 8 != 0)
+			mask[end - 1] = 0xff << f->repeat % 8;
+
+		if ((flags & STRUCT_VALIDATE_STRINGS) && f->format == 's' && f->size > 1)
+			memset(strings + f->offset + 1, 0xff, f->size - 1);
+		if ((flags & STRUCT_VALIDATE_TERMINATED) && f->format == 's' && f->size > 0)
+			mask[end - 1] = 0xff;
+	}
+	if ((flags & STRUCT_VALIDATE_PADDING) && format->size > end)
+		memset(mask + end, 0xff, format->size - end);
+}
+
+/**
+ * Check if any byte of mask is set
+ */
+static int struct_validate_any(const uint8_t *mask, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		if (mask[i] != 0)
+			return 1;
+	return 0;
+}
+
+/**
+ * Check that masked bits of memory are zero
+ * @param p Memory
+ * @param mask Mask of bits which must be zero
+ * @param size Size of memory and mask
+ * @return Non-zero when valid
+ */
+static int struct_validate_bits(const uint8_t *p, const uint8_t *mask, size_t size)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	__m128i bits = _mm_setzero_si128();
+
+	for (; i + sizeof(__m128i) <= size; i += sizeof(__m128i))
+		bits = _mm_or_si128(bits, _mm_and_si128(_mm_loadu_si128((const __m128i *) (p + i)),
+				_mm_loadu_si128((const __m128i *) (mask + i))));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128())) != 0xffff)
+		return 0;
+#endif
+
+	for (; i < size; i++)
+		if (p[i] & mask[i])
+			return 0;
+	return 1;
+}
+
+/**
+ * Check that masked bytes of memory following zero byte are zero
+ * First byte of memory is never masked, as it is first byte of string value.
+ * @param p Memory
+ * @param mask Mask of string bytes except first byte of each value
+ * @param size Size of memory and mask
+ * @return Non-zero when valid
+ */
+static int struct_validate_strings(const uint8_t *p, const uint8_t *mask, size_t size)
+{
+	size_t i = 1;
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	__m128i bad = zero;
+
+	for (; i + sizeof(__m128i) <= size; i += sizeof(__m128i))
+	{
+		__m128i prev = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (p + i - 1)), zero);
+		__m128i cur = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (p + i)), zero);
+
+		bad = _mm_or_si128(bad, _mm_and_si128(_mm_andnot_si128(cur, prev),
+				_mm_loadu_si128((const __m128i *) (mask + i))));
+	}
+	if (_mm_movemask_epi8(bad) != 0)
+		return 0;
+#endif
+
+	for (; i < size; i++)
+		if (mask[i] && p[i - 1] == 0 && p[i] != 0)
+			return 0;
+	return 1;
+}
+
+//
+// Public Services
+//
+
+ssize_t struct_pack(void *buffer, size_t size, const char *format, ...)
+{
+	ssize_t result;
+	va_list vl;
+
+	va_start(vl, format);
+	result = struct_vpack(buffer, size, format, vl);
+	va_end(vl);
+
+	return result;
+}
+
+ssize_t struct_vpack(void *buffer, size_t size, const char *format, va_list args)
+{
+	const char *c, *next;
+	struct_context context;
+	const struct_format_field *field;
+	ssize_t field_size;
+	uint8_t *p;
+	va_list vl;
+
+	if (buffer == NULL || format == NULL)
+		return -1;
+
+	memset(&context, 0, sizeof(context));
+	c = struct_parse_prefix(format, &context);
+	p = buffer;
+	va_copy(vl, args);
+
+	while (*c != '\0')
+	{
+		for (next = c; isspace(*next); next++);
+		if (*next == STRUCT_GROUP_BEGIN || *next == STRUCT_GROUP_END)
+		{
+			field_size = struct_parse_group(next, &context);
+			if (field_size < 0 || (uint8_t *) buffer + size - p < field_size)
+				break;
+
+			// presence bitmap is stored with least significant bit first
+			if (*next == STRUCT_GROUP_BEGIN)
+			{
+				context.present = va_arg(vl, uint64_t);
+				if (context.slots < STRUCT_GROUP_SLOTS && (context.present >> context.slots) != 0)
+					break;
+				struct_store_uint(p, field_size, __LITTLE_ENDIAN, context.present);
+			}
+
+			p += field_size;
+			context.offset += field_size;
+			c = next + 1;
+			continue;
+		}
+
+		next = struct_parse_field(c, &context, &field);
+		if (field == NULL)
+			break;
+
+		if (context.optional)
+		{
+			field_size = struct_pack_optional(p, (uint8_t *) buffer + size - p, field, &context, &vl);
+			if (field_size < 0)
+				break;
+			p += field_size;
+			c = next;
+			continue;
+		}
+
+		field_size = field->calcsize(&context);
+		if ((uint8_t *) buffer + size - p < field_size)
+			break;
+
+		if (field->pack(p, &context, &vl) != field_size)
+			break;
+
+		p += field_size;
+		context.offset += field_size;
+		c = next;
+	}
+
+	va_end(vl);
+
+	// not parse whole format string or optional group is not finished
+	if (*c != '\0' || context.optional)
+		return -1;
+
+	return p - (uint8_t *) buffer;
+}
+
+ssize_t struct_unpack(const void *buffer, size_t size, const char *format, ...)
+{
+	ssize_t result;
+	va_list vl;
+
+	va_start(vl, format);
+	result = struct_vunpack(buffer, size, format, vl);
+	va_end(vl);
+
+	return result;
+}
+
+ssize_t struct_vunpack(const void *buffer, size_t size, const char *format, va_list args)
+{
+	const char *c, *next;
+	struct_context context;
+	const struct_format_field *field;
+	ssize_t field_size;
+	const uint8_t *p;
+	va_list vl;
+
+	if (buffer == NULL || format == NULL)
+		return -1;
+
+	memset(&context, 0, sizeof(context));
+	c = struct_parse_prefix(format, &context);
+	p = buffer;
+	va_copy(vl, args);
+
+	while (*c != '\0')
+	{
+		for (next = c; isspace(*next); next++);
+		if (*next == STRUCT_GROUP_BEGIN || *next == STRUCT_GROUP_END)
+		{
+			field_size = struct_parse_group(next, &context);
+			if (field_size < 0 || (const uint8_t *) buffer + size - p < field_size)
+				break;
+
+			if (*next == STRUCT_GROUP_BEGIN)
+			{
+				context.present = struct_load_uint(p, field_size, __LITTLE_ENDIAN);
+				if (context.slots < STRUCT_GROUP_SLOTS && (context.present >> context.slots) != 0)
+					break;
+				*va_arg(vl, uint64_t *) = context.present;
+			}
+
+			p += field_size;
+			context.offset += field_size;
+			c = next + 1;
+			continue;
+		}
+
+		next = struct_parse_field(c, &context, &field);
+		if (field == NULL)
+			break;
+
+		if (context.optional)
+		{
+			field_size = struct_unpack_optional(p, (const uint8_t *) buffer + size - p, field, &context, &vl);
+			if (field_size < 0)
+				break;
+			p += field_size;
+			c = next;
+			continue;
+		}
+
+		field_size = field->calcsize(&context);
+		if ((const uint8_t *) buffer + size - p < field_size)
+			break;
+
+		if (field->unpack(p, &context, &vl) != field_size)
+			break;
+
+		p += field_size;
+		context.offset += field_size;
+		c = next;
+	}
+
+	va_end(vl);
+
+	// not parse whole format string or optional group is not finished
+	if (*c != '\0' || context.optional)
+		return -1;
+
+	return p - (uint8_t *) buffer;
+}
+
+ssize_t struct_calcsize(const char *format)
+{
+	const char *c, *next;
+	struct_context context;
+	const struct_format_field *field;
+	ssize_t field_size;
+	ssize_t result;
+
+	if (format == NULL)
+		return -1;
+
+	memset(&context, 0, sizeof(context));
+	c = struct_parse_prefix(format, &context);
+	result = 0;
+
+	while (*c != '\0')
+	{
+		for (next = c; isspace(*next); next++);
+		if (*next == STRUCT_GROUP_BEGIN || *next == STRUCT_GROUP_END)
+		{
+			field_size = struct_parse_group(next, &context);
+			if (field_size < 0)
+				break;
+
+			result += field_size;
+			context.offset += field_size;
+			c = next + 1;
+			continue;
+		}
+
+		next = struct_parse_field(c, &context, &field);
+		if (field == NULL)
+			break;
+
+		field_size = field->calcsize(&context);
+		if (field_size <= 0)
+			break;
+
+		result += field_size;
+		context.offset += field_size;
+		c = next;
+	}
+
+	// not parse whole format string or optional group is not finished
+	if (*c != '\0' || context.optional)
+		return -1;
+
+	return result;
+}
+
+struct_format *struct_compile(const char *format)
+{
+	const char *c, *next;
+	struct_context context;
+	const struct_format_field *field;
+	struct_format *result;
+	ssize_t field_size;
+	size_t count, n;
+
+	if (format == NULL)
+		return NULL;
+
+	// count fields before allocation
+	memset(&context, 0, sizeof(context));
+	c = struct_parse_prefix(format, &context);
+	for (count = 0; *c != '\0'; count++)
+	{
+		c = struct_parse_field(c, &context, &field);
+		if (field == NULL)
+			return NULL;
+		while (isspace(*c)) c++;
+	}
+
+	result = malloc(sizeof(*result) + count * sizeof(result->fields[0]));
+	if (result == NULL)
+		return NULL;
+
+	memset(&context, 0, sizeof(context));
+	c = struct_parse_prefix(format, &context);
+	result->byte_order = context.byte_order;
+	result->count = count;
+	result->strategy = STRUCT_STRATEGY_COLUMNS;
+	result->block = 0;
+	result->prefetch = 0;
+
+	for (n = 0; n < count; n++)
+	{
+		struct_field *f = &result->fields[n];
+
+		next = struct_parse_field(c, &context, &field);
+
+		field_size = field->calcsize(&context);
+		if (field_size < 0)
+			break;
+
+		f->format = field->format;
+		f->repeat = context.repeat;
+		f->size = struct_field_size(field, &context);
+		f->offset = context.offset + field_size - f->size;
+
+		context.offset += field_size;
+		c = next;
+	}
+
+	if (n < count)
+	{
+		free(result);
+		return NULL;
+	}
+
+	result->size = context.offset;
+	return result;
+}
+
+void struct_free(struct_format *format)
+{
+	free(format);
+}
+
+struct_format *struct_pad(const struct_format *format, size_t alignment)
+{
+	struct_format *result;
+	size_t padding;
+
+	if (format == NULL || alignment == 0 || format->size > SIZE_MAX - alignment)
+		return NULL;
+
+	// empty records take whole aligned slot too
+	padding = (alignment - format->size % alignment) % alignment;
+	if (format->size == 0)
+		padding = alignment;
+
+	result = malloc(sizeof(*result) + (format->count + 1) * sizeof(result->fields[0]));
+	if (result == NULL)
+		return NULL;
+
+	memcpy(result, format, sizeof(*result) + format->count * sizeof(result->fields[0]));
+	if (padding > 0)
+	{
+		struct_field *f = &result->fields[result->count++];
+
+		f->format = 'x';
+		f->repeat = padding;
+		f->offset = format->size;
+		f->size = padding;
+	}
+	result->size = format->size + padding;
+	return result;
+}
+
+ssize_t struct_compact(void *dst, size_t size, const void *src, const struct_format *padded,
+		const struct_format *format, size_t count)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	size_t n;
+
+	if (dst == NULL || src == NULL || padded == NULL || format == NULL || padded->size < format->size)
+		return -1;
+	if (format->size > 0 && size / format->size < count)
+		return -1;
+
+	// records move only towards beginning of buffer, so compaction in place is safe
+	for (n = 0; n < count; n++, d += format->size, s += padded->size)
+		memmove(d, s, format->size);
+
+	return count * format->size;
+}
+
+ssize_t struct_pack_array(void *buffer, size_t size, const struct_format *format, size_t count, ...)
+{
+	struct_column stack[STRUCT_ARRAY_COLUMNS];
+	struct_column *columns = stack;
+	va_list vl;
+
+	if (buffer == NULL || format == NULL)
+		return -1;
+	if (format->size > 0 && size / format->size < count)
+		return -1;
+
+	if (format->count > STRUCT_ARRAY_COLUMNS)
+	{
+		columns = malloc(format->count * sizeof(columns[0]));
+		if (columns == NULL)
+			return -1;
+	}
+
+	va_start(vl, count);
+	struct_collect_columns(columns, format, &vl);
+	va_end(vl);
+
+	struct_copy_records(buffer, format, columns, count, 0);
+
+	if (columns != stack)
+		free(columns);
+	return count * format->size;
+}
+
+ssize_t struct_unpack_array(const void *buffer, size_t size, const struct_format *format, size_t count, ...)
+{
+	struct_column stack[STRUCT_ARRAY_COLUMNS];
+	struct_column *columns = stack;
+	va_list vl;
+
+	if (buffer == NULL || format == NULL)
+		return -1;
+	if (format->size > 0 && size / format->size < count)
+		return -1;
+
+	if (format->count > STRUCT_ARRAY_COLUMNS)
+	{
+		columns = malloc(format->count * sizeof(columns[0]));
+		if (columns == NULL)
+			return -1;
+	}
+
+	va_start(vl, count);
+	struct_collect_columns(columns, format, &vl);
+	va_end(vl);
+
+	// records are only read when unpacking
+	struct_copy_records((uint8_t *) buffer, format, columns, count, 1);
+
+	if (columns != stack)
+		free(columns);
+	return count * format->size;
+}
+
+ssize_t struct_pack_gather(void *buffer, size_t size, const struct_format *format, size_t count,
+		const struct_column *columns)
+{
+	return struct_copy_strided(buffer, size, format, count, columns, 0);
+}
+
+ssize_t struct_unpack_scatter(const void *buffer, size_t size, const struct_format *format, size_t count,
+		const struct_column *columns)
+{
+	// records are only read when unpacking
+	return struct_copy_strided((uint8_t *) buffer, size, format, count, columns, 1);
+}
+
+ssize_t struct_validate_array(const struct_format *format, const void *buffer, size_t size, size_t count,
+		unsigned flags)
+{
+	const uint8_t *records = buffer;
+	size_t span, block, n, i;
+	ssize_t result = -1;
+	uint8_t *mask, *strings;
+	int masked, zero_filled;
+
+	if (format == NULL || buffer == NULL)
+		return -1;
+	if (format->size == 0)
+		return count;
+
+	// truncated record is the first bad one when preceding records are valid
+	if (size / format->size < count)
+		count = size / format->size;
+
+	// masks cover block of records, so whole blocks are checked by vector compares
+	span = format->size * STRUCT_VALIDATE_RECORDS;
+	mask = malloc(2 * span);
+	if (mask == NULL)
+		return -1;
+	strings = mask + span;
+	struct_validate_mask(mask, strings, format, flags);
+	masked = struct_validate_any(mask, format->size);
+	zero_filled = struct_validate_any(strings, format->size);
+	for (i = 1; i < STRUCT_VALIDATE_RECORDS; i++)
+	{
+		memcpy(mask + i * format->size, mask, format->size);
+		memcpy(strings + i * format->size, strings, format->size);
+	}
+
+	for (n = 0; n < count && (masked || zero_filled); n += block)
+	{
+		const uint8_t *p = records + n * format->size;
+
+		block = count - n < STRUCT_VALIDATE_RECORDS ? count - n : STRUCT_VALIDATE_RECORDS;
+		if (block == STRUCT_VALIDATE_RECORDS && (!masked || struct_validate_bits(p, mask, span)) &&
+				(!zero_filled || struct_validate_strings(p, strings, span)))
+			continue;
+
+		// find bad record of block
+		for (i = 0; i < block; i++)
+		{
+			const uint8_t *record = p + i * format->size;
+
+			if (!struct_validate_bits(record, mask, format->size) ||
+					!struct_validate_strings(record, strings, format->size))
+			{
+				result = n + i;
+				goto out;
+			}
+		}
+	}
+	result = count;
+
+out:
+	free(mask);
+	return result;
+}
+
+int struct_tune(struct_format *format)
+{
+	const int strategies[] = { STRUCT_STRATEGY_COLUMNS, STRUCT_STRATEGY_BLOCKS };
+	uint64_t elapsed[2], best = UINT64_MAX;
+	int result = STRUCT_STRATEGY_COLUMNS;
+	size_t i;
+
+	if (format == NULL)
+		return -1;
+
+	for (i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++)
+	{
+		format->strategy = strategies[i];
+		if (struct_measure(format, elapsed) < 0)
+		{
+			format->strategy = STRUCT_STRATEGY_COLUMNS;
+			return -1;
+		}
+
+		if (elapsed[0] + elapsed[1] < best)
+		{
+			best = elapsed[0] + elapsed[1];
+			result = strategies[i];
+		}
+	}
+
+	format->strategy = result;
+	return result;
+}
+
+int struct_estimate(const struct_format *format, int calibrate, struct_cost *cost)
+{
+	int swap;
+	size_t end = 0;
+	size_t i;
+
+	if (format == NULL || cost == NULL)
+		return -1;
+
+	memset(cost, 0, sizeof(*cost));
+	swap = format->byte_order != BYTE_ORDER;
+
+	for (i = 0; i < format->count; i++)
+	{
+		const struct_field *f = &format->fields[i];
+		size_t start = f->offset + (f->format == 'x' ? f->size : 0);
+		size_t width = f->repeat > 0 ? f->size / f->repeat : 0;
+
+		// gaps between values are cleared by single store each
+		if (start > end)
+		{
+			cost->bytes += start - end;
+			cost->stores++;
+		}
+		end = f->offset + f->size;
+
+		if (f->format == 'x' || f->repeat == 0)
+			continue;
+
+		cost->bytes += f->size;
+		cost->branches++;
+
+		switch (f->format)
+		{
+		case 's':
+			cost->stores += (f->size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+			break;
+		case 'T':
+			// one byte boolean per bit is read
+			cost->bytes += f->repeat;
+			cost->stores += f->size;
+			cost->branches += f->repeat;
+			break;
+		case '?':
+			cost->stores += f->repeat;
+			cost->branches += f->repeat;
+			break;
+		default:
+			cost->stores += f->repeat;
+			if (f->repeat > 1)
+				cost->branches += f->repeat;
+			if (swap && width > 1)
+				cost->swaps += f->repeat;
+			break;
+		}
+	}
+
+	if (calibrate)
+	{
+		uint64_t elapsed[2];
+		ssize_t count = struct_measure(format, elapsed);
+
+		if (count < 0)
+			return -1;
+		if (count > 0)
+		{
+			cost->pack_ns = (double) elapsed[0] / count;
+			cost->unpack_ns = (double) elapsed[1] / count;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Calculate length of mapping of buffer allocated by struct_alloc()
+ * Huge page mappings are rounded up to whole huge pages, empty buffers take single page.
+ */
+static size_t struct_alloc_length(size_t size, unsigned flags)
+{
+	if (size == 0)
+		size = 1;
+	if (flags & STRUCT_ALLOC_HUGE)
+		size = (size + STRUCT_HUGE_PAGE_SIZE - 1) & ~(size_t) (STRUCT_HUGE_PAGE_SIZE - 1);
+	return size;
+}
+
+void *struct_alloc(size_t size, unsigned flags)
+{
+	uint8_t *p = MAP_FAILED;
+	size_t length;
+
+	if (size > SIZE_MAX - 2 * STRUCT_HUGE_PAGE_SIZE)
+		return NULL;
+
+	// length is not kept in front of buffer, so buffer starts at mapping aligned to huge page
+	length = struct_alloc_length(size, flags);
+
+	if (flags & STRUCT_ALLOC_HUGE)
+	{
+#ifdef MAP_HUGETLB
+		p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+		// without reserved huge pages mapping aligned to huge page is advised to transparent huge pages
+		if (p == MAP_FAILED)
+		{
+			uint8_t *map = mmap(NULL, length + STRUCT_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			size_t head;
+
+			if (map == MAP_FAILED)
+				return NULL;
+
+			head = -(uintptr_t) map & (STRUCT_HUGE_PAGE_SIZE - 1);
+			if (head > 0)
+				munmap(map, head);
+			munmap(map + head + length, STRUCT_HUGE_PAGE_SIZE - head);
+			p = map + head;
+#ifdef MADV_HUGEPAGE
+			madvise(p, length, MADV_HUGEPAGE);
+#endif
+		}
+	}
+	else
+		p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	return p != MAP_FAILED ? p : NULL;
+}
+
+void struct_alloc_free(void *buffer, size_t size, unsigned flags)
+{
+	if (buffer == NULL)
+		return;
+
+	munmap(buffer, struct_alloc_length(size, flags));
+}
+
+struct_template *struct_bind(const struct_format *format, const size_t *fields, size_t count,
+		const void *values)
+{
+	struct_template *result;
+	const struct_format_field *field;
+	size_t i, n;
+
+	if (format == NULL || (fields == NULL && count > 0) || (values == NULL && count > 0))
+		return NULL;
+	for (n = 0; n < count; n++)
+		if (fields[n] >= format->count)
+			return NULL;
+
+	result = calloc(1, sizeof(*result) + format->count * sizeof(result->fields[0]) + format->size);
+	if (result == NULL)
+		return NULL;
+
+	result->byte_order = format->byte_order;
+	result->size = format->size;
+	result->record = (uint8_t *) &result->fields[format->count];
+
+	for (i = 0; i < format->count; i++)
+	{
+		const struct_field *f = &format->fields[i];
+
+		for (n = 0; n < count && fields[n] != i; n++);
+		if (n < count)
+		{
+			memcpy(result->record + f->offset, (const uint8_t *) values + f->offset, f->size);
+			continue;
+		}
+
+		// padding is already zeroed in template
+		if (f->format == 'x' || f->repeat == 0)
+			continue;
+
+		for (field = struct_format_fields; field->format != f->format; field++);
+		result->fields[result->count].field = field;
+		result->fields[result->count].repeat = f->repeat;
+		result->fields[result->count].offset = f->offset;
+		result->count++;
+	}
+
+	return result;
+}
+
+void struct_template_free(struct_template *template)
+{
+	free(template);
+}
+
+ssize_t struct_pack_template(void *buffer, size_t size, const struct_template *template, ...)
+{
+	struct_context context;
+	uint8_t *p = buffer;
+	size_t i;
+	va_list vl;
+
+	if (buffer == NULL || template == NULL || size < template->size)
+		return -1;
+
+	memcpy(p, template->record, template->size);
+
+	// offsets are precalculated, so values are stored without alignment padding
+	memset(&context, 0, sizeof(context));
+	context.byte_order = template->byte_order;
+
+	va_start(vl, template);
+	for (i = 0; i < template->count; i++)
+	{
+		const struct_template_field *f = &template->fields[i];
+
+		context.repeat = f->repeat;
+		context.offset = f->offset;
+		f->field->pack(p + f->offset, &context, &vl);
+	}
+	va_end(vl);
+
+	return template->size;
+}
+
+/**
+ * Store integer of field width in given byte order
+ * @param p Destination of value
+ * @param width Size of value
+ * @param byte_order Byte order of packed value
+ * @param v Value truncated to width
+ */
+static inline void struct_store_width(uint8_t *p, size_t width, int byte_order, uint64_t v)
+{
+	int swap = byte_order != BYTE_ORDER;
+
+	switch (width)
+	{
+	case sizeof(uint8_t):
+		*p = v;
+		break;
+	case sizeof(uint16_t):
+		stor_16(p, swap ? swab_16(v) : v);
+		break;
+	case sizeof(uint32_t):
+		stor_32(p, swap ? swab_32(v) : v);
+		break;
+	case sizeof(uint64_t):
+		stor_64(p, swap ? swab_64(v) : v);
+		break;
+	default:
+		struct_store_uint(p, width, byte_order, v);
+		break;
+	}
+}
+
+/**
+ * Load integer of field width in given byte order
+ * @see struct_store_width()
+ */
+static inline uint64_t struct_load_width(const uint8_t *p, size_t width, int byte_order)
+{
+	int swap = byte_order != BYTE_ORDER;
+
+	switch (width)
+	{
+	case sizeof(uint8_t):
+		return *p;
+	case sizeof(uint16_t):
+		return swap ? swab_16(load_16(p)) : load_16(p);
+	case sizeof(uint32_t):
+		return swap ? swab_32(load_32(p)) : load_32(p);
+	case sizeof(uint64_t):
+		return swap ? swab_64(load_64(p)) : load_64(p);
+	default:
+		return struct_load_uint(p, width, byte_order);
+	}
+}
+
+/**
+ * Store typed value to packed field
+ * @param p Destination of value
+ * @param format Field format character
+ * @param width Size of single field value
+ * @param byte_order Byte order of packed value
+ * @param value Value
+ * @return Zero on success or negative when value does not match field
+ */
+static int struct_store_value(uint8_t *p, char format, size_t width, int byte_order, const struct_value *value)
+{
+	float32 f32;
+	double64 d64;
+
+	switch (value->type)
+	{
+	case STRUCT_VALUE_INT:
+		d64.d = value->value.i;
+		break;
+	case STRUCT_VALUE_UINT:
+		d64.d = value->value.u;
+		break;
+	case STRUCT_VALUE_FLOAT:
+		d64.d = value->value.f;
+		break;
+	case STRUCT_VALUE_DOUBLE:
+		d64.d = value->value.d;
+		break;
+	default:
+		return -1;
+	}
+
+	switch (format)
+	{
+	case 'f':
+		f32.f = d64.d;
+		struct_store_width(p, width, byte_order, f32.i);
+		return 0;
+	case 'd':
+		struct_store_width(p, width, byte_order, d64.i);
+		return 0;
+	case '?':
+		if (value->type == STRUCT_VALUE_FLOAT || value->type == STRUCT_VALUE_DOUBLE)
+			return -1;
+		*p = value->value.u != 0;
+		return 0;
+	default:
+		// integers are truncated like by struct_pack()
+		if (value->type == STRUCT_VALUE_FLOAT || value->type == STRUCT_VALUE_DOUBLE)
+			return -1;
+		struct_store_width(p, width, byte_order, value->value.u);
+		return 0;
+	}
+}
+
+/**
+ * Load packed field value to typed destination
+ * @see struct_store_value()
+ */
+static int struct_load_value(const uint8_t *p, char format, size_t width, int byte_order, const struct_value *value)
+{
+	uint64_t v = struct_load_width(p, width, byte_order);
+	float32 f32;
+	double64 d64;
+
+	if (format == 'f' || format == 'd')
+	{
+		if (format == 'f')
+		{
+			f32.i = v;
+			d64.d = f32.f;
+		}
+		else
+		{
+			d64.i = v;
+		}
+
+		if (value->type == STRUCT_VALUE_FLOAT_PTR)
+			*(float *) value->value.p = d64.d;
+		else if (value->type == STRUCT_VALUE_DOUBLE_PTR)
+			*(double *) value->value.p = d64.d;
+		else
+			return -1;
+		return 0;
+	}
+
+	if (format == '?')
+		v = v != 0;
+
+	// characters are also unpacked to string destinations
+	if (value->type == STRUCT_VALUE_STR_PTR && format == 'c')
+	{
+		*(char *) value->value.p = v;
+		return 0;
+	}
+
+	if ((value->type != STRUCT_VALUE_INT_PTR && value->type != STRUCT_VALUE_UINT_PTR) || value->size != width)
+		return -1;
+	struct_store_width(value->value.p, width, BYTE_ORDER, v);
+	return 0;
+}
+
+ssize_t struct_pack_values(void *buffer, size_t size, const char *format,
+		const struct_value *values, size_t count)
+{
+	const char *c, *next;
 	struct_context context;
 	const struct_format_field *field;
-	ssize_t field_size;
-	ssize_t result;
+	ssize_t field_size, values_size;
+	uint8_t *p = buffer;
+	size_t i, n = 0;
 
-	if (format == NULL)
+	if (buffer == NULL || format == NULL || (values == NULL && count > 0))
 		return -1;
 
 	memset(&context, 0, sizeof(context));
 	c = struct_parse_prefix(format, &context);
-	result = 0;
 
 	while (*c != '\0')
 	{
 		next = struct_parse_field(c, &context, &field);
-		if (field == NULL)
+		if (field == NULL || context.array)
 			break;
 
 		field_size = field->calcsize(&context);
-		if (field_size <= 0)
+		values_size = struct_field_size(field, &context);
+		if (field_size <= 0 || (uint8_t *) buffer + size - p < field_size)
 			break;
 
-		result += field_size;
+		// alignment padding and padding fields are zeroed
+		memset(p, 0, field_size);
+		p += field_size - values_size;
+
+		if (field->format == 's')
+		{
+			if (n >= count || values[n].type != STRUCT_VALUE_STR)
+				break;
+			if (values[n].value.s != NULL)
+				strncpy((char *) p, values[n].value.s, context.repeat);
+			n++;
+		}
+		else if (field->format == 'T')
+		{
+			if (count - n < context.repeat)
+				break;
+			for (i = 0; i < context.repeat; i++, n++)
+				if (values[n].type == STRUCT_VALUE_INT || values[n].type == STRUCT_VALUE_UINT)
+					p[i / 8] |= (values[n].value.u != 0) << (i % 8);
+				else
+					break;
+			if (i < context.repeat)
+				break;
+		}
+		else if (field->format != 'x' && context.repeat > 0)
+		{
+			size_t width = values_size / context.repeat;
+
+			if (count - n < context.repeat)
+				break;
+			for (i = 0; i < context.repeat; i++, n++)
+				if (struct_store_value(p + i * width, field->format, width, context.byte_order, &values[n]) < 0)
+					break;
+			if (i < context.repeat)
+				break;
+		}
+
+		p += values_size;
 		context.offset += field_size;
 		c = next;
 	}
 
-	// not parse whole format string
-	if (*c != '\0')
+	if (*c != '\0' || n != count)
 		return -1;
 
-	return result;
+	return p - (uint8_t *) buffer;
+}
+
+ssize_t struct_unpack_values(const void *buffer, size_t size, const char *format,
+		const struct_value *values, size_t count)
+{
+	const char *c, *next;
+	struct_context context;
+	const struct_format_field *field;
+	ssize_t field_size, values_size;
+	const uint8_t *p = buffer;
+	size_t i, n = 0;
+
+	if (buffer == NULL || format == NULL || (values == NULL && count > 0))
+		return -1;
+
+	memset(&context, 0, sizeof(context));
+	c = struct_parse_prefix(format, &context);
+
+	while (*c != '\0')
+	{
+		next = struct_parse_field(c, &context, &field);
+		if (field == NULL || context.array)
+			break;
+
+		field_size = field->calcsize(&context);
+		values_size = struct_field_size(field, &context);
+		if (field_size <= 0 || (const uint8_t *) buffer + size - p < field_size)
+			break;
+		p += field_size - values_size;
+
+		if (field->format == 's')
+		{
+			if (n >= count || values[n].type != STRUCT_VALUE_STR_PTR)
+				break;
+			memcpy(values[n].value.p, p, context.repeat);
+			((char *) values[n].value.p)[context.repeat] = '\0';
+			n++;
+		}
+		else if (field->format == 'T')
+		{
+			if (count - n < context.repeat)
+				break;
+			for (i = 0; i < context.repeat; i++, n++)
+				if ((values[n].type == STRUCT_VALUE_INT_PTR || values[n].type == STRUCT_VALUE_UINT_PTR) &&
+						values[n].size == sizeof(uint8_t))
+					*(uint8_t *) values[n].value.p = (p[i / 8] >> (i % 8)) & 1;
+				else
+					break;
+			if (i < context.repeat)
+				break;
+		}
+		else if (field->format != 'x' && context.repeat > 0)
+		{
+			size_t width = values_size / context.repeat;
+
+			if (count - n < context.repeat)
+				break;
+			for (i = 0; i < context.repeat; i++, n++)
+				if (struct_load_value(p + i * width, field->format, width, context.byte_order, &values[n]) < 0)
+					break;
+			if (i < context.repeat)
+				break;
+		}
+
+		p += values_size;
+		context.offset += field_size;
+		c = next;
+	}
+
+	if (*c != '\0' || n != count)
+		return -1;
+
+	return p - (const uint8_t *) buffer;
+}
+
+ssize_t struct_pack_compiled_values(void *buffer, size_t size, const struct_format *format,
+		const struct_value *values, size_t count)
+{
+	uint8_t *record = buffer;
+	size_t i, k, n = 0;
+
+	if (buffer == NULL || format == NULL || (values == NULL && count > 0) || size < format->size)
+		return -1;
+
+	// padding fields and alignment padding are zeroed
+	memset(record, 0, format->size);
+
+	for (i = 0; i < format->count; i++)
+	{
+		const struct_field *f = &format->fields[i];
+		uint8_t *p = record + f->offset;
+
+		if (f->format == 'x' || f->repeat == 0)
+			continue;
+
+		if (f->format == 's')
+		{
+			if (n >= count || values[n].type != STRUCT_VALUE_STR)
+				return -1;
+			if (values[n].value.s != NULL)
+				strncpy((char *) p, values[n].value.s, f->repeat);
+			n++;
+			continue;
+		}
+
+		if (count - n < f->repeat)
+			return -1;
+
+		if (f->format == 'T')
+		{
+			for (k = 0; k < f->repeat; k++, n++)
+			{
+				if (values[n].type != STRUCT_VALUE_INT && values[n].type != STRUCT_VALUE_UINT)
+					return -1;
+				p[k / 8] |= (values[n].value.u != 0) << (k % 8);
+			}
+			continue;
+		}
+
+		for (k = 0; k < f->repeat; k++, n++)
+			if (struct_store_value(p + k * (f->size / f->repeat), f->format, f->size / f->repeat,
+					format->byte_order, &values[n]) < 0)
+				return -1;
+	}
+
+	return n == count ? (ssize_t) format->size : -1;
+}
+
+ssize_t struct_unpack_compiled_values(const void *buffer, size_t size, const struct_format *format,
+		const struct_value *values, size_t count)
+{
+	const uint8_t *record = buffer;
+	size_t i, k, n = 0;
+
+	if (buffer == NULL || format == NULL || (values == NULL && count > 0) || size < format->size)
+		return -1;
+
+	for (i = 0; i < format->count; i++)
+	{
+		const struct_field *f = &format->fields[i];
+		const uint8_t *p = record + f->offset;
+
+		if (f->format == 'x' || f->repeat == 0)
+			continue;
+
+		if (f->format == 's')
+		{
+			if (n >= count || values[n].type != STRUCT_VALUE_STR_PTR)
+				return -1;
+			memcpy(values[n].value.p, p, f->repeat);
+			((char *) values[n].value.p)[f->repeat] = '\0';
+			n++;
+			continue;
+		}
+
+		if (count - n < f->repeat)
+			return -1;
+
+		if (f->format == 'T')
+		{
+			for (k = 0; k < f->repeat; k++, n++)
+			{
+				if ((values[n].type != STRUCT_VALUE_INT_PTR && values[n].type != STRUCT_VALUE_UINT_PTR) ||
+						values[n].size != sizeof(uint8_t))
+					return -1;
+				*(uint8_t *) values[n].value.p = (p[k / 8] >> (k % 8)) & 1;
+			}
+			continue;
+		}
+
+		for (k = 0; k < f->repeat; k++, n++)
+			if (struct_load_value(p + k * (f->size / f->repeat), f->format, f->size / f->repeat,
+					format->byte_order, &values[n]) < 0)
+				return -1;
+	}
+
+	return n == count ? (ssize_t) format->size : -1;
 }
@@ -28,8 +28,104 @@
 #ifndef STRUCT_H_
 #define STRUCT_H_
 
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+//
+// Public Definitions
+//
+
+/** Strategies of array packing, see struct_tune() */
+#define STRUCT_STRATEGY_COLUMNS	0		/**< Copy each field column over all records */
+#define STRUCT_STRATEGY_BLOCKS	1		/**< Copy all fields of blocks of records fitting into cache */
+#define STRUCT_STRATEGY_STREAM	2		/**< Copy blocks, large packed output bypasses cache */
+
+/** Back buffer allocated by struct_alloc() with huge pages */
+#define STRUCT_ALLOC_HUGE		0x01
+
+/** Checks of struct_validate_array() */
+#define STRUCT_VALIDATE_BOOLS		0x01	/**< '?' values are 0 or 1 */
+#define STRUCT_VALIDATE_PADDING		0x02	/**< Pad bytes, alignment gaps and unused bits of bitsets are zero */
+#define STRUCT_VALIDATE_STRINGS		0x04	/**< Bytes of 's' values after first zero byte are zero */
+#define STRUCT_VALIDATE_TERMINATED	0x08	/**< Last byte of 's' values is zero, so values are C strings */
+#define STRUCT_VALIDATE_ALL			(STRUCT_VALIDATE_BOOLS | STRUCT_VALIDATE_PADDING | STRUCT_VALIDATE_STRINGS)
+
+//
+// Public Types
+//
+
+/** Field of compiled format pattern */
+typedef struct _struct_field
+{
+	char format;		/**< Format character */
+	size_t repeat;		/**< Repeat count */
+	size_t offset;		/**< Offset of first value in record, after alignment padding */
+	size_t size;		/**< Size of all values, without alignment padding */
+} struct_field;
+
+/** Compiled format pattern */
+typedef struct _struct_format
+{
+	int byte_order;		/**< Byte order of packed values */
+	size_t size;		/**< Size of packed record */
+	size_t count;		/**< Count of fields */
+	int strategy;		/**< Strategy of array packing, one of STRUCT_STRATEGY_* */
+	size_t block;		/**< Size of records block of blocked strategies in bytes, zero for default */
+	size_t prefetch;	/**< Distance in bytes of prefetching records ahead of unpacked block, zero for none */
+	struct_field fields[];	/**< Fields in pattern order */
+} struct_format;
+
+/** Values of field in arbitrary memory, like member of array of structures */
+typedef struct _struct_column
+{
+	void *base;			/**< Value of first record */
+	size_t stride;		/**< Distance in bytes between values of consecutive records */
+	char type;			/**< Format character of values in memory, zero for type of field */
+} struct_column;
+
+/** Estimated cost of packing single record by struct_pack_array() */
+typedef struct _struct_cost
+{
+	size_t bytes;		/**< Bytes moved, including cleared padding */
+	size_t stores;		/**< Stores to packed record */
+	size_t swaps;		/**< Values with swapped byte order */
+	size_t branches;	/**< Loop and value dependent branches */
+	double pack_ns;		/**< Calibrated time of packing in nanoseconds, zero when not calibrated */
+	double unpack_ns;	/**< Calibrated time of unpacking in nanoseconds, zero when not calibrated */
+} struct_cost;
+
+/** Compiled format with some fields bound to constant values */
+typedef struct _struct_template struct_template;
+
+/** Types of struct_value */
+#define STRUCT_VALUE_INT		'i'		/**< Signed integer value */
+#define STRUCT_VALUE_UINT		'u'		/**< Unsigned integer value */
+#define STRUCT_VALUE_FLOAT		'f'		/**< Float value */
+#define STRUCT_VALUE_DOUBLE		'd'		/**< Double value */
+#define STRUCT_VALUE_STR		's'		/**< String value */
+#define STRUCT_VALUE_INT_PTR	'I'		/**< Pointer to signed integer of given size */
+#define STRUCT_VALUE_UINT_PTR	'U'		/**< Pointer to unsigned integer of given size */
+#define STRUCT_VALUE_FLOAT_PTR	'F'		/**< Pointer to float */
+#define STRUCT_VALUE_DOUBLE_PTR	'D'		/**< Pointer to double */
+#define STRUCT_VALUE_STR_PTR	'S'		/**< Pointer to characters */
+
+/** Typed value to pack or destination to unpack, see struct_typed.h */
+typedef struct _struct_value
+{
+	char type;			/**< One of STRUCT_VALUE_* */
+	size_t size;		/**< Size of integer pointed by destination */
+	union
+	{
+		int64_t i;
+		uint64_t u;
+		float f;
+		double d;
+		const char *s;
+		void *p;
+	} value;
+} struct_value;
+
 //
 // Public Services
 //
@@ -39,7 +135,8 @@
  * @param buffer Destination buffer
  * @param size Size of destination buffer
  * @param format Format pattern string
- * @param ... Fields to pack
+ * @param ... Fields to pack, repeated field with '&' modifier like "&16H" takes single pointer to array,
+ * optional group like "{hhs}" takes uint64_t presence bitmap followed by present values only
  * @return Size of packed data or negative when failed
  */
 ssize_t struct_pack(void *buffer, size_t size, const char *format, ...);
@@ -49,16 +146,276 @@ ssize_t struct_pack(void *buffer, size_t size, const char *format, ...);
  * @param buffer Source buffer
  * @param size Size of destination buffer
  * @param format Format pattern string
- * @param ... Fields to unpack
+ * @param ... Fields to unpack, repeated field with '&' modifier like "&16H" takes single pointer to array,
+ * optional group like "{hhs}" takes pointer to uint64_t presence bitmap followed by pointers for all
+ * values, absent values are filled by zeros
  * @return Size of unpacked data or negative when failed
  */
 ssize_t struct_unpack(const void *buffer, size_t size, const char *format, ...);
 
+/**
+ * Pack binary data to buffer with fields passed as variable argument list
+ * @see struct_pack()
+ */
+ssize_t struct_vpack(void *buffer, size_t size, const char *format, va_list args);
+
+/**
+ * Unpack binary data from buffer with fields passed as variable argument list
+ * @see struct_unpack()
+ */
+ssize_t struct_vunpack(const void *buffer, size_t size, const char *format, va_list args);
+
 /**
  * Calculate size of buffer for givven format pattern
+ * Size of format with optional groups is calculated for all values present.
  * @param format Format pattern string
  * @return Calculated data size or negative when failed
  */
 ssize_t struct_calcsize(const char *format);
 
+/**
+ * Compile format pattern to list of fields with precalculated offsets
+ * Formats with optional groups have no fixed offsets and are not compiled.
+ * @param format Format pattern string
+ * @return Compiled format or NULL when failed, must be released by struct_free()
+ */
+struct_format *struct_compile(const char *format);
+
+/**
+ * Release compiled format
+ * @param format Compiled format, may be NULL
+ */
+void struct_free(struct_format *format);
+
+/**
+ * Make copy of compiled format with record size padded to multiple of alignment
+ * Padding is trailing 'x' field, so arrays of padded records take the same
+ * arguments. When threads pack records to adjacent positions of shared array
+ * aligned to cache line, records padded to cache line do not share lines.
+ * @param format Compiled format
+ * @param alignment Alignment of record size, like 64 for cache line
+ * @return Padded format or NULL when failed, must be released by struct_free()
+ */
+struct_format *struct_pad(const struct_format *format, size_t alignment);
+
+/**
+ * Remove padding from array of padded records
+ * @param dst Destination buffer, may be the same as source
+ * @param size Size of destination buffer
+ * @param src Records packed by padded format
+ * @param padded Format made by struct_pad()
+ * @param format Original format
+ * @param count Count of records
+ * @return Size of compacted records or negative when failed
+ */
+ssize_t struct_compact(void *dst, size_t size, const void *src, const struct_format *padded,
+		const struct_format *format, size_t count);
+
+/**
+ * Pack array of records
+ * Each field takes single pointer to array of count * repeat values in host
+ * byte order, values of record N start at index N * repeat. Fields 's' take
+ * pointer to count * repeat characters, fields 'T' take pointer to count * repeat
+ * one byte booleans, fields 'x' and fields with zero repeat count take no arguments.
+ * @param buffer Destination buffer
+ * @param size Size of destination buffer
+ * @param format Compiled format of records
+ * @param count Count of records
+ * @param ... Pointers to arrays of field values
+ * @return Size of packed data or negative when failed
+ */
+ssize_t struct_pack_array(void *buffer, size_t size, const struct_format *format, size_t count, ...);
+
+/**
+ * Unpack array of records
+ * With blocked strategies records at prefetch distance of format ahead of
+ * each block are requested to cache before copying block, so reading of
+ * records from memory overlaps with copying.
+ * @see struct_pack_array()
+ * @param buffer Source buffer
+ * @param size Size of source buffer
+ * @param format Compiled format of records
+ * @param count Count of records
+ * @param ... Pointers to arrays for field values
+ * @return Size of unpacked data or negative when failed
+ */
+ssize_t struct_unpack_array(const void *buffer, size_t size, const struct_format *format, size_t count, ...);
+
+/**
+ * Pack array of records gathering field values from arbitrary memory
+ * Values of each record are taken like struct_pack_array() takes values of
+ * single record, so repeated field takes repeat values at base of its record.
+ * Column of numeric field may keep values of other numeric type given by
+ * format character, values are converted while copied. Integers are truncated
+ * like by struct_pack() and converted to floating point, floating point values
+ * are not converted to integers.
+ * @param buffer Destination buffer
+ * @param size Size of destination buffer
+ * @param format Compiled format of records
+ * @param count Count of records
+ * @param columns Values of each compiled field, columns of 'x' fields and fields
+ * with zero repeat count are ignored
+ * @return Size of packed data or negative when failed
+ */
+ssize_t struct_pack_gather(void *buffer, size_t size, const struct_format *format, size_t count,
+		const struct_column *columns);
+
+/**
+ * Unpack array of records scattering field values to arbitrary memory
+ * @see struct_pack_gather()
+ * @param buffer Source buffer
+ * @param size Size of source buffer
+ * @param format Compiled format of records
+ * @param count Count of records
+ * @param columns Destinations of each compiled field
+ * @return Size of unpacked data or negative when failed
+ */
+ssize_t struct_unpack_scatter(const void *buffer, size_t size, const struct_format *format, size_t count,
+		const struct_column *columns);
+
+/**
+ * Validate array of packed records before unpacking
+ * Records of untrusted input are checked to be packed like by struct_pack(),
+ * so unpacking of records before the first bad one needs no further checks.
+ * @param format Compiled format of records
+ * @param buffer Packed records
+ * @param size Size of buffer
+ * @param count Count of records
+ * @param flags Checks of record values, STRUCT_VALIDATE_* flags
+ * @return Index of first bad or truncated record, count when all records are
+ * valid or negative when failed
+ */
+ssize_t struct_validate_array(const struct_format *format, const void *buffer, size_t size, size_t count,
+		unsigned flags);
+
+/**
+ * Select fastest strategy of array packing on current machine
+ * Each strategy packs and unpacks about megabyte of records several times,
+ * the fastest one is stored in format and used by following array calls.
+ * Without tuning compiled formats use STRUCT_STRATEGY_COLUMNS. Streaming is
+ * never selected, it saves cache for other work rather than time of packing.
+ * @param format Compiled format
+ * @return Selected strategy or negative when failed
+ */
+int struct_tune(struct_format *format);
+
+/**
+ * Estimate cost of packing single record
+ * Static model counts work done per record by array packing, calibration
+ * additionally measures array packing and unpacking like struct_tune() does.
+ * @param format Compiled format
+ * @param calibrate Non-zero to measure time per record on current machine
+ * @param cost Estimated cost
+ * @return Zero on success or negative when failed
+ */
+int struct_estimate(const struct_format *format, int calibrate, struct_cost *cost);
+
+/**
+ * Allocate zeroed buffer for large arrays of records
+ * Buffer is mapped directly from system and aligned to page. With
+ * STRUCT_ALLOC_HUGE it is aligned to huge page and backed by reserved huge
+ * pages when available, otherwise by pages advised to be merged to
+ * transparent huge pages, which reduces TLB misses of buffers of gigabytes.
+ * @param size Size of buffer
+ * @param flags Combination of STRUCT_ALLOC_* flags
+ * @return Buffer or NULL when failed, must be released by struct_alloc_free()
+ */
+void *struct_alloc(size_t size, unsigned flags);
+
+/**
+ * Release buffer allocated by struct_alloc()
+ * @param buffer Buffer, may be NULL
+ * @param size Size of buffer passed to struct_alloc()
+ * @param flags Flags passed to struct_alloc()
+ */
+void struct_alloc_free(void *buffer, size_t size, unsigned flags);
+
+/**
+ * Specialize compiled format binding some fields to constant values
+ * Bound fields are prepacked to template record, so packing by template
+ * copies it and stores only remaining fields.
+ * @param format Compiled format
+ * @param fields Numbers of bound fields in compiled format
+ * @param count Count of bound fields
+ * @param values Packed record with values of bound fields, other fields are ignored
+ * @return Template or NULL when failed, must be released by struct_template_free()
+ */
+struct_template *struct_bind(const struct_format *format, const size_t *fields, size_t count,
+		const void *values);
+
+/**
+ * Release template
+ * @param template Template, may be NULL
+ */
+void struct_template_free(struct_template *template);
+
+/**
+ * Pack record by template
+ * @param buffer Destination buffer
+ * @param size Size of destination buffer
+ * @param template Template
+ * @param ... Values of fields which are not bound in pattern order, like for struct_pack()
+ * @return Size of packed record or negative when failed
+ */
+ssize_t struct_pack_template(void *buffer, size_t size, const struct_template *template, ...);
+
+/**
+ * Pack array of typed values without variable arguments
+ * Each value of repeated field is separate value, 's' field takes single
+ * string and 'x' field takes no value. Numbers are converted to type of
+ * field, strings are accepted only by 's' fields. Array modifiers and
+ * optional groups are not supported.
+ * @param buffer Destination buffer
+ * @param size Size of destination buffer
+ * @param format Format pattern string
+ * @param values Values to pack
+ * @param count Count of values, must match format
+ * @return Size of packed data or negative when failed
+ */
+ssize_t struct_pack_values(void *buffer, size_t size, const char *format,
+		const struct_value *values, size_t count);
+
+/**
+ * Unpack to array of typed destinations without variable arguments
+ * Integer destinations must have the same size as field values, floating
+ * point destinations accept both 'f' and 'd' fields. Destinations of 's'
+ * fields must have space for field characters and terminating zero.
+ * @see struct_pack_values()
+ * @param buffer Source buffer
+ * @param size Size of source buffer
+ * @param format Format pattern string
+ * @param values Destinations for unpacked values
+ * @param count Count of destinations, must match format
+ * @return Size of unpacked data or negative when failed
+ */
+ssize_t struct_unpack_values(const void *buffer, size_t size, const char *format,
+		const struct_value *values, size_t count);
+
+/**
+ * Pack record of compiled format from array of typed values
+ * Values are taken like by struct_pack_values(), format is not parsed for
+ * each record.
+ * @param buffer Destination buffer
+ * @param size Size of destination buffer
+ * @param format Compiled format
+ * @param values Values to pack
+ * @param count Count of values, must match format
+ * @return Size of packed record or negative when failed
+ */
+ssize_t struct_pack_compiled_values(void *buffer, size_t size, const struct_format *format,
+		const struct_value *values, size_t count);
+
+/**
+ * Unpack record of compiled format to array of typed destinations
+ * @see struct_unpack_values()
+ * @param buffer Source buffer
+ * @param size Size of source buffer
+ * @param format Compiled format
+ * @param values Destinations for unpacked values
+ * @param count Count of destinations, must match format
+ * @return Size of unpacked record or negative when failed
+ */
+ssize_t struct_unpack_compiled_values(const void *buffer, size_t size, const struct_format *format,
+		const struct_value *values, size_t count);
+
 #endif /* STRUCT_H_ */
@@ -0,0 +1,349 @@
+/**
+ * struct_arrow.c
+ * Export of packed records as Arrow C data interface arrays.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "struct_arrow.h"
+#include "struct_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Private Definitions
+//
+
+/** Maximal count of buffers of exported array */
+#define STRUCT_ARROW_BUFFERS	3
+
+/** Size of format and name strings of exported schema */
+#define STRUCT_ARROW_NAME_SIZE	32
+
+//
+// Private Types
+//
+
+/** Private data of exported array */
+typedef struct _struct_arrow_array_data
+{
+	const void *buffers[STRUCT_ARROW_BUFFERS];
+	struct ArrowArray **children;
+	struct ArrowArray child_arrays[];
+} struct_arrow_array_data;
+
+/** Private data of exported schema */
+typedef struct _struct_arrow_schema_data
+{
+	char format[STRUCT_ARROW_NAME_SIZE];
+	char name[STRUCT_ARROW_NAME_SIZE];
+	struct ArrowSchema **children;
+	struct ArrowSchema child_schemas[];
+} struct_arrow_schema_data;
+
+//
+// Private Services
+//
+
+static void struct_arrow_release_array(struct ArrowArray *array)
+{
+	struct_arrow_array_data *data = array->private_data;
+	int64_t i;
+
+	// children moved by consumer are already released
+	for (i = 0; i < array->n_children; i++)
+		if (array->children[i]->release != NULL)
+			array->children[i]->release(array->children[i]);
+	for (i = 0; i < STRUCT_ARROW_BUFFERS; i++)
+		free((void *) data->buffers[i]);
+	free(data);
+	array->release = NULL;
+}
+
+static void struct_arrow_release_schema(struct ArrowSchema *schema)
+{
+	struct_arrow_schema_data *data = schema->private_data;
+	int64_t i;
+
+	for (i = 0; i < schema->n_children; i++)
+		if (schema->children[i]->release != NULL)
+			schema->children[i]->release(schema->children[i]);
+	free(data);
+	schema->release = NULL;
+}
+
+/**
+ * Initialize array with given count of buffers and empty children
+ * @param array Array
+ * @param length Count of values
+ * @param buffers Count of buffers
+ * @param children Count of children
+ * @return Private data of array or NULL when failed
+ */
+static struct_arrow_array_data *struct_arrow_init_array(struct ArrowArray *array, size_t length,
+		size_t buffers, size_t children)
+{
+	struct_arrow_array_data *data;
+	size_t i;
+
+	memset(array, 0, sizeof(*array));
+	data = calloc(1, sizeof(*data) + children * (sizeof(data->child_arrays[0]) + sizeof(data->children[0])));
+	if (data == NULL)
+		return NULL;
+
+	data->children = (struct ArrowArray **) &data->child_arrays[children];
+	for (i = 0; i < children; i++)
+		data->children[i] = &data->child_arrays[i];
+
+	array->length = length;
+	array->n_buffers = buffers;
+	array->n_children = children;
+	array->buffers = data->buffers;
+	array->children = data->children;
+	array->release = struct_arrow_release_array;
+	array->private_data = data;
+	return data;
+}
+
+/**
+ * Initialize schema with empty children
+ * @param schema Schema
+ * @param format Arrow format string
+ * @param name Name of field
+ * @param children Count of children
+ * @return Private data of schema or NULL when failed
+ */
+static struct_arrow_schema_data *struct_arrow_init_schema(struct ArrowSchema *schema, const char *format,
+		const char *name, size_t children)
+{
+	struct_arrow_schema_data *data;
+	size_t i;
+
+	memset(schema, 0, sizeof(*schema));
+	data = calloc(1, sizeof(*data) + children * (sizeof(data->child_schemas[0]) + sizeof(data->children[0])));
+	if (data == NULL)
+		return NULL;
+
+	data->children = (struct ArrowSchema **) &data->child_schemas[children];
+	for (i = 0; i < children; i++)
+		data->children[i] = &data->child_schemas[i];
+	snprintf(data->format, sizeof(data->format), "%s", format);
+	snprintf(data->name, sizeof(data->name), "%s", name);
+
+	schema->format = data->format;
+	schema->name = data->name;
+	schema->n_children = children;
+	schema->children = data->children;
+	schema->release = struct_arrow_release_schema;
+	schema->private_data = data;
+	return data;
+}
+
+/**
+ * Get Arrow format string of field values
+ * @param format Format character
+ * @param width Size of single value
+ */
+static const char *struct_arrow_type(char format, size_t width)
+{
+	switch (format)
+	{
+	case '?':
+	case 'T':
+		return "b";
+	case 'f':
+		return "f";
+	case 'd':
+		return "g";
+	case 's':
+		return "z";
+	}
+
+	switch (width)
+	{
+	case sizeof(int8_t):
+		return struct_format_signed(format) ? "c" : "C";
+	case sizeof(int16_t):
+		return struct_format_signed(format) ? "s" : "S";
+	case sizeof(int32_t):
+		return struct_format_signed(format) ? "i" : "I";
+	default:
+		return struct_format_signed(format) ? "l" : "L";
+	}
+}
+
+static void *struct_arrow_alloc(size_t size)
+{
+	return malloc(size > 0 ? size : 1);
+}
+
+/**
+ * Extract values of single field from packed records to contiguous array in host byte order
+ * @return Zero on success or negative when failed
+ */
+static int struct_arrow_column(void *dst, const struct_format *format, const struct_field *field,
+		const void *records, size_t count)
+{
+	uint64_t storage[(sizeof(struct_format) + sizeof(struct_field) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+	struct_format *column = (struct_format *) storage;
+
+	// batch unpack of format with single field copies only its column
+	column->byte_order = format->byte_order;
+	column->size = format->size;
+	column->count = 1;
+	column->strategy = format->strategy;
+	column->block = format->block;
+	column->prefetch = format->prefetch;
+	column->fields[0] = *field;
+
+	return struct_unpack_array(records, count * format->size, column, count, dst) < 0 ? -1 : 0;
+}
+
+/**
+ * Export values of field as array without nested children
+ * @param values Count of values
+ * @return Zero on success or negative when failed
+ */
+static int struct_arrow_leaf(const struct_format *format, const struct_field *f, const void *records,
+		size_t count, size_t values, struct ArrowArray *array, struct ArrowSchema *schema, const char *name)
+{
+	size_t width = f->size / f->repeat;
+	struct_arrow_array_data *data;
+	uint8_t *column;
+
+	if (struct_arrow_init_schema(schema, struct_arrow_type(f->format, width), name, 0) == NULL)
+		return -1;
+
+	data = struct_arrow_init_array(array, values, f->format == 's' ? 3 : 2, 0);
+	if (data == NULL)
+		return -1;
+
+	// booleans are extracted one per byte before packing to bitmap
+	if (f->format == '?' || f->format == 'T')
+		width = sizeof(uint8_t);
+	column = struct_arrow_alloc(f->format == 's' ? count * f->size : values * width);
+	if (column == NULL || struct_arrow_column(column, format, f, records, count) < 0)
+	{
+		free(column);
+		return -1;
+	}
+
+	if (f->format == '?' || f->format == 'T')
+	{
+		data->buffers[1] = struct_arrow_alloc((values + 7) / 8);
+		if (data->buffers[1] != NULL)
+			struct_bits_from_bool((void *) data->buffers[1], column, values);
+		free(column);
+		return data->buffers[1] != NULL ? 0 : -1;
+	}
+
+	if (f->format == 's')
+	{
+		int32_t *offsets;
+		size_t i, length, end = 0;
+
+		data->buffers[2] = column;
+		data->buffers[1] = offsets = struct_arrow_alloc((count + 1) * sizeof(int32_t));
+		if (offsets == NULL || count * f->size > INT32_MAX)
+			return -1;
+
+		// values are compacted in place without zero padding added by packing of shorter strings
+		offsets[0] = 0;
+		for (i = 0; i < count; i++)
+		{
+			for (length = f->size; length > 0 && column[i * f->size + length - 1] == '\0'; length--);
+			memmove(column + end, column + i * f->size, length);
+			end += length;
+			offsets[i + 1] = end;
+		}
+		return 0;
+	}
+
+	data->buffers[1] = column;
+	return 0;
+}
+
+/**
+ * Export field as child of struct array
+ * @return Zero on success or negative when failed
+ */
+static int struct_arrow_field(const struct_format *format, size_t index, const void *records, size_t count,
+		struct ArrowArray *array, struct ArrowSchema *schema)
+{
+	const struct_field *f = &format->fields[index];
+	char name[STRUCT_ARROW_NAME_SIZE], list[STRUCT_ARROW_NAME_SIZE];
+
+	snprintf(name, sizeof(name), "f%zu", index);
+	if (f->format == 's' || (f->repeat == 1 && f->format != 'T'))
+		return struct_arrow_leaf(format, f, records, count, count, array, schema, name);
+
+	snprintf(list, sizeof(list), "+w:%zu", f->repeat);
+	if (struct_arrow_init_schema(schema, list, name, 1) == NULL ||
+			struct_arrow_init_array(array, count, 1, 1) == NULL)
+		return -1;
+
+	return struct_arrow_leaf(format, f, records, count, count * f->repeat, array->children[0],
+			schema->children[0], "item");
+}
+
+//
+// Public Services
+//
+
+ssize_t struct_arrow_export(const struct_format *format, const void *records, size_t count,
+		struct ArrowArray *array, struct ArrowSchema *schema)
+{
+	size_t fields = 0;
+	size_t i, n;
+
+	if (format == NULL || array == NULL || schema == NULL || (records == NULL && count > 0))
+		return -1;
+
+	for (i = 0; i < format->count; i++)
+		if (format->fields[i].format != 'x' && format->fields[i].repeat > 0)
+			fields++;
+
+	memset(schema, 0, sizeof(*schema));
+	if (struct_arrow_init_array(array, count, 1, fields) == NULL ||
+			struct_arrow_init_schema(schema, "+s", "", fields) == NULL)
+		goto fail;
+
+	for (i = 0, n = 0; i < format->count; i++)
+	{
+		if (format->fields[i].format == 'x' || format->fields[i].repeat == 0)
+			continue;
+
+		if (struct_arrow_field(format, i, records, count, array->children[n], schema->children[n]) < 0)
+			goto fail;
+		n++;
+	}
+
+	return count;
+
+fail:
+	if (array->release != NULL)
+		array->release(array);
+	if (schema->release != NULL)
+		schema->release(schema);
+	return -1;
+}
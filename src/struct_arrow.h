@@ -0,0 +1,98 @@
+/**
+ * struct_arrow.h
+ * Export of packed records as Arrow C data interface arrays.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STRUCT_ARROW_H_
+#define STRUCT_ARROW_H_
+
+#include "struct.h"
+#include <stdint.h>
+
+//
+// Public Types
+//
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+/** Arrow C data interface schema, see https://arrow.apache.org/docs/format/CDataInterface.html */
+struct ArrowSchema
+{
+	const char *format;
+	const char *name;
+	const char *metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema **children;
+	struct ArrowSchema *dictionary;
+	void (*release)(struct ArrowSchema *);
+	void *private_data;
+};
+
+/** Arrow C data interface array */
+struct ArrowArray
+{
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void **buffers;
+	struct ArrowArray **children;
+	struct ArrowArray *dictionary;
+	void (*release)(struct ArrowArray *);
+	void *private_data;
+};
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+//
+// Public Services
+//
+
+/**
+ * Export array of packed records as Arrow struct array with child for each field
+ * Padding and fields with zero repeat count are skipped, children are named
+ * "f<N>" by number of field in compiled format. Integer and floating point
+ * fields are exported as types of the same width, '?' as boolean, 's' as
+ * binary, since it may hold any bytes, with trailing zero bytes trimmed as
+ * padding of shorter strings, repeated fields and 'T' bitsets as
+ * fixed size lists. Exported data is copied and released by release callbacks
+ * of array and schema.
+ * @param format Compiled format of records
+ * @param records Packed records
+ * @param count Count of records
+ * @param array Destination array
+ * @param schema Destination schema
+ * @return Count of exported records or negative when failed
+ */
+ssize_t struct_arrow_export(const struct_format *format, const void *records, size_t count,
+		struct ArrowArray *array, struct ArrowSchema *schema);
+
+#endif /* STRUCT_ARROW_H_ */
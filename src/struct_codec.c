@@ -0,0 +1,260 @@
+/**
+ * struct_codec.c
+ * Block compression codecs for streams of packed records.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "struct_codec.h"
+#include <stdint.h>
+#include <string.h>
+
+//
+// Private Definitions
+//
+
+/** Minimal length of match */
+#define STRUCT_LZ_MIN_MATCH		4
+
+/** Maximal distance to match */
+#define STRUCT_LZ_MAX_OFFSET	65535
+
+/** Size of match finder hash table as power of two */
+#define STRUCT_LZ_HASH_BITS		12
+
+/** Length value in sequence token telling that length continues in next bytes */
+#define STRUCT_LZ_LENGTH_MORE	15
+
+/** Misses count as power of two after which match finder starts skipping input */
+#define STRUCT_LZ_SKIP_TRIGGER	6
+
+//
+// Private Services
+//
+
+static inline uint32_t struct_lz_read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t struct_lz_hash(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - STRUCT_LZ_HASH_BITS);
+}
+
+/**
+ * Write continuation of length exceeding sequence token field
+ * @param op Output pointer
+ * @param length Length without part stored in token
+ * @return Next output pointer
+ */
+static inline uint8_t *struct_lz_write_length(uint8_t *op, size_t length)
+{
+	for (; length >= 255; length -= 255)
+		*op++ = 255;
+	*op++ = length;
+	return op;
+}
+
+/**
+ * Read continuation of length exceeding sequence token field
+ * @param ip Input pointer, advanced past length bytes
+ * @param iend End of input
+ * @param length Length stored in token, increased by continuation
+ * @return Zero on success or negative when input is truncated
+ */
+static inline int struct_lz_read_length(const uint8_t **ip, const uint8_t *iend, size_t *length)
+{
+	uint8_t b;
+
+	if (*length != STRUCT_LZ_LENGTH_MORE)
+		return 0;
+	do {
+		if (*ip >= iend)
+			return -1;
+		b = *(*ip)++;
+		*length += b;
+	} while (b == 255);
+	return 0;
+}
+
+/**
+ * Write sequence of literals with optional match following them
+ * @param op Output pointer
+ * @param literals Literals
+ * @param literals_length Count of literals
+ * @param offset Distance to match, zero for last sequence without match
+ * @param match_length Length of match
+ * @return Next output pointer
+ */
+static uint8_t *struct_lz_write_sequence(uint8_t *op, const uint8_t *literals, size_t literals_length,
+		size_t offset, size_t match_length)
+{
+	uint8_t *token = op++;
+
+	if (literals_length >= STRUCT_LZ_LENGTH_MORE)
+	{
+		*token = STRUCT_LZ_LENGTH_MORE << 4;
+		op = struct_lz_write_length(op, literals_length - STRUCT_LZ_LENGTH_MORE);
+	}
+	else
+	{
+		*token = literals_length << 4;
+	}
+	memcpy(op, literals, literals_length);
+	op += literals_length;
+
+	if (offset == 0)
+		return op;
+
+	*op++ = offset & 0xff;
+	*op++ = offset >> 8;
+	match_length -= STRUCT_LZ_MIN_MATCH;
+	if (match_length >= STRUCT_LZ_LENGTH_MORE)
+	{
+		*token |= STRUCT_LZ_LENGTH_MORE;
+		op = struct_lz_write_length(op, match_length - STRUCT_LZ_LENGTH_MORE);
+	}
+	else
+	{
+		*token |= match_length;
+	}
+	return op;
+}
+
+static size_t struct_lz_bound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+/**
+ * Compress block
+ * Greedy parser with single entry hash table, input without matches is
+ * skipped with increasing step so incompressible data costs little time.
+ * Destination must have at least struct_lz_bound() bytes.
+ */
+static ssize_t struct_lz_compress(void *dst, size_t dst_size, const void *src, size_t src_size)
+{
+	uint32_t table[1 << STRUCT_LZ_HASH_BITS];
+	const uint8_t *ip = src, *anchor = src, *end = ip + src_size;
+	uint8_t *op = dst;
+
+	if (dst == NULL || (src == NULL && src_size > 0) || dst_size < struct_lz_bound(src_size))
+		return -1;
+
+	memset(table, 0, sizeof(table));
+
+	while (ip + STRUCT_LZ_MIN_MATCH <= end)
+	{
+		uint32_t v = struct_lz_read32(ip);
+		uint32_t h = struct_lz_hash(v);
+		const uint8_t *ref = (const uint8_t *) src + table[h];
+		size_t length;
+
+		table[h] = ip - (const uint8_t *) src;
+		if (ref >= ip || ip - ref > STRUCT_LZ_MAX_OFFSET || struct_lz_read32(ref) != v)
+		{
+			ip += 1 + ((ip - anchor) >> STRUCT_LZ_SKIP_TRIGGER);
+			continue;
+		}
+
+		length = STRUCT_LZ_MIN_MATCH;
+		while (ip + length < end && ref[length] == ip[length])
+			length++;
+
+		op = struct_lz_write_sequence(op, anchor, ip - anchor, ip - ref, length);
+		ip += length;
+		anchor = ip;
+	}
+
+	op = struct_lz_write_sequence(op, anchor, end - anchor, 0, 0);
+	return op - (uint8_t *) dst;
+}
+
+static ssize_t struct_lz_decompress(void *dst, size_t dst_size, const void *src, size_t src_size)
+{
+	const uint8_t *ip = src, *iend = ip + src_size;
+	uint8_t *op = dst, *oend = op + dst_size;
+
+	if (dst == NULL || src == NULL)
+		return -1;
+
+	while (ip < iend)
+	{
+		uint8_t token = *ip++;
+		size_t length = token >> 4;
+		size_t offset;
+
+		if (struct_lz_read_length(&ip, iend, &length) != 0 ||
+				length > (size_t) (iend - ip) || length > (size_t) (oend - op))
+			return -1;
+		memcpy(op, ip, length);
+		op += length;
+		ip += length;
+
+		// last sequence has literals only
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return -1;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t) (op - (uint8_t *) dst))
+			return -1;
+
+		length = token & STRUCT_LZ_LENGTH_MORE;
+		if (struct_lz_read_length(&ip, iend, &length) != 0)
+			return -1;
+		length += STRUCT_LZ_MIN_MATCH;
+		if (length > (size_t) (oend - op))
+			return -1;
+
+		// overlapping match repeats last offset bytes
+		if (offset >= length)
+		{
+			memcpy(op, op - offset, length);
+			op += length;
+		}
+		else
+		{
+			for (; length > 0; length--, op++)
+				*op = *(op - offset);
+		}
+	}
+
+	return op - (uint8_t *) dst;
+}
+
+//
+// Public Variables
+//
+
+const struct_codec struct_codec_lz = {
+		.name = "lz",
+		.bound = struct_lz_bound,
+		.compress = struct_lz_compress,
+		.decompress = struct_lz_decompress
+};
@@ -0,0 +1,81 @@
+/**
+ * struct_codec.h
+ * Block compression codecs for streams of packed records.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STRUCT_CODEC_H_
+#define STRUCT_CODEC_H_
+
+#include <stdlib.h>
+
+//
+// Public Types
+//
+
+/** Block compression codec */
+typedef struct _struct_codec
+{
+	/** Codec name */
+	const char *name;
+
+	/**
+	 * Calculate maximal size of compressed block
+	 * @param size Size of source data
+	 * @return Maximal size of compressed data
+	 */
+	size_t (*bound)(size_t size);
+
+	/**
+	 * Compress block
+	 * @param dst Destination buffer
+	 * @param dst_size Size of destination buffer
+	 * @param src Source data
+	 * @param src_size Size of source data
+	 * @return Size of compressed data or negative when failed
+	 */
+	ssize_t (*compress)(void *dst, size_t dst_size, const void *src, size_t src_size);
+
+	/**
+	 * Decompress block
+	 * @param dst Destination buffer
+	 * @param dst_size Size of destination buffer
+	 * @param src Compressed data
+	 * @param src_size Size of compressed data
+	 * @return Size of decompressed data or negative when failed
+	 */
+	ssize_t (*decompress)(void *dst, size_t dst_size, const void *src, size_t src_size);
+} struct_codec;
+
+//
+// Public Variables
+//
+
+/**
+ * Fast LZ77 codec without external dependencies
+ * Compressed block is a sequence of literal runs followed by matches with
+ * 16-bit offsets, like LZ4 block format.
+ */
+extern const struct_codec struct_codec_lz;
+
+#endif /* STRUCT_CODEC_H_ */
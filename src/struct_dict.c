@@ -0,0 +1,435 @@
+/**
+ * struct_dict.c
+ * Dictionary encoding of string fields in blocks of packed records.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "struct_dict.h"
+#include "struct_internal.h"
+#include <string.h>
+
+//
+// Private Definitions
+//
+
+/** Size of record count in block header */
+#define STRUCT_DICT_HEADER_SIZE		sizeof(uint32_t)
+
+/** Size of dictionary index and dictionary entry count */
+#define STRUCT_DICT_INDEX_SIZE		sizeof(uint16_t)
+
+/** Maximal count of dictionary entries for one field */
+#define STRUCT_DICT_ENTRIES_MAX		65536
+
+//
+// Private Types
+//
+
+/** Hash table of distinct strings of one field */
+typedef struct _struct_dict_interner
+{
+	size_t width;		/**< Width of strings */
+	size_t count;		/**< Count of distinct strings */
+	size_t mask;		/**< Count of hash slots minus one */
+	uint32_t *slots;	/**< Entry number plus one for used slots, zero for free */
+	uint8_t *entries;	/**< Distinct strings in order of appearance */
+} struct_dict_interner;
+
+//
+// Private Services
+//
+
+/**
+ * Check if field is encoded by dictionary
+ */
+static inline int struct_dict_field(const struct_field *field)
+{
+	return field->format == 's' && field->size > 0;
+}
+
+/**
+ * Calculate size of record with string fields replaced by indices
+ */
+static size_t struct_dict_record_size(const struct_format *format)
+{
+	size_t result = format->size;
+	size_t i;
+
+	for (i = 0; i < format->count; i++)
+		if (struct_dict_field(&format->fields[i]))
+			result = result - format->fields[i].size + STRUCT_DICT_INDEX_SIZE;
+
+	return result;
+}
+
+/**
+ * Calculate offset of field in record with string fields replaced by indices
+ */
+static size_t struct_dict_field_offset(const struct_format *format, size_t field)
+{
+	size_t result = format->fields[field].offset;
+	size_t i;
+
+	for (i = 0; i < field; i++)
+		if (struct_dict_field(&format->fields[i]))
+			result = result - format->fields[i].size + STRUCT_DICT_INDEX_SIZE;
+
+	return result;
+}
+
+/**
+ * Hash string of fixed width
+ * Multiplicative hash over 64-bit words, strings are short so quality
+ * of mixing matters less than instruction count.
+ */
+static inline uint64_t struct_dict_hash(const uint8_t *p, size_t width)
+{
+	uint64_t h = width;
+	uint64_t v;
+
+	for (; width >= sizeof(v); width -= sizeof(v), p += sizeof(v))
+	{
+		memcpy(&v, p, sizeof(v));
+		h = (h ^ v) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+	if (width > 0)
+	{
+		v = 0;
+		memcpy(&v, p, width);
+		h = (h ^ v) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+static int struct_dict_interner_init(struct_dict_interner *interner, size_t width, size_t count)
+{
+	size_t slots = 16;
+
+	if (count > STRUCT_DICT_ENTRIES_MAX)
+		count = STRUCT_DICT_ENTRIES_MAX;
+	while (slots < 2 * count)
+		slots <<= 1;
+
+	interner->width = width;
+	interner->count = 0;
+	interner->mask = slots - 1;
+	interner->slots = calloc(slots, sizeof(interner->slots[0]));
+	interner->entries = malloc(count * width);
+
+	return interner->slots != NULL && (interner->entries != NULL || count == 0) ? 0 : -1;
+}
+
+static void struct_dict_interner_free(struct_dict_interner *interner)
+{
+	free(interner->slots);
+	free(interner->entries);
+}
+
+/**
+ * Find string in interner adding it when not found
+ * @param interner Interner of field strings
+ * @param str String of interner width
+ * @return Entry number or negative when dictionary is full
+ */
+static ssize_t struct_dict_intern(struct_dict_interner *interner, const uint8_t *str)
+{
+	size_t slot = struct_dict_hash(str, interner->width) & interner->mask;
+	uint32_t entry;
+
+	while ((entry = interner->slots[slot]) != 0)
+	{
+		if (memcmp(&interner->entries[(entry - 1) * interner->width], str, interner->width) == 0)
+			return entry - 1;
+		slot = (slot + 1) & interner->mask;
+	}
+
+	// table is sized for all records of block, so it never gets more than half full
+	if (interner->count == STRUCT_DICT_ENTRIES_MAX)
+		return -1;
+
+	memcpy(&interner->entries[interner->count * interner->width], str, interner->width);
+	interner->slots[slot] = ++interner->count;
+	return interner->count - 1;
+}
+
+/**
+ * Locate dictionary of field in encoded block
+ * @param entries Returning count of dictionary entries
+ * @return Pointer to first dictionary entry or NULL when block is broken
+ */
+static const uint8_t *struct_dict_locate(const void *block, size_t block_size,
+		const struct_format *format, size_t field, size_t *entries)
+{
+	const uint8_t *p = block, *end = p + block_size;
+	size_t count, i;
+
+	if (block_size < STRUCT_DICT_HEADER_SIZE || struct_dict_record_size(format) == 0)
+		return NULL;
+	count = struct_load_uint(p, sizeof(uint32_t), __LITTLE_ENDIAN);
+	if (count > (block_size - STRUCT_DICT_HEADER_SIZE) / struct_dict_record_size(format))
+		return NULL;
+	p += STRUCT_DICT_HEADER_SIZE + count * struct_dict_record_size(format);
+
+	for (i = 0; i < format->count; i++)
+	{
+		const struct_field *f = &format->fields[i];
+
+		if (!struct_dict_field(f))
+			continue;
+		if ((size_t) (end - p) < STRUCT_DICT_INDEX_SIZE)
+			return NULL;
+		*entries = struct_load_uint(p, STRUCT_DICT_INDEX_SIZE, __LITTLE_ENDIAN);
+		if (*entries == 0 && count > 0)
+			*entries = STRUCT_DICT_ENTRIES_MAX;
+		p += STRUCT_DICT_INDEX_SIZE;
+		if ((size_t) (end - p) / f->size < *entries)
+			return NULL;
+		if (i == field)
+			return p;
+		p += *entries * f->size;
+	}
+
+	return NULL;
+}
+
+//
+// Public Services
+//
+
+ssize_t struct_dict_bound(const struct_format *format, size_t count)
+{
+	size_t result, i;
+
+	if (format == NULL)
+		return -1;
+
+	result = STRUCT_DICT_HEADER_SIZE + count * struct_dict_record_size(format);
+	for (i = 0; i < format->count; i++)
+		if (struct_dict_field(&format->fields[i]))
+			result += STRUCT_DICT_INDEX_SIZE + count * format->fields[i].size;
+
+	return result;
+}
+
+ssize_t struct_dict_encode(void *block, size_t size, const struct_format *format,
+		const void *records, size_t count)
+{
+	struct_dict_interner *interners;
+	const uint8_t *src = records;
+	uint8_t *p = block;
+	size_t record_size, i, n;
+	ssize_t result = -1;
+
+	if (block == NULL || format == NULL || (records == NULL && count > 0) || count > UINT32_MAX)
+		return -1;
+
+	record_size = struct_dict_record_size(format);
+	if (record_size == 0 || size < STRUCT_DICT_HEADER_SIZE || (size - STRUCT_DICT_HEADER_SIZE) / record_size < count)
+		return -1;
+
+	interners = calloc(format->count, sizeof(*interners));
+	if (interners == NULL)
+		return -1;
+	for (i = 0; i < format->count; i++)
+		if (struct_dict_field(&format->fields[i]) &&
+				struct_dict_interner_init(&interners[i], format->fields[i].size, count) != 0)
+			goto out;
+
+	struct_store_uint(p, sizeof(uint32_t), __LITTLE_ENDIAN, count);
+	p += STRUCT_DICT_HEADER_SIZE;
+
+	for (n = 0; n < count; n++, src += format->size)
+	{
+		size_t pos = 0;
+
+		for (i = 0; i < format->count; i++)
+		{
+			const struct_field *f = &format->fields[i];
+			ssize_t entry;
+
+			if (!struct_dict_field(f))
+				continue;
+
+			entry = struct_dict_intern(&interners[i], src + f->offset);
+			if (entry < 0)
+				goto out;
+
+			memcpy(p, src + pos, f->offset - pos);
+			p += f->offset - pos;
+			struct_store_uint(p, STRUCT_DICT_INDEX_SIZE, __LITTLE_ENDIAN, entry);
+			p += STRUCT_DICT_INDEX_SIZE;
+			pos = f->offset + f->size;
+		}
+		memcpy(p, src + pos, format->size - pos);
+		p += format->size - pos;
+	}
+
+	for (i = 0; i < format->count; i++)
+	{
+		const struct_dict_interner *interner = &interners[i];
+
+		if (!struct_dict_field(&format->fields[i]))
+			continue;
+		if ((size_t) ((uint8_t *) block + size - p) < STRUCT_DICT_INDEX_SIZE + interner->count * interner->width)
+			goto out;
+
+		// 65536 entries are stored as zero, empty dictionary is possible for empty block only
+		struct_store_uint(p, STRUCT_DICT_INDEX_SIZE, __LITTLE_ENDIAN, interner->count);
+		p += STRUCT_DICT_INDEX_SIZE;
+		memcpy(p, interner->entries, interner->count * interner->width);
+		p += interner->count * interner->width;
+	}
+
+	result = p - (uint8_t *) block;
+
+out:
+	for (i = 0; i < format->count; i++)
+		if (struct_dict_field(&format->fields[i]))
+			struct_dict_interner_free(&interners[i]);
+	free(interners);
+	return result;
+}
+
+ssize_t struct_dict_decode(void *records, size_t size, const struct_format *format,
+		const void *block, size_t block_size)
+{
+	const uint8_t **dictionaries;
+	size_t *entries;
+	const uint8_t *p = block;
+	uint8_t *dst = records;
+	size_t count, i, n;
+	ssize_t result = -1;
+
+	if (records == NULL || format == NULL || block == NULL || block_size < STRUCT_DICT_HEADER_SIZE)
+		return -1;
+
+	// records must fit into block even when there are no dictionaries to check it
+	count = struct_load_uint(p, sizeof(uint32_t), __LITTLE_ENDIAN);
+	if ((format->size > 0 && size / format->size < count) || (struct_dict_record_size(format) > 0 &&
+			(block_size - STRUCT_DICT_HEADER_SIZE) / struct_dict_record_size(format) < count))
+		return -1;
+
+	dictionaries = calloc(format->count, sizeof(*dictionaries));
+	entries = calloc(format->count, sizeof(*entries));
+	if (dictionaries == NULL || entries == NULL)
+		goto out;
+	for (i = 0; i < format->count; i++)
+	{
+		if (!struct_dict_field(&format->fields[i]))
+			continue;
+		dictionaries[i] = struct_dict_locate(block, block_size, format, i, &entries[i]);
+		if (dictionaries[i] == NULL)
+			goto out;
+	}
+
+	p += STRUCT_DICT_HEADER_SIZE;
+	for (n = 0; n < count; n++, dst += format->size)
+	{
+		size_t pos = 0;
+
+		for (i = 0; i < format->count; i++)
+		{
+			const struct_field *f = &format->fields[i];
+			size_t entry;
+
+			if (!struct_dict_field(f))
+				continue;
+
+			memcpy(dst + pos, p, f->offset - pos);
+			p += f->offset - pos;
+			entry = struct_load_uint(p, STRUCT_DICT_INDEX_SIZE, __LITTLE_ENDIAN);
+			if (entry >= entries[i])
+				goto out;
+			memcpy(dst + f->offset, &dictionaries[i][entry * f->size], f->size);
+			p += STRUCT_DICT_INDEX_SIZE;
+			pos = f->offset + f->size;
+		}
+		memcpy(dst + pos, p, format->size - pos);
+		p += format->size - pos;
+	}
+
+	result = count;
+
+out:
+	free(dictionaries);
+	free(entries);
+	return result;
+}
+
+ssize_t struct_dict_find(const void *block, size_t block_size, const struct_format *format,
+		size_t field, const char *str)
+{
+	const uint8_t *dictionary;
+	size_t entries, width, length, i;
+
+	if (block == NULL || format == NULL || str == NULL || field >= format->count ||
+			!struct_dict_field(&format->fields[field]))
+		return -1;
+
+	dictionary = struct_dict_locate(block, block_size, format, field, &entries);
+	if (dictionary == NULL)
+		return -1;
+
+	// strings are packed with zero padding up to field width
+	width = format->fields[field].size;
+	length = strnlen(str, width + 1);
+	if (length > width)
+		return -1;
+
+	for (i = 0; i < entries; i++, dictionary += width)
+	{
+		size_t j = length;
+
+		if (memcmp(dictionary, str, length) != 0)
+			continue;
+		while (j < width && dictionary[j] == '\0')
+			j++;
+		if (j == width)
+			return i;
+	}
+
+	return -1;
+}
+
+ssize_t struct_dict_index(const void *block, size_t block_size, const struct_format *format,
+		size_t record, size_t field)
+{
+	size_t record_size, count, offset;
+
+	if (block == NULL || format == NULL || field >= format->count ||
+			!struct_dict_field(&format->fields[field]) || block_size < STRUCT_DICT_HEADER_SIZE)
+		return -1;
+
+	record_size = struct_dict_record_size(format);
+	count = struct_load_uint(block, sizeof(uint32_t), __LITTLE_ENDIAN);
+	if (record >= count)
+		return -1;
+
+	offset = STRUCT_DICT_HEADER_SIZE + record * record_size + struct_dict_field_offset(format, field);
+	if (offset + STRUCT_DICT_INDEX_SIZE > block_size)
+		return -1;
+
+	return struct_load_uint((const uint8_t *) block + offset, STRUCT_DICT_INDEX_SIZE, __LITTLE_ENDIAN);
+}
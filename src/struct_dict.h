@@ -0,0 +1,96 @@
+/**
+ * struct_dict.h
+ * Dictionary encoding of string fields in blocks of packed records.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STRUCT_DICT_H_
+#define STRUCT_DICT_H_
+
+#include "struct.h"
+
+//
+// Public Services
+//
+
+/**
+ * Calculate maximal size of encoded block
+ * @param format Compiled format of records
+ * @param count Count of records in block
+ * @return Maximal block size or negative when failed
+ */
+ssize_t struct_dict_bound(const struct_format *format, size_t count);
+
+/**
+ * Encode block of records replacing each 's' field by index in dictionary of the field
+ * Block starts with 32-bit count of records followed by records with 16-bit
+ * indices in place of strings. Dictionaries of 's' fields follow records, each
+ * is 16-bit count of entries and entries of field width. Block integers are
+ * little endian, up to 65536 distinct strings per field are supported.
+ * @param block Destination buffer
+ * @param size Size of destination buffer
+ * @param format Compiled format of records
+ * @param records Packed records
+ * @param count Count of records
+ * @return Size of encoded block or negative when failed
+ */
+ssize_t struct_dict_encode(void *block, size_t size, const struct_format *format,
+		const void *records, size_t count);
+
+/**
+ * Decode block of records encoded by struct_dict_encode()
+ * @param records Destination buffer for packed records
+ * @param size Size of destination buffer
+ * @param format Compiled format of records
+ * @param block Encoded block
+ * @param block_size Size of encoded block
+ * @return Count of decoded records or negative when failed
+ */
+ssize_t struct_dict_decode(void *records, size_t size, const struct_format *format,
+		const void *block, size_t block_size);
+
+/**
+ * Find dictionary index of string, so records can be filtered by comparing indices
+ * @param block Encoded block
+ * @param block_size Size of encoded block
+ * @param format Compiled format of records
+ * @param field Number of 's' field in compiled format
+ * @param str String to find
+ * @return Dictionary index or negative when string is not in dictionary
+ */
+ssize_t struct_dict_find(const void *block, size_t block_size, const struct_format *format,
+		size_t field, const char *str);
+
+/**
+ * Get dictionary index of string field of encoded record without decoding
+ * @param block Encoded block
+ * @param block_size Size of encoded block
+ * @param format Compiled format of records
+ * @param record Number of record in block
+ * @param field Number of 's' field in compiled format
+ * @return Dictionary index or negative when failed
+ */
+ssize_t struct_dict_index(const void *block, size_t block_size, const struct_format *format,
+		size_t record, size_t field);
+
+#endif /* STRUCT_DICT_H_ */
@@ -0,0 +1,324 @@
+/**
+ * struct_index.c
+ * Sorted secondary index over key field of packed record file.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "struct_index.h"
+#include "struct_internal.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+// Private Definitions
+//
+
+/** Index file signature */
+#define STRUCT_INDEX_MAGIC		"SIDX"
+
+/** Index file format version */
+#define STRUCT_INDEX_VERSION	1
+
+/** Count of interpolation steps before search falls back to bisection */
+#define STRUCT_INDEX_INTERPOLATIONS	8
+
+/** Sign bit of normalized key */
+#define STRUCT_INDEX_SIGN		(1ULL << 63)
+
+//
+// Private Types
+//
+
+/**
+ * Header of index file
+ * Header is followed by array of sorted keys and array of record numbers,
+ * both with count of 64-bit entries. Keys of signed fields are stored with
+ * inverted sign bit so all keys are compared as unsigned values.
+ */
+typedef struct _struct_index_header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t is_signed;
+	uint32_t reserved;
+	uint64_t count;
+} struct_index_header;
+
+/** Key and record number pair used while building index */
+typedef struct _struct_index_entry
+{
+	uint64_t key;
+	uint64_t record;
+} struct_index_entry;
+
+struct _struct_index
+{
+	void *map;
+	size_t map_size;
+	int is_signed;
+	size_t count;
+	const uint64_t *keys;
+	const uint64_t *records;
+};
+
+//
+// Private Services
+//
+
+/**
+ * Check if field can be used as index key
+ * @param field Compiled format field
+ * @return Non-zero for supported key fields
+ */
+static int struct_index_key_field(const struct_field *field)
+{
+	return field->repeat == 1 && field->size <= sizeof(uint64_t) &&
+			strchr("cbB?hHiIlLqQ", field->format) != NULL;
+}
+
+/**
+ * Convert key value to order preserving unsigned value
+ * @param key Key value, sign extended for signed fields
+ * @param is_signed Key field is signed integer
+ * @return Normalized key
+ */
+static inline uint64_t struct_index_normalize(uint64_t key, int is_signed)
+{
+	return is_signed ? key ^ STRUCT_INDEX_SIGN : key;
+}
+
+static int struct_index_entry_compare(const void *a, const void *b)
+{
+	const struct_index_entry *ea = a, *eb = b;
+
+	if (ea->key != eb->key)
+		return ea->key < eb->key ? -1 : 1;
+	if (ea->record != eb->record)
+		return ea->record < eb->record ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Find position of first key not less than given one
+ * Positions are guessed by linear interpolation between boundary keys, that
+ * gives near constant step count on evenly distributed keys like sequence
+ * numbers or timestamps. Bisection guarantees logarithmic worst case.
+ * @param keys Sorted normalized keys
+ * @param count Count of keys
+ * @param key Normalized key to find
+ * @return Position of first key not less than given one
+ */
+static size_t struct_index_lower_bound(const uint64_t *keys, size_t count, uint64_t key)
+{
+	size_t lo = 0, hi = count, probe;
+	unsigned step = 0;
+
+	while (lo < hi)
+	{
+		if (step++ < STRUCT_INDEX_INTERPOLATIONS && keys[lo] < key && key <= keys[hi - 1])
+		{
+			double ratio = (double) (key - keys[lo]) / (double) (keys[hi - 1] - keys[lo]);
+			probe = lo + (size_t) (ratio * (hi - 1 - lo));
+			if (probe >= hi)
+				probe = hi - 1;
+		}
+		else
+		{
+			probe = lo + (hi - lo) / 2;
+		}
+
+		if (keys[probe] < key)
+			lo = probe + 1;
+		else
+			hi = probe;
+	}
+
+	return lo;
+}
+
+//
+// Public Services
+//
+
+ssize_t struct_index_build(const char *index_path, const char *records_path,
+		const struct_format *format, size_t field)
+{
+	const struct_field *key_field;
+	struct_index_header header;
+	struct_index_entry *entries = NULL;
+	const uint8_t *records = MAP_FAILED;
+	struct stat st;
+	size_t count = 0, i;
+	ssize_t result = -1;
+	int is_signed;
+	FILE *f = NULL;
+	int fd;
+
+	if (index_path == NULL || records_path == NULL || format == NULL ||
+			field >= format->count || format->size == 0)
+		return -1;
+
+	key_field = &format->fields[field];
+	if (!struct_index_key_field(key_field))
+		return -1;
+	is_signed = struct_format_signed(key_field->format);
+
+	fd = open(records_path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) != 0 || st.st_size % format->size != 0)
+		goto out;
+
+	count = st.st_size / format->size;
+	if (count > 0)
+	{
+		records = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (records == MAP_FAILED)
+			goto out;
+		madvise((void *) records, st.st_size, MADV_SEQUENTIAL);
+
+		entries = malloc(count * sizeof(*entries));
+		if (entries == NULL)
+			goto out;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		uint64_t key = struct_load_uint(records + i * format->size + key_field->offset,
+				key_field->size, format->byte_order);
+		if (is_signed)
+			key = struct_sign_extend(key, key_field->size);
+		entries[i].key = struct_index_normalize(key, is_signed);
+		entries[i].record = i;
+	}
+	qsort(entries, count, sizeof(*entries), struct_index_entry_compare);
+
+	f = fopen(index_path, "wb");
+	if (f == NULL)
+		goto out;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, STRUCT_INDEX_MAGIC, sizeof(header.magic));
+	header.version = STRUCT_INDEX_VERSION;
+	header.is_signed = is_signed;
+	header.count = count;
+	if (fwrite(&header, sizeof(header), 1, f) != 1)
+		goto out;
+	for (i = 0; i < count; i++)
+		if (fwrite(&entries[i].key, sizeof(entries[i].key), 1, f) != 1)
+			goto out;
+	for (i = 0; i < count; i++)
+		if (fwrite(&entries[i].record, sizeof(entries[i].record), 1, f) != 1)
+			goto out;
+
+	result = count;
+
+out:
+	if (f != NULL && fclose(f) != 0)
+		result = -1;
+	free(entries);
+	if (records != MAP_FAILED)
+		munmap((void *) records, st.st_size);
+	close(fd);
+	return result;
+}
+
+struct_index *struct_index_open(const char *path)
+{
+	const struct_index_header *header;
+	struct_index *index;
+	struct stat st;
+	int fd;
+
+	if (path == NULL)
+		return NULL;
+
+	index = calloc(1, sizeof(*index));
+	if (index == NULL)
+		return NULL;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		goto fail;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(*header))
+	{
+		close(fd);
+		goto fail;
+	}
+
+	index->map_size = st.st_size;
+	index->map = mmap(NULL, index->map_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (index->map == MAP_FAILED)
+		goto fail;
+
+	header = index->map;
+	if (memcmp(header->magic, STRUCT_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+			header->version != STRUCT_INDEX_VERSION ||
+			header->count > (index->map_size - sizeof(*header)) / (2 * sizeof(uint64_t)))
+	{
+		munmap(index->map, index->map_size);
+		goto fail;
+	}
+
+	index->is_signed = header->is_signed;
+	index->count = header->count;
+	index->keys = (const uint64_t *) (header + 1);
+	index->records = index->keys + index->count;
+
+	return index;
+
+fail:
+	free(index);
+	return NULL;
+}
+
+void struct_index_close(struct_index *index)
+{
+	if (index == NULL)
+		return;
+
+	munmap(index->map, index->map_size);
+	free(index);
+}
+
+ssize_t struct_index_lookup(const struct_index *index, uint64_t key, size_t *records, size_t count)
+{
+	size_t first, i;
+
+	if (index == NULL || (records == NULL && count > 0))
+		return -1;
+
+	key = struct_index_normalize(key, index->is_signed);
+	first = struct_index_lower_bound(index->keys, index->count, key);
+
+	for (i = first; i < index->count && index->keys[i] == key; i++)
+		if (i - first < count)
+			records[i - first] = index->records[i];
+
+	return i - first;
+}
@@ -0,0 +1,81 @@
+/**
+ * struct_index.h
+ * Sorted secondary index over key field of packed record file.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STRUCT_INDEX_H_
+#define STRUCT_INDEX_H_
+
+#include "struct.h"
+#include <stdint.h>
+
+//
+// Public Types
+//
+
+/** Opened index, file is mapped to memory while opened */
+typedef struct _struct_index struct_index;
+
+//
+// Public Services
+//
+
+/**
+ * Build index over integer key field of record file
+ * Record file is a sequence of records packed with the same format, record N
+ * is located at offset N * format->size. Index file stores keys sorted in
+ * native byte order and is not portable between hosts with different order.
+ * @param index_path Path of index file to create
+ * @param records_path Path of record file
+ * @param format Compiled format of records
+ * @param field Number of key field in compiled format
+ * @return Count of indexed records or negative when failed
+ */
+ssize_t struct_index_build(const char *index_path, const char *records_path,
+		const struct_format *format, size_t field);
+
+/**
+ * Open index file
+ * @param path Path of index file
+ * @return Opened index or NULL when failed, must be closed by struct_index_close()
+ */
+struct_index *struct_index_open(const char *path);
+
+/**
+ * Close index file
+ * @param index Opened index, may be NULL
+ */
+void struct_index_close(struct_index *index);
+
+/**
+ * Find numbers of records with given key
+ * @param index Opened index
+ * @param key Key value, signed keys are passed as sign extended value
+ * @param records Array for found record numbers in ascending order
+ * @param count Size of records array
+ * @return Count of records with given key, may be greater than count, or negative when failed
+ */
+ssize_t struct_index_lookup(const struct_index *index, uint64_t key, size_t *records, size_t count);
+
+#endif /* STRUCT_INDEX_H_ */
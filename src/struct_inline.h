@@ -0,0 +1,191 @@
+/**
+ * struct_inline.h
+ * Inline size calculation folded by compiler for constant formats.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STRUCT_INLINE_H_
+#define STRUCT_INLINE_H_
+
+#include "struct.h"
+#include <stdint.h>
+
+//
+// Public Definitions
+//
+
+/**
+ * Calculate size of constant format at compile time
+ * Include this header instead of struct.h to replace calls of struct_calcsize()
+ * with constant format by result, when compiled by GCC or Clang with
+ * optimization. Other calls are left to library, format is evaluated twice.
+ */
+#if defined(__GNUC__) && defined(__OPTIMIZE__)
+#define struct_calcsize(format)	(__builtin_constant_p(format) ? \
+		struct_calcsize_inline(format) : (struct_calcsize)(format))
+#endif
+
+/** Attribute of services which must be inlined to be folded */
+#define STRUCT_INLINE			static inline __attribute__((always_inline))
+
+//
+// Private Types
+//
+
+/** State of inline size calculation */
+typedef struct _struct_inline_state
+{
+	const char *format;		/**< Next field in format string */
+	ssize_t size;			/**< Size of parsed fields or negative when library must calculate it */
+	int native_alignment;
+} struct_inline_state;
+
+//
+// Private Services
+//
+
+STRUCT_INLINE int struct_inline_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/**
+ * Add size of next field to state
+ * Parsing is written without loops, so compiler can evaluate it for constant
+ * format. Whitespaces, optional groups and repeat counts longer than four
+ * digits are left to library.
+ */
+STRUCT_INLINE void struct_inline_field(struct_inline_state *state)
+{
+	const char *c = state->format;
+	size_t repeat = 1, width, alignment, size;
+	int array;
+
+	if (state->size < 0 || *c == '\0')
+		return;
+
+	array = *c == '&';
+	if (array)
+		c++;
+
+	if (struct_inline_digit(*c))
+	{
+		repeat = *c++ - '0';
+		if (struct_inline_digit(*c))
+		{
+			repeat = repeat * 10 + *c++ - '0';
+			if (struct_inline_digit(*c))
+			{
+				repeat = repeat * 10 + *c++ - '0';
+				if (struct_inline_digit(*c))
+					repeat = repeat * 10 + *c++ - '0';
+			}
+		}
+	}
+
+	switch (*c)
+	{
+	case 'x': case 'c': case 'b': case 'B': case '?': case 's':
+		width = sizeof(uint8_t);
+		alignment = 1;
+		break;
+	case 'T':
+		width = 0;
+		alignment = 1;
+		break;
+	case 'h': case 'H':
+		width = sizeof(int16_t);
+		alignment = __alignof__(int16_t);
+		break;
+	case 'i': case 'I': case 'l': case 'L':
+		width = sizeof(uint32_t);
+		alignment = __alignof__(uint32_t);
+		break;
+	case 'q': case 'Q':
+		width = sizeof(uint64_t);
+		alignment = __alignof__(uint64_t);
+		break;
+	case 'f':
+		width = sizeof(float);
+		alignment = __alignof__(float);
+		break;
+	case 'd':
+		width = sizeof(double);
+		alignment = __alignof__(double);
+		break;
+	default:
+		state->size = -1;
+		return;
+	}
+
+	size = width ? repeat * width : (repeat + 7) / 8;
+	if (state->native_alignment)
+		size += (alignment - state->size % alignment) % alignment;
+
+	// empty fields and arrays of padding or strings are rejected by library
+	if (size == 0 || (array && (*c == 'x' || *c == 's')))
+	{
+		state->size = -1;
+		return;
+	}
+
+	state->size += size;
+	state->format = c + 1;
+}
+
+/**
+ * Calculate size of format inline, falling back to library for formats longer than
+ * 16 fields or unusual formats
+ * @param format Format pattern string
+ * @return Calculated data size or negative when failed
+ */
+STRUCT_INLINE ssize_t struct_calcsize_inline(const char *format)
+{
+	struct_inline_state state = { format, 0, 1 };
+
+	if (format == NULL)
+		return (struct_calcsize)(format);
+
+	switch (*format)
+	{
+	case '<': case '>': case '!': case '=':
+		state.native_alignment = 0;
+		state.format++;
+		break;
+	case '@':
+		state.format++;
+		break;
+	}
+
+#define STRUCT_INLINE_FIELDS_4 \
+	struct_inline_field(&state); struct_inline_field(&state); \
+	struct_inline_field(&state); struct_inline_field(&state);
+	STRUCT_INLINE_FIELDS_4 STRUCT_INLINE_FIELDS_4 STRUCT_INLINE_FIELDS_4 STRUCT_INLINE_FIELDS_4
+#undef STRUCT_INLINE_FIELDS_4
+
+	if (state.size < 0 || *state.format != '\0')
+		return (struct_calcsize)(format);
+	return state.size;
+}
+
+#endif /* STRUCT_INLINE_H_ */
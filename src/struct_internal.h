@@ -0,0 +1,163 @@
+/**
+ * struct_internal.h
+ * Helpers shared between 'struct' modules, not part of public interface.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STRUCT_INTERNAL_H_
+#define STRUCT_INTERNAL_H_
+
+#include <endian.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <tmmintrin.h>
+
+/**
+ * Compile function with SSSE3 instructions regardless of build flags
+ * Such functions are called only when struct_has_ssse3() is true.
+ */
+#define STRUCT_TARGET_SSSE3		__attribute__((target("ssse3")))
+#endif
+
+/**
+ * Load unsigned integer of any size up to 64 bits
+ * @param p Data source
+ * @param size Size of value in bytes
+ * @param byte_order Byte order of value
+ * @return Loaded value
+ */
+static inline uint64_t struct_load_uint(const void *p, size_t size, int byte_order)
+{
+	const uint8_t *p8 = p;
+	uint64_t result = 0;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+	{
+		result <<= 8;
+		if (byte_order == __BIG_ENDIAN)
+			result |= p8[i];
+		else
+			result |= p8[size - i - 1];
+	}
+	return result;
+}
+
+/**
+ * Store unsigned integer of any size up to 64 bits
+ * @param p Data destination
+ * @param size Size of value in bytes
+ * @param byte_order Byte order of value
+ * @param v Value to store
+ */
+static inline void struct_store_uint(void *p, size_t size, int byte_order, uint64_t v)
+{
+	uint8_t *p8 = p;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+	{
+		if (byte_order == __BIG_ENDIAN)
+			p8[size - i - 1] = v & 0xff;
+		else
+			p8[i] = v & 0xff;
+		v >>= 8;
+	}
+}
+
+/**
+ * Check if format character describes signed integer
+ * @param format Format character
+ * @return Non-zero for signed integer types
+ */
+static inline int struct_format_signed(char format)
+{
+	return format == 'b' || format == 'h' || format == 'i' || format == 'l' || format == 'q';
+}
+
+/**
+ * Extend loaded value of signed integer type to 64 bits
+ * @param v Loaded value
+ * @param size Size of value in bytes
+ * @return Sign extended value
+ */
+static inline int64_t struct_sign_extend(uint64_t v, size_t size)
+{
+	unsigned shift = 64 - 8 * size;
+
+	return (int64_t) (v << shift) >> shift;
+}
+
+#ifdef STRUCT_TARGET_SSSE3
+/**
+ * Check at run time if CPU supports SSSE3 instructions
+ */
+static inline int struct_has_ssse3(void)
+{
+#ifdef __SSSE3__
+	return 1;
+#else
+	return __builtin_cpu_supports("ssse3");
+#endif
+}
+#endif
+
+/**
+ * Pack array of boolean values to bitset, least significant bit first
+ * @param dst Bitset destination of (count + 7) / 8 bytes, unused bits are zeroed
+ * @param src Boolean values
+ * @param count Count of values
+ */
+static inline void struct_bits_from_bool(void *dst, const void *src, size_t count)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	size_t i = 0;
+
+#ifdef __SSE2__
+	for (; i + 16 <= count; i += 16, s += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *) s);
+		unsigned mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+		*d++ = mask;
+		*d++ = mask >> 8;
+	}
+#endif
+	for (; i + 8 <= count; i += 8, s += 8)
+		*d++ = (s[0] != 0) | (s[1] != 0) << 1 | (s[2] != 0) << 2 | (s[3] != 0) << 3 |
+				(s[4] != 0) << 4 | (s[5] != 0) << 5 | (s[6] != 0) << 6 | (s[7] != 0) << 7;
+	if (i < count)
+	{
+		uint8_t byte = 0;
+		size_t bit;
+
+		for (bit = 0; i < count; i++, bit++)
+			byte |= (s[bit] != 0) << bit;
+		*d = byte;
+	}
+}
+
+#endif /* STRUCT_INTERNAL_H_ */
@@ -0,0 +1,485 @@
+/**
+ * struct_proto.c
+ * Protocol buffers wire encoding of packed records.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "struct_proto.h"
+#include "struct_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Private Definitions
+//
+
+/** Wire types of protocol buffers */
+#define STRUCT_PROTO_VARINT		0
+#define STRUCT_PROTO_FIXED64	1
+#define STRUCT_PROTO_BYTES		2
+#define STRUCT_PROTO_FIXED32	5
+
+/** Maximal size of varint */
+#define STRUCT_PROTO_VARINT_SIZE	10
+
+/** Count of fields with decoding state on stack, messages with more fields allocate it */
+#define STRUCT_PROTO_STACK_FIELDS	32
+
+/** Maximal message field number */
+#define STRUCT_PROTO_NUMBER_MAX	((1U << 29) - 1)
+
+//
+// Private Types
+//
+
+/** Encoding of single compiled field */
+typedef struct _struct_proto_field
+{
+	uint8_t key[5];		/**< Encoded key of field */
+	uint8_t key_size;
+	uint8_t wire;		/**< Wire type of single value */
+	int packed;			/**< Values are encoded as packed repeated field */
+	char format;
+	unsigned number;
+	size_t offset;
+	size_t repeat;
+	size_t size;
+	size_t width;		/**< Size of single value */
+	size_t bound;		/**< Maximal size of encoded field */
+} struct_proto_field;
+
+struct _struct_proto
+{
+	int byte_order;
+	size_t record_size;
+	size_t bound;
+	size_t count;
+	struct_proto_field fields[];
+};
+
+//
+// Private Services
+//
+
+static inline size_t struct_proto_varint_size(uint64_t v)
+{
+	size_t result = 1;
+
+	while (v >= 0x80)
+	{
+		v >>= 7;
+		result++;
+	}
+	return result;
+}
+
+static inline uint8_t *struct_proto_put_varint(uint8_t *p, uint64_t v)
+{
+	while (v >= 0x80)
+	{
+		*p++ = (uint8_t) v | 0x80;
+		v >>= 7;
+	}
+	*p++ = (uint8_t) v;
+	return p;
+}
+
+/**
+ * Read varint
+ * @param p Data source
+ * @param end End of data
+ * @param v Returning value
+ * @return Pointer after varint or NULL when malformed
+ */
+static inline const uint8_t *struct_proto_get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+	uint64_t result = 0;
+	unsigned shift;
+
+	for (shift = 0; p < end && shift < 7 * STRUCT_PROTO_VARINT_SIZE; shift += 7)
+	{
+		result |= (uint64_t) (*p & 0x7f) << shift;
+		if (*p++ < 0x80)
+		{
+			*v = result;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Load value of field from packed record as value of varint or fixed wire type
+ */
+static inline uint64_t struct_proto_load(const struct_proto *proto, const struct_proto_field *f,
+		const uint8_t *record, size_t i)
+{
+	uint64_t v = struct_load_uint(record + f->offset + i * f->width, f->width, proto->byte_order);
+
+	if (f->format == '?')
+		return v != 0;
+	if (struct_format_signed(f->format))
+		return (uint64_t) struct_sign_extend(v, f->width);
+	return v;
+}
+
+/**
+ * Store single value to field of packed record
+ */
+static inline void struct_proto_store(const struct_proto *proto, const struct_proto_field *f,
+		uint8_t *record, size_t i, uint64_t v)
+{
+	if (f->format == '?')
+		v = v != 0;
+	struct_store_uint(record + f->offset + i * f->width, f->width, proto->byte_order, v);
+}
+
+/**
+ * Calculate size of encoded single value
+ */
+static inline size_t struct_proto_value_size(const struct_proto_field *f, uint64_t v)
+{
+	return f->wire == STRUCT_PROTO_VARINT ? struct_proto_varint_size(v) : f->width;
+}
+
+static inline uint8_t *struct_proto_put_value(uint8_t *p, const struct_proto_field *f, uint64_t v)
+{
+	if (f->wire == STRUCT_PROTO_VARINT)
+		return struct_proto_put_varint(p, v);
+
+	struct_store_uint(p, f->width, __LITTLE_ENDIAN, v);
+	return p + f->width;
+}
+
+/**
+ * Read single value of field
+ * @return Pointer after value or NULL when malformed
+ */
+static inline const uint8_t *struct_proto_get_value(const uint8_t *p, const uint8_t *end,
+		const struct_proto_field *f, uint64_t *v)
+{
+	if (f->wire == STRUCT_PROTO_VARINT)
+		return struct_proto_get_varint(p, end, v);
+
+	if ((size_t) (end - p) < f->width)
+		return NULL;
+	*v = struct_load_uint(p, f->width, __LITTLE_ENDIAN);
+	return p + f->width;
+}
+
+/**
+ * Skip value of unknown field
+ * @return Pointer after value or NULL when malformed
+ */
+static const uint8_t *struct_proto_skip(const uint8_t *p, const uint8_t *end, unsigned wire)
+{
+	uint64_t v;
+
+	switch (wire)
+	{
+	case STRUCT_PROTO_VARINT:
+		return struct_proto_get_varint(p, end, &v);
+	case STRUCT_PROTO_FIXED64:
+		return end - p >= 8 ? p + 8 : NULL;
+	case STRUCT_PROTO_FIXED32:
+		return end - p >= 4 ? p + 4 : NULL;
+	case STRUCT_PROTO_BYTES:
+		p = struct_proto_get_varint(p, end, &v);
+		return p != NULL && v <= (uint64_t) (end - p) ? p + v : NULL;
+	default:
+		// groups are deprecated and not supported
+		return NULL;
+	}
+}
+
+//
+// Public Services
+//
+
+struct_proto *struct_proto_create(const struct_format *format, const unsigned *numbers)
+{
+	struct_proto *result;
+	size_t i, j, count = 0;
+
+	if (format == NULL || numbers == NULL)
+		return NULL;
+
+	for (i = 0; i < format->count; i++)
+	{
+		if (numbers[i] == 0 || format->fields[i].format == 'x' || format->fields[i].repeat == 0)
+			continue;
+		if (numbers[i] > STRUCT_PROTO_NUMBER_MAX)
+			return NULL;
+		for (j = 0; j < i; j++)
+			if (numbers[j] == numbers[i])
+				return NULL;
+		count++;
+	}
+
+	result = malloc(sizeof(*result) + count * sizeof(result->fields[0]));
+	if (result == NULL)
+		return NULL;
+
+	result->byte_order = format->byte_order;
+	result->record_size = format->size;
+	result->bound = 0;
+	result->count = count;
+
+	for (i = 0, j = 0; i < format->count; i++)
+	{
+		const struct_field *field = &format->fields[i];
+		struct_proto_field *f = &result->fields[j];
+		size_t value_bound;
+		unsigned wire;
+
+		if (numbers[i] == 0 || field->format == 'x' || field->repeat == 0)
+			continue;
+
+		f->format = field->format;
+		f->number = numbers[i];
+		f->offset = field->offset;
+		f->repeat = field->repeat;
+		f->size = field->size;
+		f->width = field->size / field->repeat;
+		f->packed = field->repeat > 1 && field->format != 's' && field->format != 'T';
+
+		switch (field->format)
+		{
+		case 'f':
+			f->wire = STRUCT_PROTO_FIXED32;
+			value_bound = f->width;
+			break;
+		case 'd':
+			f->wire = STRUCT_PROTO_FIXED64;
+			value_bound = f->width;
+			break;
+		case 's':
+		case 'T':
+			f->wire = STRUCT_PROTO_BYTES;
+			f->width = f->size;
+			value_bound = struct_proto_varint_size(f->size) + f->size;
+			break;
+		default:
+			// negative values of signed integers are always sign extended to 64 bits
+			f->wire = STRUCT_PROTO_VARINT;
+			value_bound = struct_format_signed(field->format) ? STRUCT_PROTO_VARINT_SIZE :
+					(f->width * 8 + 6) / 7;
+			break;
+		}
+
+		wire = f->packed ? STRUCT_PROTO_BYTES : f->wire;
+		f->key_size = struct_proto_put_varint(f->key, (uint64_t) f->number << 3 | wire) - f->key;
+		if (f->packed)
+			f->bound = f->key_size + STRUCT_PROTO_VARINT_SIZE + f->repeat * value_bound;
+		else
+			f->bound = f->key_size + value_bound;
+
+		result->bound += f->bound;
+		j++;
+	}
+
+	return result;
+}
+
+void struct_proto_free(struct_proto *proto)
+{
+	free(proto);
+}
+
+ssize_t struct_proto_bound(const struct_proto *proto)
+{
+	if (proto == NULL)
+		return -1;
+	return proto->bound;
+}
+
+ssize_t struct_proto_encode(void *buffer, size_t size, const struct_proto *proto, const void *record)
+{
+	uint8_t *p = buffer;
+	uint8_t *end = p + size;
+	const uint8_t *r = record;
+	size_t i, n;
+
+	if (buffer == NULL || proto == NULL || record == NULL)
+		return -1;
+
+	for (i = 0; i < proto->count; i++)
+	{
+		const struct_proto_field *f = &proto->fields[i];
+		size_t length;
+		uint64_t v;
+
+		if (f->wire == STRUCT_PROTO_BYTES)
+		{
+			length = f->format == 's' ? strnlen((const char *) r + f->offset, f->size) : f->size;
+			if (length == 0)
+				continue;
+			if ((size_t) (end - p) < f->key_size + struct_proto_varint_size(length) + length)
+				return -1;
+			memcpy(p, f->key, f->key_size);
+			p = struct_proto_put_varint(p + f->key_size, length);
+			memcpy(p, r + f->offset, length);
+			p += length;
+			continue;
+		}
+
+		if (!f->packed)
+		{
+			v = struct_proto_load(proto, f, r, 0);
+			if (v == 0)
+				continue;
+			// exact size is calculated only when maximal size does not fit
+			if ((size_t) (end - p) < f->bound &&
+					(size_t) (end - p) < f->key_size + struct_proto_value_size(f, v))
+				return -1;
+			memcpy(p, f->key, f->key_size);
+			p = struct_proto_put_value(p + f->key_size, f, v);
+			continue;
+		}
+
+		if (f->wire == STRUCT_PROTO_VARINT)
+			for (n = 0, length = 0; n < f->repeat; n++)
+				length += struct_proto_varint_size(struct_proto_load(proto, f, r, n));
+		else
+			length = f->size;
+
+		if ((size_t) (end - p) < f->key_size + struct_proto_varint_size(length) + length)
+			return -1;
+		memcpy(p, f->key, f->key_size);
+		p = struct_proto_put_varint(p + f->key_size, length);
+		for (n = 0; n < f->repeat; n++)
+			p = struct_proto_put_value(p, f, struct_proto_load(proto, f, r, n));
+	}
+
+	return p - (uint8_t *) buffer;
+}
+
+ssize_t struct_proto_decode(void *record, size_t size, const struct_proto *proto,
+		const void *buffer, size_t buffer_size)
+{
+	const uint8_t *p = buffer;
+	const uint8_t *end = p + buffer_size;
+	uint8_t *r = record;
+	size_t stack[STRUCT_PROTO_STACK_FIELDS];
+	size_t *filled = stack;
+	ssize_t result = -1;
+	size_t i = 0;
+
+	if (record == NULL || proto == NULL || buffer == NULL || size < proto->record_size)
+		return -1;
+
+	// elements of repeated field may be interleaved with other fields, so each field counts its own
+	if (proto->count > STRUCT_PROTO_STACK_FIELDS)
+	{
+		filled = malloc(proto->count * sizeof(filled[0]));
+		if (filled == NULL)
+			return -1;
+	}
+	memset(filled, 0, proto->count * sizeof(filled[0]));
+	memset(record, 0, proto->record_size);
+
+	while (p < end)
+	{
+		const struct_proto_field *f = NULL;
+		unsigned wire;
+		uint64_t key, v;
+		size_t n;
+
+		p = struct_proto_get_varint(p, end, &key);
+		if (p == NULL)
+			goto out;
+		wire = key & 7;
+
+		// fields usually follow in order of format, so search starts from previous one
+		for (n = 0; n < proto->count; n++, i++)
+		{
+			if (i >= proto->count)
+				i = 0;
+			if (proto->fields[i].number == key >> 3)
+			{
+				f = &proto->fields[i];
+				break;
+			}
+		}
+
+		if (f == NULL)
+		{
+			p = struct_proto_skip(p, end, wire);
+			if (p == NULL)
+				goto out;
+			continue;
+		}
+
+		// last value of singular field wins
+		if (f->repeat == 1)
+			filled[i] = 0;
+
+		if (wire == f->wire && f->wire == STRUCT_PROTO_BYTES)
+		{
+			p = struct_proto_get_varint(p, end, &v);
+			if (p == NULL || v > (uint64_t) (end - p) || v > f->size)
+				goto out;
+			memset(r + f->offset, 0, f->size);
+			memcpy(r + f->offset, p, v);
+			p += v;
+		}
+		else if (wire == f->wire)
+		{
+			if (filled[i] >= f->repeat)
+				goto out;
+			p = struct_proto_get_value(p, end, f, &v);
+			if (p == NULL)
+				goto out;
+			struct_proto_store(proto, f, r, filled[i]++, v);
+		}
+		else if (wire == STRUCT_PROTO_BYTES)
+		{
+			const uint8_t *packed_end;
+
+			p = struct_proto_get_varint(p, end, &v);
+			if (p == NULL || v > (uint64_t) (end - p))
+				goto out;
+			for (packed_end = p + v; p < packed_end; )
+			{
+				uint64_t value;
+
+				if (filled[i] >= f->repeat)
+					goto out;
+				p = struct_proto_get_value(p, packed_end, f, &value);
+				if (p == NULL)
+					goto out;
+				struct_proto_store(proto, f, r, filled[i]++, value);
+			}
+		}
+		else
+		{
+			goto out;
+		}
+	}
+	result = proto->record_size;
+
+out:
+	if (filled != stack)
+		free(filled);
+	return result;
+}
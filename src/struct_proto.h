@@ -0,0 +1,92 @@
+/**
+ * struct_proto.h
+ * Protocol buffers wire encoding of packed records.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STRUCT_PROTO_H_
+#define STRUCT_PROTO_H_
+
+#include "struct.h"
+
+//
+// Public Types
+//
+
+/** Mapping of compiled format fields to protocol buffers message fields */
+typedef struct _struct_proto struct_proto;
+
+//
+// Public Services
+//
+
+/**
+ * Create mapping of compiled format to protocol buffers message
+ * Signed integers are encoded as int32/int64, unsigned integers and 'c' as
+ * uint32/uint64, '?' as bool, 'f' as float, 'd' as double, 's' as string
+ * and 'T' as bytes of bitset. Repeated numeric fields are encoded packed.
+ * @param format Compiled format of records, must be valid while mapping is used
+ * @param numbers Message field number for each compiled field, 0 to skip field
+ * @return Mapping or NULL when failed, must be freed by struct_proto_free()
+ */
+struct_proto *struct_proto_create(const struct_format *format, const unsigned *numbers);
+
+/**
+ * Free mapping created by struct_proto_create()
+ * @param proto Mapping
+ */
+void struct_proto_free(struct_proto *proto);
+
+/**
+ * Calculate maximal size of encoded message
+ * @param proto Mapping
+ * @return Maximal message size or negative when failed
+ */
+ssize_t struct_proto_bound(const struct_proto *proto);
+
+/**
+ * Encode packed record to protocol buffers message
+ * Single value fields with zero value are omitted like proto3 encoders do.
+ * @param buffer Destination buffer
+ * @param size Size of destination buffer
+ * @param proto Mapping
+ * @param record Packed record
+ * @return Size of message or negative when failed
+ */
+ssize_t struct_proto_encode(void *buffer, size_t size, const struct_proto *proto, const void *record);
+
+/**
+ * Decode protocol buffers message to packed record
+ * Missing fields are filled by zeros, unknown fields are skipped, repeated
+ * fields are accepted both packed and unpacked.
+ * @param record Destination buffer for packed record
+ * @param size Size of destination buffer
+ * @param proto Mapping
+ * @param buffer Message
+ * @param buffer_size Size of message
+ * @return Size of packed record or negative when failed
+ */
+ssize_t struct_proto_decode(void *record, size_t size, const struct_proto *proto,
+		const void *buffer, size_t buffer_size);
+
+#endif /* STRUCT_PROTO_H_ */
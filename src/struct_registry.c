@@ -0,0 +1,550 @@
+/**
+ * struct_registry.c
+ * Registry of many formats in compact compiled representation.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "struct_registry.h"
+#include <endian.h>
+#include <string.h>
+
+//
+// Private Definitions
+//
+
+/** Count of ops of entry kept as compiled format */
+#define STRUCT_REGISTRY_WIDE		UINT16_MAX
+
+/** Initial capacity of registry arrays */
+#define STRUCT_REGISTRY_CAPACITY	16
+
+//
+// Private Types
+//
+
+/** Run of equal consecutive fields or link to shared suffix */
+typedef struct _struct_registry_op
+{
+	char format;		/**< Format character, zero for link with pool index in repeat and run */
+	uint8_t layout;		/**< Alignment padding before each field in high nibble, value width in low nibble */
+	uint16_t repeat;	/**< Repeat count of each field */
+	uint16_t run;		/**< Count of fields */
+} struct_registry_op;
+
+/** Registered format */
+typedef struct _struct_registry_entry
+{
+	uint32_t ops;		/**< Index of first op in pool or of compiled format */
+	uint16_t count;		/**< Count of ops or STRUCT_REGISTRY_WIDE for compiled format */
+	uint16_t big;		/**< Non-zero for big endian byte order */
+	uint32_t size;		/**< Size of record */
+} struct_registry_entry;
+
+/** Slot of hash table of interned op sequences, free when count is zero */
+typedef struct _struct_registry_slot
+{
+	uint32_t ops;		/**< Index of first op in pool */
+	uint32_t count;		/**< Count of ops */
+} struct_registry_slot;
+
+struct _struct_registry
+{
+	size_t count;					/**< Count of formats */
+	size_t capacity;				/**< Capacity of entries */
+	struct_registry_entry *entries;
+	size_t pool_count;				/**< Count of ops in pool */
+	size_t pool_capacity;			/**< Capacity of pool */
+	struct_registry_op *pool;		/**< Interned op sequences */
+	size_t mask;					/**< Count of hash slots minus one */
+	size_t used;					/**< Count of used hash slots */
+	struct_registry_slot *slots;
+	size_t wide_count;				/**< Count of compiled formats */
+	struct_format **wide;			/**< Formats not fitting compact representation */
+	size_t wide_memory;				/**< Size of compiled formats */
+	size_t compiled_count;			/**< Count of formats which may have kept compiled format */
+	struct_format **compiled;		/**< Expanded formats kept by struct_registry_compiled() */
+	size_t compiled_memory;			/**< Size of kept expanded formats */
+};
+
+//
+// Private Services
+//
+
+/**
+ * Grow array to hold at least required count of elements
+ * @return Zero on success or negative when failed
+ */
+static int struct_registry_reserve(void **array, size_t *capacity, size_t required, size_t element)
+{
+	size_t size = *capacity > 0 ? *capacity : STRUCT_REGISTRY_CAPACITY;
+	void *result;
+
+	if (required <= *capacity)
+		return 0;
+	while (size < required)
+		size *= 2;
+
+	result = realloc(*array, size * element);
+	if (result == NULL)
+		return -1;
+
+	*array = result;
+	*capacity = size;
+	return 0;
+}
+
+/**
+ * Get op of interned sequence following link to shared suffix
+ * @param registry Registry
+ * @param pos Position of op in pool, advanced to next op
+ * @return Op
+ */
+static inline const struct_registry_op *struct_registry_next(const struct_registry *registry, uint32_t *pos)
+{
+	const struct_registry_op *op = &registry->pool[*pos];
+
+	if (op->format == '\0')
+	{
+		*pos = op->repeat | (uint32_t) op->run << 16;
+		op = &registry->pool[*pos];
+	}
+	(*pos)++;
+	return op;
+}
+
+/**
+ * Hash op sequence from last op to first, so hashes of all suffixes are calculated on the way
+ * @param ops Op sequence
+ * @param count Count of ops
+ * @param hashes Destination for hash of each suffix, may be NULL
+ * @return Hash of whole sequence
+ */
+static uint64_t struct_registry_hash(const struct_registry_op *ops, size_t count, uint64_t *hashes)
+{
+	uint64_t h = 0;
+	size_t i;
+
+	for (i = count; i-- > 0;)
+	{
+		uint64_t v = 0;
+
+		memcpy(&v, &ops[i], sizeof(ops[i]));
+		h = (h ^ v) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+		if (hashes != NULL)
+			hashes[i] = h;
+	}
+	return h;
+}
+
+/**
+ * Find interned op sequence
+ * @return Slot of sequence or free slot where it should be stored
+ */
+static struct_registry_slot *struct_registry_find(const struct_registry *registry,
+		const struct_registry_op *ops, size_t count, uint64_t hash)
+{
+	size_t slot = hash & registry->mask;
+
+	for (;; slot = (slot + 1) & registry->mask)
+	{
+		struct_registry_slot *s = &registry->slots[slot];
+		uint32_t pos = s->ops;
+		size_t i;
+
+		if (s->count == 0)
+			return s;
+		if (s->count != count)
+			continue;
+
+		for (i = 0; i < count && memcmp(struct_registry_next(registry, &pos), &ops[i], sizeof(ops[i])) == 0; i++);
+		if (i == count)
+			return s;
+	}
+}
+
+/**
+ * Double hash table of interned sequences
+ * @return Zero on success or negative when failed
+ */
+static int struct_registry_rehash(struct_registry *registry)
+{
+	struct_registry_slot *old = registry->slots;
+	size_t old_slots = registry->mask + 1;
+	struct_registry_op *ops;
+	size_t i, n;
+
+	// sequences are copied without links to be hashed
+	ops = malloc(registry->pool_count * sizeof(ops[0]) + 1);
+	registry->slots = calloc(2 * old_slots, sizeof(registry->slots[0]));
+	if (ops == NULL || registry->slots == NULL)
+	{
+		free(ops);
+		free(registry->slots);
+		registry->slots = old;
+		return -1;
+	}
+	registry->mask = 2 * old_slots - 1;
+
+	for (i = 0; i < old_slots; i++)
+	{
+		uint32_t pos = old[i].ops;
+
+		if (old[i].count == 0)
+			continue;
+		for (n = 0; n < old[i].count; n++)
+			ops[n] = *struct_registry_next(registry, &pos);
+		*struct_registry_find(registry, ops, old[i].count, struct_registry_hash(ops, old[i].count, NULL)) = old[i];
+	}
+
+	free(ops);
+	free(old);
+	return 0;
+}
+
+/**
+ * Convert compiled format to op sequence
+ * @param ops Destination for format->count ops
+ * @return Count of ops or negative when format does not fit compact representation
+ */
+static ssize_t struct_registry_ops(struct_registry_op *ops, const struct_format *format)
+{
+	size_t end = 0;
+	size_t count = 0;
+	size_t i;
+
+	if (format->size > UINT32_MAX)
+		return -1;
+
+	for (i = 0; i < format->count; i++)
+	{
+		const struct_field *f = &format->fields[i];
+		size_t padding = f->offset - end;
+		size_t width = f->format == 'T' ? 1 : (f->repeat > 0 ? f->size / f->repeat : 0);
+		struct_registry_op op;
+
+		if (f->repeat > UINT16_MAX || padding > 0x0f || width > 0x0f)
+			return -1;
+
+		memset(&op, 0, sizeof(op));
+		op.format = f->format;
+		op.layout = padding << 4 | width;
+		op.repeat = f->repeat;
+		end = f->offset + f->size;
+
+		// equal fields extend previous run
+		if (count > 0 && ops[count - 1].format == op.format && ops[count - 1].layout == op.layout &&
+				ops[count - 1].repeat == op.repeat && ops[count - 1].run < UINT16_MAX)
+		{
+			ops[count - 1].run++;
+			continue;
+		}
+
+		op.run = 1;
+		ops[count++] = op;
+	}
+
+	return count < STRUCT_REGISTRY_WIDE ? (ssize_t) count : -1;
+}
+
+/**
+ * Intern op sequence with all its suffixes
+ * Only ops before longest already interned suffix are stored, followed by
+ * link to the suffix.
+ * @return Index of first op in pool or negative when failed
+ */
+static ssize_t struct_registry_intern(struct_registry *registry, const struct_registry_op *ops, size_t count)
+{
+	struct_registry_slot *slot;
+	uint64_t *hashes;
+	ssize_t result = -1;
+	size_t pos, shared, i;
+
+	if (count == 0)
+		return 0;
+
+	hashes = malloc(count * sizeof(hashes[0]));
+	if (hashes == NULL)
+		return -1;
+	struct_registry_hash(ops, count, hashes);
+
+	for (shared = 0; shared < count; shared++)
+	{
+		slot = struct_registry_find(registry, &ops[shared], count - shared, hashes[shared]);
+		if (slot->count > 0)
+			break;
+	}
+	if (shared == 0)
+	{
+		result = slot->ops;
+		goto out;
+	}
+
+	if (registry->pool_count + shared + 1 > UINT32_MAX ||
+			struct_registry_reserve((void **) &registry->pool, &registry->pool_capacity,
+					registry->pool_count + shared + 1, sizeof(registry->pool[0])) < 0)
+		goto out;
+
+	pos = registry->pool_count;
+	memcpy(&registry->pool[pos], ops, shared * sizeof(ops[0]));
+	registry->pool_count += shared;
+	if (shared < count)
+	{
+		struct_registry_op *link = &registry->pool[registry->pool_count++];
+
+		memset(link, 0, sizeof(*link));
+		link->repeat = slot->ops & 0xffff;
+		link->run = slot->ops >> 16;
+	}
+
+	for (i = 0; i < shared; i++)
+	{
+		// table is kept at most half full
+		if (2 * (registry->used + 1) > registry->mask + 1 && struct_registry_rehash(registry) < 0)
+			goto out;
+
+		slot = struct_registry_find(registry, &registry->pool[pos + i], count - i, hashes[i]);
+		if (slot->count > 0)
+			continue;
+		slot->ops = pos + i;
+		slot->count = count - i;
+		registry->used++;
+	}
+	result = pos;
+
+out:
+	free(hashes);
+	return result;
+}
+
+//
+// Public Services
+//
+
+struct_registry *struct_registry_create(void)
+{
+	struct_registry *registry = calloc(1, sizeof(*registry));
+
+	if (registry == NULL)
+		return NULL;
+
+	registry->mask = STRUCT_REGISTRY_CAPACITY - 1;
+	registry->slots = calloc(STRUCT_REGISTRY_CAPACITY, sizeof(registry->slots[0]));
+	if (registry->slots == NULL)
+	{
+		free(registry);
+		return NULL;
+	}
+
+	return registry;
+}
+
+void struct_registry_free(struct_registry *registry)
+{
+	size_t i;
+
+	if (registry == NULL)
+		return;
+
+	for (i = 0; i < registry->compiled_count; i++)
+		struct_free(registry->compiled[i]);
+	free(registry->compiled);
+	for (i = 0; i < registry->wide_count; i++)
+		struct_free(registry->wide[i]);
+	free(registry->wide);
+	free(registry->slots);
+	free(registry->pool);
+	free(registry->entries);
+	free(registry);
+}
+
+ssize_t struct_registry_add(struct_registry *registry, const char *format)
+{
+	struct_format *compiled;
+	struct_registry_op *ops = NULL;
+	struct_registry_entry entry;
+	ssize_t count, pos;
+	ssize_t result = -1;
+
+	if (registry == NULL || registry->count >= UINT32_MAX ||
+			struct_registry_reserve((void **) &registry->entries, &registry->capacity,
+					registry->count + 1, sizeof(registry->entries[0])) < 0)
+		return -1;
+
+	compiled = struct_compile(format);
+	if (compiled == NULL)
+		return -1;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.big = compiled->byte_order == __BIG_ENDIAN;
+
+	ops = malloc(compiled->count * sizeof(ops[0]) + 1);
+	if (ops == NULL)
+		goto out;
+
+	count = struct_registry_ops(ops, compiled);
+	if (count >= 0)
+	{
+		pos = struct_registry_intern(registry, ops, count);
+		if (pos < 0)
+			goto out;
+		entry.ops = pos;
+		entry.count = count;
+		entry.size = compiled->size;
+	}
+	else
+	{
+		struct_format **wide = realloc(registry->wide, (registry->wide_count + 1) * sizeof(wide[0]));
+		if (wide == NULL)
+			goto out;
+		registry->wide = wide;
+
+		entry.ops = registry->wide_count;
+		entry.count = STRUCT_REGISTRY_WIDE;
+		registry->wide_memory += sizeof(*compiled) + compiled->count * sizeof(compiled->fields[0]);
+		registry->wide[registry->wide_count++] = compiled;
+		compiled = NULL;
+	}
+
+	registry->entries[registry->count] = entry;
+	result = registry->count++;
+
+out:
+	free(ops);
+	struct_free(compiled);
+	return result;
+}
+
+ssize_t struct_registry_size(const struct_registry *registry, size_t id)
+{
+	if (registry == NULL || id >= registry->count)
+		return -1;
+	if (registry->entries[id].count == STRUCT_REGISTRY_WIDE)
+		return registry->wide[registry->entries[id].ops]->size;
+	return registry->entries[id].size;
+}
+
+struct_format *struct_registry_format(const struct_registry *registry, size_t id)
+{
+	const struct_registry_entry *entry;
+	struct_format *result;
+	size_t count = 0, offset = 0;
+	size_t i, r;
+	uint32_t pos;
+
+	if (registry == NULL || id >= registry->count)
+		return NULL;
+
+	entry = &registry->entries[id];
+	if (entry->count == STRUCT_REGISTRY_WIDE)
+	{
+		const struct_format *wide = registry->wide[entry->ops];
+		size_t size = sizeof(*wide) + wide->count * sizeof(wide->fields[0]);
+
+		result = malloc(size);
+		if (result != NULL)
+			memcpy(result, wide, size);
+		return result;
+	}
+
+	for (i = 0, pos = entry->ops; i < entry->count; i++)
+		count += struct_registry_next(registry, &pos)->run;
+
+	result = malloc(sizeof(*result) + count * sizeof(result->fields[0]));
+	if (result == NULL)
+		return NULL;
+
+	result->byte_order = entry->big ? __BIG_ENDIAN : __LITTLE_ENDIAN;
+	result->size = entry->size;
+	result->count = count;
+	result->strategy = STRUCT_STRATEGY_COLUMNS;
+	result->block = 0;
+	result->prefetch = 0;
+
+	for (i = 0, count = 0, pos = entry->ops; i < entry->count; i++)
+	{
+		const struct_registry_op *op = struct_registry_next(registry, &pos);
+		size_t width = op->layout & 0x0f;
+
+		for (r = 0; r < op->run; r++)
+		{
+			struct_field *f = &result->fields[count++];
+
+			offset += op->layout >> 4;
+			f->format = op->format;
+			f->repeat = op->repeat;
+			f->offset = offset;
+			f->size = op->format == 'T' ? (op->repeat + 7) / 8u : op->repeat * width;
+			offset += f->size;
+		}
+	}
+
+	return result;
+}
+
+const struct_format *struct_registry_compiled(struct_registry *registry, size_t id)
+{
+	struct_format *result;
+
+	if (registry == NULL || id >= registry->count)
+		return NULL;
+
+	// formats kept compiled are not expanded
+	if (registry->entries[id].count == STRUCT_REGISTRY_WIDE)
+		return registry->wide[registry->entries[id].ops];
+
+	if (id < registry->compiled_count && registry->compiled[id] != NULL)
+		return registry->compiled[id];
+
+	if (id >= registry->compiled_count)
+	{
+		struct_format **compiled = realloc(registry->compiled, registry->count * sizeof(compiled[0]));
+		if (compiled == NULL)
+			return NULL;
+
+		memset(&compiled[registry->compiled_count], 0,
+				(registry->count - registry->compiled_count) * sizeof(compiled[0]));
+		registry->compiled = compiled;
+		registry->compiled_count = registry->count;
+	}
+
+	result = struct_registry_format(registry, id);
+	if (result == NULL)
+		return NULL;
+
+	registry->compiled_memory += sizeof(*result) + result->count * sizeof(result->fields[0]);
+	registry->compiled[id] = result;
+	return result;
+}
+
+size_t struct_registry_memory(const struct_registry *registry)
+{
+	if (registry == NULL)
+		return 0;
+
+	return sizeof(*registry) + registry->capacity * sizeof(registry->entries[0]) +
+			registry->pool_capacity * sizeof(registry->pool[0]) +
+			(registry->mask + 1) * sizeof(registry->slots[0]) +
+			registry->wide_count * sizeof(registry->wide[0]) + registry->wide_memory +
+			registry->compiled_count * sizeof(registry->compiled[0]) + registry->compiled_memory;
+}
@@ -0,0 +1,105 @@
+/**
+ * struct_registry.h
+ * Registry of many formats in compact compiled representation.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STRUCT_REGISTRY_H_
+#define STRUCT_REGISTRY_H_
+
+#include "struct.h"
+
+//
+// Public Types
+//
+
+/** Registry of compiled formats */
+typedef struct _struct_registry struct_registry;
+
+//
+// Public Services
+//
+
+/**
+ * Create empty registry
+ * Formats are kept as runs of equal fields with 16-bit repeat counts and
+ * alignment padding instead of offsets, so equal runs of different formats
+ * are the same. Sequences of runs are interned with all their suffixes and
+ * shared by formats which end with the same fields. Formats which do not
+ * fit compact representation are kept compiled.
+ * @return Registry or NULL when failed, must be released by struct_registry_free()
+ */
+struct_registry *struct_registry_create(void);
+
+/**
+ * Release registry
+ * @param registry Registry, may be NULL
+ */
+void struct_registry_free(struct_registry *registry);
+
+/**
+ * Add format to registry
+ * @param registry Registry
+ * @param format Format pattern string
+ * @return Number of format in registry or negative when failed
+ */
+ssize_t struct_registry_add(struct_registry *registry, const char *format);
+
+/**
+ * Get size of record of registered format
+ * @param registry Registry
+ * @param id Number of format in registry
+ * @return Size of record or negative when failed
+ */
+ssize_t struct_registry_size(const struct_registry *registry, size_t id);
+
+/**
+ * Expand registered format to compiled format
+ * Compiled format is allocated and built on each call, formats used for
+ * many records should be kept by caller or taken by struct_registry_compiled().
+ * @param registry Registry
+ * @param id Number of format in registry
+ * @return Compiled format equal to struct_compile() result or NULL when failed,
+ * must be released by struct_free()
+ */
+struct_format *struct_registry_format(const struct_registry *registry, size_t id);
+
+/**
+ * Get compiled format kept by registry
+ * Format is expanded on first use and kept until registry is released, its
+ * size is counted by struct_registry_memory().
+ * @param registry Registry
+ * @param id Number of format in registry
+ * @return Compiled format equal to struct_compile() result or NULL when failed,
+ * must not be released or modified
+ */
+const struct_format *struct_registry_compiled(struct_registry *registry, size_t id);
+
+/**
+ * Get memory used by registry
+ * @param registry Registry
+ * @return Size of all allocations of registry in bytes, including kept compiled formats
+ */
+size_t struct_registry_memory(const struct_registry *registry);
+
+#endif /* STRUCT_REGISTRY_H_ */
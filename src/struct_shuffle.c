@@ -0,0 +1,207 @@
+/**
+ * struct_shuffle.c
+ * Byte plane shuffle of packed records for better compressibility.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "struct_shuffle.h"
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//
+// Private Definitions
+//
+
+/** Count of records and bytes in tile transposed by SIMD registers */
+#define STRUCT_SHUFFLE_TILE		16
+
+//
+// Private Services
+//
+
+/**
+ * Transpose records to byte planes with scalar code
+ * @param dst Byte planes
+ * @param src Records
+ * @param size Size of record
+ * @param count Count of records in whole buffer
+ * @param first Number of first record to transpose
+ */
+static void struct_shuffle_scalar(uint8_t *dst, const uint8_t *src, size_t size, size_t count, size_t first)
+{
+	size_t i, j;
+
+	for (i = first; i < count; i++)
+		for (j = 0; j < size; j++)
+			dst[j * count + i] = src[i * size + j];
+}
+
+/**
+ * Transpose byte planes to records with scalar code
+ * @see struct_shuffle_scalar()
+ */
+static void struct_unshuffle_scalar(uint8_t *dst, const uint8_t *src, size_t size, size_t count, size_t first)
+{
+	size_t i, j;
+
+	for (i = first; i < count; i++)
+		for (j = 0; j < size; j++)
+			dst[i * size + j] = src[j * count + i];
+}
+
+#ifdef __SSE2__
+
+/**
+ * Transpose 16x16 bytes matrix in registers
+ * Each pass interleaves rows K and K + 8 and moves one bit of column number
+ * to row number, so four passes swap rows and columns.
+ */
+static inline void struct_transpose_16x16(__m128i x[STRUCT_SHUFFLE_TILE])
+{
+	__m128i t[STRUCT_SHUFFLE_TILE];
+	int pass, k;
+
+	for (pass = 0; pass < 4; pass++)
+	{
+		for (k = 0; k < STRUCT_SHUFFLE_TILE / 2; k++)
+		{
+			t[2 * k] = _mm_unpacklo_epi8(x[k], x[k + STRUCT_SHUFFLE_TILE / 2]);
+			t[2 * k + 1] = _mm_unpackhi_epi8(x[k], x[k + STRUCT_SHUFFLE_TILE / 2]);
+		}
+		for (k = 0; k < STRUCT_SHUFFLE_TILE; k++)
+			x[k] = t[k];
+	}
+}
+
+/**
+ * Transpose records to byte planes by tiles of 16 records and 16 bytes
+ * Rows are loaded with 16-byte reads even when record is shorter, tail bytes
+ * belong to following records and are dropped after transpose.
+ * @return Count of transposed records
+ */
+static size_t struct_shuffle_sse2(uint8_t *dst, const uint8_t *src, size_t size, size_t count)
+{
+	__m128i x[STRUCT_SHUFFLE_TILE];
+	size_t total = size * count;
+	size_t i, j, k, planes;
+
+	for (i = 0; i + STRUCT_SHUFFLE_TILE <= count; i += STRUCT_SHUFFLE_TILE)
+	{
+		// last rows of buffer are not readable by full registers
+		if ((i + STRUCT_SHUFFLE_TILE - 1) * size + ((size - 1) & ~(size_t) (STRUCT_SHUFFLE_TILE - 1)) +
+				STRUCT_SHUFFLE_TILE > total)
+			break;
+
+		for (j = 0; j < size; j += STRUCT_SHUFFLE_TILE)
+		{
+			for (k = 0; k < STRUCT_SHUFFLE_TILE; k++)
+				x[k] = _mm_loadu_si128((const __m128i *) &src[(i + k) * size + j]);
+			struct_transpose_16x16(x);
+
+			planes = size - j < STRUCT_SHUFFLE_TILE ? size - j : STRUCT_SHUFFLE_TILE;
+			for (k = 0; k < planes; k++)
+				_mm_storeu_si128((__m128i *) &dst[(j + k) * count + i], x[k]);
+		}
+	}
+
+	return i;
+}
+
+/**
+ * Transpose byte planes to records by tiles of 16 records and 16 bytes
+ * Rows are stored with 16-byte writes even when record is shorter. Writes go
+ * in order of descending columns and ascending rows, so bytes written past
+ * end of record are rewritten with correct values by following stores.
+ * @return Count of transposed records
+ */
+static size_t struct_unshuffle_sse2(uint8_t *dst, const uint8_t *src, size_t size, size_t count)
+{
+	__m128i x[STRUCT_SHUFFLE_TILE];
+	size_t total = size * count;
+	size_t i, j, k, planes;
+	size_t last = (size - 1) & ~(size_t) (STRUCT_SHUFFLE_TILE - 1);
+
+	for (i = 0; i + STRUCT_SHUFFLE_TILE <= count; i += STRUCT_SHUFFLE_TILE)
+	{
+		if ((i + STRUCT_SHUFFLE_TILE - 1) * size + last + STRUCT_SHUFFLE_TILE > total)
+			break;
+
+		for (j = last + STRUCT_SHUFFLE_TILE; j > 0; )
+		{
+			j -= STRUCT_SHUFFLE_TILE;
+			planes = size - j < STRUCT_SHUFFLE_TILE ? size - j : STRUCT_SHUFFLE_TILE;
+			for (k = 0; k < planes; k++)
+				x[k] = _mm_loadu_si128((const __m128i *) &src[(j + k) * count + i]);
+			for (; k < STRUCT_SHUFFLE_TILE; k++)
+				x[k] = _mm_setzero_si128();
+			struct_transpose_16x16(x);
+
+			for (k = 0; k < STRUCT_SHUFFLE_TILE; k++)
+				_mm_storeu_si128((__m128i *) &dst[(i + k) * size + j], x[k]);
+		}
+	}
+
+	return i;
+}
+
+#endif /* __SSE2__ */
+
+//
+// Public Services
+//
+
+ssize_t struct_shuffle(void *dst, const void *src, const struct_format *format, size_t count)
+{
+	size_t first = 0;
+
+	if (dst == NULL || src == NULL || format == NULL)
+		return -1;
+	if (format->size == 0 || count == 0)
+		return 0;
+
+#ifdef __SSE2__
+	first = struct_shuffle_sse2(dst, src, format->size, count);
+#endif
+	struct_shuffle_scalar(dst, src, format->size, count, first);
+
+	return format->size * count;
+}
+
+ssize_t struct_unshuffle(void *dst, const void *src, const struct_format *format, size_t count)
+{
+	size_t first = 0;
+
+	if (dst == NULL || src == NULL || format == NULL)
+		return -1;
+	if (format->size == 0 || count == 0)
+		return 0;
+
+#ifdef __SSE2__
+	first = struct_unshuffle_sse2(dst, src, format->size, count);
+#endif
+	struct_unshuffle_scalar(dst, src, format->size, count, first);
+
+	return format->size * count;
+}
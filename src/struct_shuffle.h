@@ -0,0 +1,59 @@
+/**
+ * struct_shuffle.h
+ * Byte plane shuffle of packed records for better compressibility.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STRUCT_SHUFFLE_H_
+#define STRUCT_SHUFFLE_H_
+
+#include "struct.h"
+
+//
+// Public Services
+//
+
+/**
+ * Transpose records to byte planes
+ * Byte J of record I is stored at offset J * count + I, so bytes at the same
+ * position of consecutive records, like high bytes of counters, are stored
+ * together and compress better by any general purpose compressor.
+ * @param dst Destination buffer of count * format->size bytes, must not overlap source
+ * @param src Packed records
+ * @param format Compiled format of records
+ * @param count Count of records
+ * @return Size of shuffled data or negative when failed
+ */
+ssize_t struct_shuffle(void *dst, const void *src, const struct_format *format, size_t count);
+
+/**
+ * Transpose byte planes back to records
+ * @param dst Destination buffer of count * format->size bytes, must not overlap source
+ * @param src Byte planes produced by struct_shuffle()
+ * @param format Compiled format of records
+ * @param count Count of records
+ * @return Size of unshuffled data or negative when failed
+ */
+ssize_t struct_unshuffle(void *dst, const void *src, const struct_format *format, size_t count);
+
+#endif /* STRUCT_SHUFFLE_H_ */
@@ -0,0 +1,465 @@
+/**
+ * struct_stream.c
+ * Buffered streams of packed records with block compression.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "struct_stream.h"
+#include "struct_internal.h"
+#include "struct_shuffle.h"
+#include <stdarg.h>
+#include <string.h>
+
+//
+// Private Definitions
+//
+
+/** Block data is compressed by codec */
+#define STRUCT_BLOCK_COMPRESSED		0x02
+
+/** Flags known in block header */
+#define STRUCT_BLOCK_FLAGS			(STRUCT_STREAM_SHUFFLE | STRUCT_BLOCK_COMPRESSED)
+
+/** Size of stream header with count of records in block */
+#define STRUCT_STREAM_HEADER_SIZE	sizeof(uint32_t)
+
+/** Count of 32-bit values in block header */
+#define STRUCT_BLOCK_HEADER_VALUES	3
+
+/** Size of block header */
+#define STRUCT_BLOCK_HEADER_SIZE	(STRUCT_BLOCK_HEADER_VALUES * sizeof(uint32_t))
+
+//
+// Private Types
+//
+
+struct _struct_writer
+{
+	FILE *stream;
+	char *format;
+	struct_format *compiled;
+	const struct_codec *codec;
+	unsigned flags;
+	size_t block_records;	/**< Capacity of block in records */
+	size_t block_size;		/**< Capacity of block in bytes */
+	size_t count;			/**< Count of collected records */
+	uint8_t *block;			/**< Collected records */
+	uint8_t *shuffled;		/**< Block transposed to byte planes */
+	uint8_t *compressed;	/**< Compressed block */
+};
+
+struct _struct_reader
+{
+	FILE *stream;
+	char *format;
+	struct_format *compiled;
+	const struct_codec *codec;
+	size_t block_records;	/**< Maximal count of records in block from stream header */
+	size_t count;			/**< Count of records in block */
+	size_t position;		/**< Number of next record in block */
+	size_t block_capacity;	/**< Capacity of block in bytes */
+	size_t shuffled_capacity;	/**< Capacity of shuffled in bytes */
+	size_t compressed_capacity;	/**< Capacity of compressed in bytes */
+	uint8_t *block;			/**< Decoded records */
+	uint8_t *shuffled;		/**< Block transposed to byte planes */
+	uint8_t *compressed;	/**< Block data as read from stream */
+};
+
+//
+// Private Services
+//
+
+static char *struct_stream_strdup(const char *s)
+{
+	size_t length = strlen(s) + 1;
+	char *result = malloc(length);
+
+	if (result != NULL)
+		memcpy(result, s, length);
+	return result;
+}
+
+/**
+ * Allocate block buffer of writer
+ * @param size Size of buffer
+ * @param flags Flags of writer
+ * @return Buffer or NULL when failed
+ */
+static void *struct_writer_alloc(size_t size, unsigned flags)
+{
+	if (flags & STRUCT_STREAM_HUGE_PAGES)
+		return struct_alloc(size, STRUCT_ALLOC_HUGE);
+	return malloc(size);
+}
+
+/**
+ * Release block buffer of writer
+ * @param buffer Buffer, may be NULL
+ * @param size Size of buffer
+ * @param flags Flags of writer
+ */
+static void struct_writer_release(void *buffer, size_t size, unsigned flags)
+{
+	if (flags & STRUCT_STREAM_HUGE_PAGES)
+		struct_alloc_free(buffer, size, STRUCT_ALLOC_HUGE);
+	else
+		free(buffer);
+}
+
+//
+// Public Services
+//
+
+struct_writer *struct_writer_open(FILE *stream, const char *format, size_t block_records,
+		const struct_codec *codec, unsigned flags)
+{
+	uint8_t header[STRUCT_STREAM_HEADER_SIZE];
+	struct_writer *writer;
+
+	if (stream == NULL || format == NULL || block_records == 0 || block_records > UINT32_MAX)
+		return NULL;
+
+	writer = calloc(1, sizeof(*writer));
+	if (writer == NULL)
+		return NULL;
+
+	writer->stream = stream;
+	writer->codec = codec;
+	writer->flags = flags;
+	writer->block_records = block_records;
+	writer->format = struct_stream_strdup(format);
+	writer->compiled = struct_compile(format);
+	if (writer->format == NULL || writer->compiled == NULL || writer->compiled->size == 0 ||
+			writer->compiled->size > UINT32_MAX / block_records)
+		goto fail;
+
+	writer->block_size = block_records * writer->compiled->size;
+	writer->block = struct_writer_alloc(writer->block_size, flags);
+	if (writer->block == NULL)
+		goto fail;
+	if (flags & STRUCT_STREAM_SHUFFLE)
+	{
+		writer->shuffled = struct_writer_alloc(writer->block_size, flags);
+		if (writer->shuffled == NULL)
+			goto fail;
+	}
+	if (codec != NULL)
+	{
+		writer->compressed = struct_writer_alloc(codec->bound(writer->block_size), flags);
+		if (writer->compressed == NULL)
+			goto fail;
+	}
+
+	// reader rejects blocks larger than stated by stream header
+	struct_store_uint(header, sizeof(uint32_t), __LITTLE_ENDIAN, block_records);
+	if (fwrite(header, sizeof(header), 1, stream) != 1)
+		goto fail;
+
+	return writer;
+
+fail:
+	writer->count = 0;
+	struct_writer_close(writer);
+	return NULL;
+}
+
+ssize_t struct_writer_pack(struct_writer *writer, ...)
+{
+	ssize_t result;
+	va_list vl;
+
+	if (writer == NULL)
+		return -1;
+	if (writer->count == writer->block_records && struct_writer_flush(writer) != 0)
+		return -1;
+
+	va_start(vl, writer);
+	result = struct_vpack(writer->block + writer->count * writer->compiled->size,
+			writer->compiled->size, writer->format, vl);
+	va_end(vl);
+
+	if (result != (ssize_t) writer->compiled->size)
+		return -1;
+
+	writer->count++;
+	return result;
+}
+
+ssize_t struct_writer_write(struct_writer *writer, const void *records, size_t count)
+{
+	const uint8_t *p = records;
+	size_t i, n;
+
+	if (writer == NULL || (records == NULL && count > 0))
+		return -1;
+
+	for (i = 0; i < count; i += n)
+	{
+		if (writer->count == writer->block_records && struct_writer_flush(writer) != 0)
+			return -1;
+
+		n = writer->block_records - writer->count;
+		if (n > count - i)
+			n = count - i;
+		memcpy(writer->block + writer->count * writer->compiled->size,
+				p + i * writer->compiled->size, n * writer->compiled->size);
+		writer->count += n;
+	}
+
+	return count;
+}
+
+int struct_writer_flush(struct_writer *writer)
+{
+	uint8_t header[STRUCT_BLOCK_HEADER_SIZE];
+	const uint8_t *data;
+	size_t size;
+	unsigned flags;
+
+	if (writer == NULL)
+		return -1;
+	if (writer->count == 0)
+		return 0;
+
+	data = writer->block;
+	size = writer->count * writer->compiled->size;
+	flags = writer->flags & STRUCT_STREAM_SHUFFLE;
+
+	if (flags & STRUCT_STREAM_SHUFFLE)
+	{
+		struct_shuffle(writer->shuffled, data, writer->compiled, writer->count);
+		data = writer->shuffled;
+	}
+	if (writer->codec != NULL)
+	{
+		ssize_t compressed = writer->codec->compress(writer->compressed,
+				writer->codec->bound(size), data, size);
+		if (compressed >= 0 && (size_t) compressed < size)
+		{
+			data = writer->compressed;
+			size = compressed;
+			flags |= STRUCT_BLOCK_COMPRESSED;
+		}
+	}
+
+	struct_store_uint(&header[0], sizeof(uint32_t), __LITTLE_ENDIAN, writer->count);
+	struct_store_uint(&header[4], sizeof(uint32_t), __LITTLE_ENDIAN, flags);
+	struct_store_uint(&header[8], sizeof(uint32_t), __LITTLE_ENDIAN, size);
+	if (fwrite(header, sizeof(header), 1, writer->stream) != 1 ||
+			fwrite(data, size, 1, writer->stream) != 1)
+		return -1;
+
+	writer->count = 0;
+	return 0;
+}
+
+int struct_writer_close(struct_writer *writer)
+{
+	int result;
+
+	if (writer == NULL)
+		return 0;
+
+	result = struct_writer_flush(writer);
+	free(writer->format);
+	struct_free(writer->compiled);
+	struct_writer_release(writer->block, writer->block_size, writer->flags);
+	struct_writer_release(writer->shuffled, writer->block_size, writer->flags);
+	if (writer->compressed != NULL)
+		struct_writer_release(writer->compressed, writer->codec->bound(writer->block_size), writer->flags);
+	free(writer);
+	return result;
+}
+
+struct_reader *struct_reader_open(FILE *stream, const char *format, const struct_codec *codec)
+{
+	uint8_t header[STRUCT_STREAM_HEADER_SIZE];
+	struct_reader *reader;
+
+	if (stream == NULL || format == NULL)
+		return NULL;
+
+	reader = calloc(1, sizeof(*reader));
+	if (reader == NULL)
+		return NULL;
+
+	reader->stream = stream;
+	reader->codec = codec;
+	reader->format = struct_stream_strdup(format);
+	reader->compiled = struct_compile(format);
+	if (reader->format == NULL || reader->compiled == NULL || reader->compiled->size == 0 ||
+			fread(header, sizeof(header), 1, stream) != 1)
+		goto fail;
+
+	reader->block_records = struct_load_uint(header, sizeof(uint32_t), __LITTLE_ENDIAN);
+	if (reader->block_records == 0 || reader->block_records > UINT32_MAX / reader->compiled->size)
+		goto fail;
+
+	return reader;
+
+fail:
+	struct_reader_close(reader);
+	return NULL;
+}
+
+/**
+ * Grow buffer of reader to hold at least required size
+ * Buffers grow to largest block seen, previous content is not kept.
+ * @return Zero on success or negative when failed
+ */
+static int struct_reader_reserve(uint8_t **buffer, size_t *capacity, size_t size)
+{
+	if (size <= *capacity)
+		return 0;
+
+	free(*buffer);
+	*buffer = malloc(size);
+	*capacity = *buffer != NULL ? size : 0;
+	return *buffer != NULL ? 0 : -1;
+}
+
+/**
+ * Read and decode next block from stream
+ * @param reader Reader with all records of current block consumed
+ * @return Count of records in block, zero at end of stream or negative when failed
+ */
+static ssize_t struct_reader_next(struct_reader *reader)
+{
+	uint8_t header[STRUCT_BLOCK_HEADER_SIZE];
+	size_t count, flags, size, block_size;
+	uint8_t *data;
+
+	if (fread(header, sizeof(header), 1, reader->stream) != 1)
+		return feof(reader->stream) ? 0 : -1;
+
+	count = struct_load_uint(&header[0], sizeof(uint32_t), __LITTLE_ENDIAN);
+	flags = struct_load_uint(&header[4], sizeof(uint32_t), __LITTLE_ENDIAN);
+	size = struct_load_uint(&header[8], sizeof(uint32_t), __LITTLE_ENDIAN);
+	if (count == 0 || count > reader->block_records || (flags & ~STRUCT_BLOCK_FLAGS) != 0)
+		return -1;
+	if ((flags & STRUCT_BLOCK_COMPRESSED) && reader->codec == NULL)
+		return -1;
+
+	// header is checked before allocation, so forged sizes do not allocate more than stream allows
+	block_size = count * reader->compiled->size;
+	if ((flags & STRUCT_BLOCK_COMPRESSED) ? size > reader->codec->bound(block_size) : size != block_size)
+		return -1;
+
+	if (struct_reader_reserve(&reader->block, &reader->block_capacity, block_size) < 0)
+		return -1;
+	if ((flags & STRUCT_STREAM_SHUFFLE) &&
+			struct_reader_reserve(&reader->shuffled, &reader->shuffled_capacity, block_size) < 0)
+		return -1;
+	if ((flags & STRUCT_BLOCK_COMPRESSED) &&
+			struct_reader_reserve(&reader->compressed, &reader->compressed_capacity, size) < 0)
+		return -1;
+
+	data = (flags & STRUCT_STREAM_SHUFFLE) ? reader->shuffled : reader->block;
+	if (flags & STRUCT_BLOCK_COMPRESSED)
+	{
+		if (fread(reader->compressed, size, 1, reader->stream) != 1 ||
+				reader->codec->decompress(data, block_size, reader->compressed, size) != (ssize_t) block_size)
+			return -1;
+	}
+	else
+	{
+		if (fread(data, size, 1, reader->stream) != 1)
+			return -1;
+	}
+
+	if (flags & STRUCT_STREAM_SHUFFLE)
+		struct_unshuffle(reader->block, reader->shuffled, reader->compiled, count);
+
+	reader->count = count;
+	reader->position = 0;
+	return count;
+}
+
+ssize_t struct_reader_unpack(struct_reader *reader, ...)
+{
+	ssize_t result;
+	va_list vl;
+
+	if (reader == NULL)
+		return -1;
+	if (reader->position == reader->count)
+	{
+		result = struct_reader_next(reader);
+		if (result <= 0)
+			return result;
+	}
+
+	va_start(vl, reader);
+	result = struct_vunpack(reader->block + reader->position * reader->compiled->size,
+			reader->compiled->size, reader->format, vl);
+	va_end(vl);
+
+	if (result != (ssize_t) reader->compiled->size)
+		return -1;
+
+	reader->position++;
+	return result;
+}
+
+ssize_t struct_reader_read(struct_reader *reader, void *records, size_t count)
+{
+	uint8_t *p = records;
+	size_t i, n;
+
+	if (reader == NULL || (records == NULL && count > 0))
+		return -1;
+
+	for (i = 0; i < count; i += n)
+	{
+		if (reader->position == reader->count)
+		{
+			ssize_t result = struct_reader_next(reader);
+			if (result < 0)
+				return result;
+			if (result == 0)
+				break;
+		}
+
+		n = reader->count - reader->position;
+		if (n > count - i)
+			n = count - i;
+		memcpy(p + i * reader->compiled->size,
+				reader->block + reader->position * reader->compiled->size, n * reader->compiled->size);
+		reader->position += n;
+	}
+
+	return i;
+}
+
+void struct_reader_close(struct_reader *reader)
+{
+	if (reader == NULL)
+		return;
+
+	free(reader->format);
+	struct_free(reader->compiled);
+	free(reader->block);
+	free(reader->shuffled);
+	free(reader->compressed);
+	free(reader);
+}
@@ -0,0 +1,141 @@
+/**
+ * struct_stream.h
+ * Buffered streams of packed records with block compression.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STRUCT_STREAM_H_
+#define STRUCT_STREAM_H_
+
+#include "struct.h"
+#include "struct_codec.h"
+#include <stdio.h>
+
+//
+// Public Definitions
+//
+
+/** Transpose bytes of records in block to byte planes before compression */
+#define STRUCT_STREAM_SHUFFLE	0x01
+
+/** Allocate block buffers of writer with huge pages, see struct_alloc() */
+#define STRUCT_STREAM_HUGE_PAGES	0x02
+
+//
+// Public Types
+//
+
+/** Writer of packed records to stream */
+typedef struct _struct_writer struct_writer;
+
+/** Reader of packed records from stream */
+typedef struct _struct_reader struct_reader;
+
+//
+// Public Services
+//
+
+/**
+ * Open writer of records to stream
+ * Stream starts with 32-bit little endian count of records in block.
+ * Records are collected to blocks, each block is optionally shuffled and
+ * compressed and written with header of 32-bit little endian count of
+ * records, flags and size of block data. Block is stored uncompressed when
+ * compression does not reduce its size.
+ * @param stream Output stream, not closed by writer
+ * @param format Format pattern string of records
+ * @param block_records Count of records in block
+ * @param codec Compression codec or NULL to store blocks uncompressed
+ * @param flags Combination of STRUCT_STREAM_* flags
+ * @return Writer or NULL when failed, must be closed by struct_writer_close()
+ */
+struct_writer *struct_writer_open(FILE *stream, const char *format, size_t block_records,
+		const struct_codec *codec, unsigned flags);
+
+/**
+ * Pack record to writer
+ * @param writer Writer
+ * @param ... Fields to pack
+ * @return Size of packed record or negative when failed
+ */
+ssize_t struct_writer_pack(struct_writer *writer, ...);
+
+/**
+ * Write already packed records to writer
+ * @param writer Writer
+ * @param records Packed records
+ * @param count Count of records
+ * @return Count of written records or negative when failed
+ */
+ssize_t struct_writer_write(struct_writer *writer, const void *records, size_t count);
+
+/**
+ * Write collected records to stream as incomplete block
+ * @param writer Writer
+ * @return Zero on success or negative when failed
+ */
+int struct_writer_flush(struct_writer *writer);
+
+/**
+ * Flush and close writer
+ * @param writer Writer, may be NULL
+ * @return Zero on success or negative when flush failed
+ */
+int struct_writer_close(struct_writer *writer);
+
+/**
+ * Open reader of records written by struct_writer
+ * Stream header is read by this call. Blocks with more records than stated
+ * by stream header, unknown flags or compressed data larger than codec
+ * bound of block are rejected before buffers are allocated for them.
+ * @param stream Input stream, not closed by reader
+ * @param format Format pattern string of records
+ * @param codec Compression codec used by writer, may be NULL for uncompressed stream
+ * @return Reader or NULL when failed, must be closed by struct_reader_close()
+ */
+struct_reader *struct_reader_open(FILE *stream, const char *format, const struct_codec *codec);
+
+/**
+ * Unpack next record from reader
+ * @param reader Reader
+ * @param ... Fields to unpack
+ * @return Size of unpacked record, zero at end of stream or negative when failed
+ */
+ssize_t struct_reader_unpack(struct_reader *reader, ...);
+
+/**
+ * Read next packed records from reader
+ * @param reader Reader
+ * @param records Destination buffer
+ * @param count Maximal count of records to read
+ * @return Count of read records, zero at end of stream or negative when failed
+ */
+ssize_t struct_reader_read(struct_reader *reader, void *records, size_t count);
+
+/**
+ * Close reader
+ * @param reader Reader, may be NULL
+ */
+void struct_reader_close(struct_reader *reader);
+
+#endif /* STRUCT_STREAM_H_ */
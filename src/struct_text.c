@@ -0,0 +1,451 @@
+/**
+ * struct_text.c
+ * Packing binary data directly to base64 and hex text.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "struct_text.h"
+#include "struct.h"
+#include "struct_internal.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//
+// Private Definitions
+//
+
+/** Size of binary data decoded on stack, larger data is decoded to heap */
+#define STRUCT_TEXT_STACK_SIZE	256
+
+/** Base64 padding character */
+#define STRUCT_BASE64_PAD		'='
+
+//
+// Private Types
+//
+
+/** Binary to text conversion */
+typedef struct _struct_text_codec
+{
+	/** Calculate text length for binary data size */
+	size_t (*length)(size_t size);
+
+	/**
+	 * Encode binary data located at tail of text buffer
+	 * @param text Destination text, binary data starts at text + length(size) - size
+	 * @param size Size of binary data
+	 */
+	void (*encode)(char *text, size_t size);
+
+	/**
+	 * Decode text to binary data
+	 * @param data Destination buffer of decoded size
+	 * @param text Source text
+	 * @param length Length of source text
+	 * @return Size of binary data or negative for malformed text
+	 */
+	ssize_t (*decode)(uint8_t *data, const char *text, size_t length);
+
+	/** Calculate maximal size of binary data for text length */
+	size_t (*decoded_size)(size_t length);
+} struct_text_codec;
+
+//
+// Private Variables
+//
+
+static const char struct_base64_alphabet[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const char struct_hex_alphabet[] = "0123456789abcdef";
+
+//
+// Private Services
+//
+
+/**
+ * Decode single base64 character
+ * @return Value of character or negative for character out of alphabet
+ */
+static inline int struct_base64_value(char c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A';
+	if (c >= 'a' && c <= 'z')
+		return c - 'a' + 26;
+	if (c >= '0' && c <= '9')
+		return c - '0' + 52;
+	if (c == '+')
+		return 62;
+	if (c == '/')
+		return 63;
+	return -1;
+}
+
+/**
+ * Decode single hex digit
+ * @return Value of digit or negative for character out of alphabet
+ */
+static inline int struct_hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+static size_t struct_base64_length(size_t size)
+{
+	return (size + 2) / 3 * 4;
+}
+
+#ifdef STRUCT_TARGET_SSSE3
+
+/**
+ * Encode 12-byte groups of binary data with SSSE3
+ * Bytes are split to 6-bit indices by multiplications and indices are
+ * mapped to alphabet by adding offset of their range from lookup table.
+ * Each loop reads before writing and writes stay behind unread data while
+ * 4 * (groups + 1) <= gap between text and binary data.
+ * @param text Destination text
+ * @param data Binary data located after text
+ * @param size Size of binary data
+ * @return Count of encoded 3-byte groups
+ */
+STRUCT_TARGET_SSSE3 static size_t struct_base64_encode_ssse3(char *text, const uint8_t *data, size_t size)
+{
+	const __m128i shuffle = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+	const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	size_t gap = data - (const uint8_t *) text;
+	size_t k;
+
+	for (k = 0; 12 * k + 16 <= size && 4 * k + 4 <= gap; k++)
+	{
+		__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) &data[12 * k]), shuffle);
+		__m128i hi = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+		__m128i lo = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+		__m128i indices = _mm_or_si128(hi, lo);
+		__m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+
+		// range is 0 for 'A'-'Z' indices, 13 for 'a'-'z' and 1..12 for the rest
+		range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+		_mm_storeu_si128((__m128i *) &text[16 * k], _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range)));
+	}
+
+	return 4 * k;
+}
+
+#endif /* STRUCT_TARGET_SSSE3 */
+
+/**
+ * Encode binary data to base64 text in place
+ * Group G is read before 4 characters are written at 4 * G, binary data
+ * starts at least ceil(size / 3) characters after text so writes never
+ * overtake unread data.
+ */
+static void struct_base64_encode(char *text, size_t size)
+{
+	const uint8_t *data = (const uint8_t *) text + struct_base64_length(size) - size;
+	const uint8_t *end = data + size / 3 * 3;
+	size_t groups = 0;
+
+#ifdef STRUCT_TARGET_SSSE3
+	if (struct_has_ssse3())
+		groups = struct_base64_encode_ssse3(text, data, size);
+#endif
+
+	// each group is loaded before its characters are stored, which stay behind unread groups
+	for (data += 3 * groups, text += 4 * groups; data < end; data += 3, text += 4)
+	{
+		uint32_t v = (data[0] << 16) | (data[1] << 8) | data[2];
+
+		text[0] = struct_base64_alphabet[v >> 18];
+		text[1] = struct_base64_alphabet[(v >> 12) & 0x3f];
+		text[2] = struct_base64_alphabet[(v >> 6) & 0x3f];
+		text[3] = struct_base64_alphabet[v & 0x3f];
+	}
+
+	if (size % 3 != 0)
+	{
+		uint32_t v = data[0] << 16;
+
+		if (size % 3 == 2)
+			v |= data[1] << 8;
+		text[0] = struct_base64_alphabet[v >> 18];
+		text[1] = struct_base64_alphabet[(v >> 12) & 0x3f];
+		text[2] = size % 3 == 2 ? struct_base64_alphabet[(v >> 6) & 0x3f] : STRUCT_BASE64_PAD;
+		text[3] = STRUCT_BASE64_PAD;
+	}
+}
+
+static ssize_t struct_base64_decode(uint8_t *data, const char *text, size_t length)
+{
+	size_t i, size = 0;
+
+	if (length % 4 != 0)
+		return -1;
+
+	for (i = 0; i < length; i += 4)
+	{
+		int v0 = struct_base64_value(text[i]);
+		int v1 = struct_base64_value(text[i + 1]);
+		int v2 = struct_base64_value(text[i + 2]);
+		int v3 = struct_base64_value(text[i + 3]);
+		int last = i + 4 == length;
+
+		if (v0 < 0 || v1 < 0)
+			return -1;
+		data[size++] = (v0 << 2) | (v1 >> 4);
+
+		if (last && text[i + 2] == STRUCT_BASE64_PAD && text[i + 3] == STRUCT_BASE64_PAD)
+			break;
+		if (v2 < 0)
+			return -1;
+		data[size++] = ((v1 & 0x0f) << 4) | (v2 >> 2);
+
+		if (last && text[i + 3] == STRUCT_BASE64_PAD)
+			break;
+		if (v3 < 0)
+			return -1;
+		data[size++] = ((v2 & 0x03) << 6) | v3;
+	}
+
+	return size;
+}
+
+static size_t struct_base64_decoded_size(size_t length)
+{
+	return length / 4 * 3;
+}
+
+static size_t struct_hex_length(size_t size)
+{
+	return 2 * size;
+}
+
+#ifdef __SSE2__
+
+/**
+ * Convert bytes with values 0..15 to hex digits
+ */
+static inline __m128i struct_hex_digits(__m128i v)
+{
+	__m128i letters = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+
+	return _mm_add_epi8(_mm_add_epi8(v, _mm_set1_epi8('0')), letters);
+}
+
+/**
+ * Encode 16-byte blocks of binary data with SSE2
+ * Binary data starts size characters after text, so writes of block K
+ * stay behind unread data while 16 * (K + 1) <= size.
+ * @return Count of encoded bytes
+ */
+static size_t struct_hex_encode_sse2(char *text, const uint8_t *data, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= size; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *) &data[i]);
+		__m128i hi = struct_hex_digits(_mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f)));
+		__m128i lo = struct_hex_digits(_mm_and_si128(v, _mm_set1_epi8(0x0f)));
+
+		_mm_storeu_si128((__m128i *) &text[2 * i], _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *) &text[2 * i + 16], _mm_unpackhi_epi8(hi, lo));
+	}
+
+	return i;
+}
+
+#endif /* __SSE2__ */
+
+/**
+ * Encode binary data to hex text in place
+ */
+static void struct_hex_encode(char *text, size_t size)
+{
+	const uint8_t *data = (const uint8_t *) text + size;
+	const uint8_t *end = data + size;
+	size_t done = 0;
+
+#ifdef __SSE2__
+	done = struct_hex_encode_sse2(text, data, size);
+#endif
+
+	// each byte is loaded before its digits are stored, which stay behind unread bytes
+	for (data += done, text += 2 * done; data < end; data++, text += 2)
+	{
+		uint8_t v = *data;
+
+		text[0] = struct_hex_alphabet[v >> 4];
+		text[1] = struct_hex_alphabet[v & 0x0f];
+	}
+}
+
+static ssize_t struct_hex_decode(uint8_t *data, const char *text, size_t length)
+{
+	size_t i;
+
+	if (length % 2 != 0)
+		return -1;
+
+	for (i = 0; i < length; i += 2)
+	{
+		int hi = struct_hex_value(text[i]);
+		int lo = struct_hex_value(text[i + 1]);
+
+		if (hi < 0 || lo < 0)
+			return -1;
+		data[i / 2] = (hi << 4) | lo;
+	}
+
+	return length / 2;
+}
+
+static size_t struct_hex_decoded_size(size_t length)
+{
+	return length / 2;
+}
+
+static const struct_text_codec struct_text_base64 = {
+		struct_base64_length, struct_base64_encode, struct_base64_decode, struct_base64_decoded_size
+};
+
+static const struct_text_codec struct_text_hex = {
+		struct_hex_length, struct_hex_encode, struct_hex_decode, struct_hex_decoded_size
+};
+
+static ssize_t struct_vpack_text(const struct_text_codec *codec, char *text, size_t size,
+		const char *format, va_list args)
+{
+	ssize_t data_size;
+	size_t length;
+
+	if (text == NULL || format == NULL)
+		return -1;
+
+	data_size = struct_calcsize(format);
+	if (data_size < 0)
+		return -1;
+
+	length = codec->length(data_size);
+	if (size <= length)
+		return -1;
+
+	if (struct_vpack(text + length - data_size, data_size, format, args) != data_size)
+		return -1;
+
+	codec->encode(text, data_size);
+	text[length] = '\0';
+
+	return length;
+}
+
+static ssize_t struct_vunpack_text(const struct_text_codec *codec, const char *text, size_t length,
+		const char *format, va_list args)
+{
+	uint8_t stack[STRUCT_TEXT_STACK_SIZE];
+	uint8_t *data = stack;
+	ssize_t result = -1;
+	ssize_t size;
+
+	if (text == NULL || format == NULL)
+		return -1;
+
+	// text is constant, so it is decoded to separate buffer instead of in place
+	if (codec->decoded_size(length) > sizeof(stack))
+	{
+		data = malloc(codec->decoded_size(length));
+		if (data == NULL)
+			return -1;
+	}
+
+	size = codec->decode(data, text, length);
+	if (size >= 0)
+		result = struct_vunpack(data, size, format, args);
+
+	if (data != stack)
+		free(data);
+	return result;
+}
+
+//
+// Public Services
+//
+
+ssize_t struct_pack_base64(char *text, size_t size, const char *format, ...)
+{
+	ssize_t result;
+	va_list vl;
+
+	va_start(vl, format);
+	result = struct_vpack_text(&struct_text_base64, text, size, format, vl);
+	va_end(vl);
+
+	return result;
+}
+
+ssize_t struct_unpack_base64(const char *text, size_t length, const char *format, ...)
+{
+	ssize_t result;
+	va_list vl;
+
+	va_start(vl, format);
+	result = struct_vunpack_text(&struct_text_base64, text, length, format, vl);
+	va_end(vl);
+
+	return result;
+}
+
+ssize_t struct_pack_hex(char *text, size_t size, const char *format, ...)
+{
+	ssize_t result;
+	va_list vl;
+
+	va_start(vl, format);
+	result = struct_vpack_text(&struct_text_hex, text, size, format, vl);
+	va_end(vl);
+
+	return result;
+}
+
+ssize_t struct_unpack_hex(const char *text, size_t length, const char *format, ...)
+{
+	ssize_t result;
+	va_list vl;
+
+	va_start(vl, format);
+	result = struct_vunpack_text(&struct_text_hex, text, length, format, vl);
+	va_end(vl);
+
+	return result;
+}
@@ -0,0 +1,71 @@
+/**
+ * struct_text.h
+ * Packing binary data directly to base64 and hex text.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STRUCT_TEXT_H_
+#define STRUCT_TEXT_H_
+
+#include <stdlib.h>
+
+//
+// Public Services
+//
+
+/**
+ * Pack binary data to base64 text
+ * Data is packed to the tail of text buffer and encoded in place, so no
+ * intermediate binary buffer is used. Text is padded by '=' and terminated
+ * by zero character.
+ * @param text Destination buffer
+ * @param size Size of destination buffer
+ * @param format Format pattern string
+ * @param ... Fields to pack
+ * @return Length of text without terminating zero or negative when failed
+ */
+ssize_t struct_pack_base64(char *text, size_t size, const char *format, ...);
+
+/**
+ * Unpack binary data from base64 text
+ * @param text Source text
+ * @param length Length of source text
+ * @param format Format pattern string
+ * @param ... Fields to unpack
+ * @return Size of unpacked binary data or negative when failed
+ */
+ssize_t struct_unpack_base64(const char *text, size_t length, const char *format, ...);
+
+/**
+ * Pack binary data to lower case hex text
+ * @see struct_pack_base64()
+ */
+ssize_t struct_pack_hex(char *text, size_t size, const char *format, ...);
+
+/**
+ * Unpack binary data from hex text in any case
+ * @see struct_unpack_base64()
+ */
+ssize_t struct_unpack_hex(const char *text, size_t length, const char *format, ...);
+
+#endif /* STRUCT_TEXT_H_ */
@@ -0,0 +1,713 @@
+/**
+ * struct_transcode.c
+ * Transcoding of packed records to MessagePack and CBOR.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "struct_transcode.h"
+#include "struct_internal.h"
+#include <string.h>
+
+//
+// Private Definitions
+//
+
+/** Encodings */
+#define STRUCT_MSGPACK			0
+#define STRUCT_CBOR				1
+
+/** Types of encoded items */
+#define STRUCT_ITEM_UINT		0
+#define STRUCT_ITEM_INT			1	/**< Signed integer, decoded only for negative values */
+#define STRUCT_ITEM_BOOL		2
+#define STRUCT_ITEM_FLOAT32		3
+#define STRUCT_ITEM_FLOAT64		4
+#define STRUCT_ITEM_STR			5
+#define STRUCT_ITEM_BIN			6
+#define STRUCT_ITEM_ARRAY		7
+
+/** Maximal size of item without string data */
+#define STRUCT_ITEM_HEAD_SIZE	9
+
+/** CBOR major types */
+#define STRUCT_CBOR_UINT		0
+#define STRUCT_CBOR_NINT		1
+#define STRUCT_CBOR_BYTES		2
+#define STRUCT_CBOR_TEXT		3
+#define STRUCT_CBOR_ARRAY		4
+#define STRUCT_CBOR_SIMPLE		7
+
+//
+// Private Types
+//
+
+/** Decoded item */
+typedef struct _struct_item
+{
+	int type;
+	uint64_t value;			/**< Integer, float bits, boolean, length of string or count of array elements */
+	const uint8_t *data;	/**< Data of string */
+} struct_item;
+
+/**
+ * Float to 32-bit integer value conversation
+ */
+typedef union _float32
+{
+	float		f;
+	uint32_t	i;
+} float32;
+
+/**
+ * Double to 64-bit integer value conversation
+ */
+typedef union _double64
+{
+	double		d;
+	uint64_t	i;
+} double64;
+
+//
+// Private Services
+//
+
+/**
+ * Store marker byte followed by big endian value
+ */
+static inline uint8_t *struct_put_marker(uint8_t *p, uint8_t marker, size_t size, uint64_t v)
+{
+	*p++ = marker;
+	struct_store_uint(p, size, __BIG_ENDIAN, v);
+	return p + size;
+}
+
+/**
+ * Store MessagePack marker with value in smallest of 1, 2, 4 or 8 bytes
+ * @param marker Marker for 1 byte value, markers for larger values must follow it
+ */
+static inline uint8_t *struct_put_msgpack_sized(uint8_t *p, uint8_t marker, uint64_t v)
+{
+	if (v <= UINT8_MAX)
+		return struct_put_marker(p, marker, 1, v);
+	if (v <= UINT16_MAX)
+		return struct_put_marker(p, marker + 1, 2, v);
+	if (v <= UINT32_MAX)
+		return struct_put_marker(p, marker + 2, 4, v);
+	return struct_put_marker(p, marker + 3, 8, v);
+}
+
+static uint8_t *struct_put_msgpack(uint8_t *p, int type, uint64_t v)
+{
+	int64_t i = (int64_t) v;
+
+	switch (type)
+	{
+	case STRUCT_ITEM_INT:
+		if (i >= 0)
+			return struct_put_msgpack(p, STRUCT_ITEM_UINT, v);
+		if (i >= -32)
+			return struct_put_marker(p, (uint8_t) i, 0, 0);
+		if (i >= INT8_MIN)
+			return struct_put_marker(p, 0xd0, 1, v);
+		if (i >= INT16_MIN)
+			return struct_put_marker(p, 0xd1, 2, v);
+		if (i >= INT32_MIN)
+			return struct_put_marker(p, 0xd2, 4, v);
+		return struct_put_marker(p, 0xd3, 8, v);
+	case STRUCT_ITEM_UINT:
+		return v < 0x80 ? struct_put_marker(p, v, 0, 0) : struct_put_msgpack_sized(p, 0xcc, v);
+	case STRUCT_ITEM_BOOL:
+		return struct_put_marker(p, v ? 0xc3 : 0xc2, 0, 0);
+	case STRUCT_ITEM_FLOAT32:
+		return struct_put_marker(p, 0xca, 4, v);
+	case STRUCT_ITEM_FLOAT64:
+		return struct_put_marker(p, 0xcb, 8, v);
+	case STRUCT_ITEM_STR:
+		return v < 32 ? struct_put_marker(p, 0xa0 | v, 0, 0) : struct_put_msgpack_sized(p, 0xd9, v);
+	case STRUCT_ITEM_BIN:
+		return struct_put_msgpack_sized(p, 0xc4, v);
+	case STRUCT_ITEM_ARRAY:
+	default:
+		if (v < 16)
+			return struct_put_marker(p, 0x90 | v, 0, 0);
+		return v <= UINT16_MAX ? struct_put_marker(p, 0xdc, 2, v) : struct_put_marker(p, 0xdd, 4, v);
+	}
+}
+
+/**
+ * Store CBOR initial byte with argument in smallest size
+ */
+static inline uint8_t *struct_put_cbor_head(uint8_t *p, unsigned major, uint64_t v)
+{
+	if (v < 24)
+		return struct_put_marker(p, major << 5 | v, 0, 0);
+	if (v <= UINT8_MAX)
+		return struct_put_marker(p, major << 5 | 24, 1, v);
+	if (v <= UINT16_MAX)
+		return struct_put_marker(p, major << 5 | 25, 2, v);
+	if (v <= UINT32_MAX)
+		return struct_put_marker(p, major << 5 | 26, 4, v);
+	return struct_put_marker(p, major << 5 | 27, 8, v);
+}
+
+static uint8_t *struct_put_cbor(uint8_t *p, int type, uint64_t v)
+{
+	switch (type)
+	{
+	case STRUCT_ITEM_INT:
+		if ((int64_t) v < 0)
+			return struct_put_cbor_head(p, STRUCT_CBOR_NINT, ~v);
+		/* fall through */
+	case STRUCT_ITEM_UINT:
+		return struct_put_cbor_head(p, STRUCT_CBOR_UINT, v);
+	case STRUCT_ITEM_BOOL:
+		return struct_put_marker(p, v ? 0xf5 : 0xf4, 0, 0);
+	case STRUCT_ITEM_FLOAT32:
+		return struct_put_marker(p, 0xfa, 4, v);
+	case STRUCT_ITEM_FLOAT64:
+		return struct_put_marker(p, 0xfb, 8, v);
+	case STRUCT_ITEM_STR:
+		return struct_put_cbor_head(p, STRUCT_CBOR_TEXT, v);
+	case STRUCT_ITEM_BIN:
+		return struct_put_cbor_head(p, STRUCT_CBOR_BYTES, v);
+	case STRUCT_ITEM_ARRAY:
+	default:
+		return struct_put_cbor_head(p, STRUCT_CBOR_ARRAY, v);
+	}
+}
+
+/**
+ * Store item without string data checking space in destination
+ * @param p Pointer to destination, moved after item
+ * @param end End of destination
+ * @param encoding Encoding
+ * @param type Type of item
+ * @param v Value of item
+ * @return Zero on success or negative when item does not fit
+ */
+static inline int struct_write_item(uint8_t **p, uint8_t *end, int encoding, int type, uint64_t v)
+{
+	uint8_t item[STRUCT_ITEM_HEAD_SIZE];
+	size_t size;
+
+	if (end - *p >= STRUCT_ITEM_HEAD_SIZE)
+	{
+		*p = encoding == STRUCT_CBOR ? struct_put_cbor(*p, type, v) : struct_put_msgpack(*p, type, v);
+		return 0;
+	}
+
+	// exact size is known only after encoding near end of destination
+	size = (encoding == STRUCT_CBOR ? struct_put_cbor(item, type, v) : struct_put_msgpack(item, type, v)) - item;
+	if ((size_t) (end - *p) < size)
+		return -1;
+	memcpy(*p, item, size);
+	*p += size;
+	return 0;
+}
+
+/**
+ * Load big endian value following marker
+ * @return Pointer after value or NULL when data is truncated
+ */
+static inline const uint8_t *struct_get_sized(const uint8_t *p, const uint8_t *end, size_t size, uint64_t *v)
+{
+	if ((size_t) (end - p) < size)
+		return NULL;
+	*v = struct_load_uint(p, size, __BIG_ENDIAN);
+	return p + size;
+}
+
+static const uint8_t *struct_get_msgpack(const uint8_t *p, const uint8_t *end, struct_item *item)
+{
+	uint8_t m;
+
+	if (p >= end)
+		return NULL;
+	m = *p++;
+
+	if (m < 0x80 || m >= 0xe0)
+	{
+		item->type = m < 0x80 ? STRUCT_ITEM_UINT : STRUCT_ITEM_INT;
+		item->value = (uint64_t) (int64_t) (int8_t) m;
+		return p;
+	}
+	if (m >= 0x90 && m < 0xa0)
+	{
+		item->type = STRUCT_ITEM_ARRAY;
+		item->value = m & 0x0f;
+		return p;
+	}
+	if (m >= 0xa0 && m < 0xc0)
+	{
+		item->type = STRUCT_ITEM_STR;
+		item->value = m & 0x1f;
+	}
+	else
+	{
+		switch (m)
+		{
+		case 0xc2:
+		case 0xc3:
+			item->type = STRUCT_ITEM_BOOL;
+			item->value = m == 0xc3;
+			return p;
+		case 0xc4: case 0xc5: case 0xc6:
+			item->type = STRUCT_ITEM_BIN;
+			p = struct_get_sized(p, end, 1 << (m - 0xc4), &item->value);
+			break;
+		case 0xca:
+			item->type = STRUCT_ITEM_FLOAT32;
+			return struct_get_sized(p, end, 4, &item->value);
+		case 0xcb:
+			item->type = STRUCT_ITEM_FLOAT64;
+			return struct_get_sized(p, end, 8, &item->value);
+		case 0xcc: case 0xcd: case 0xce: case 0xcf:
+			item->type = STRUCT_ITEM_UINT;
+			return struct_get_sized(p, end, 1 << (m - 0xcc), &item->value);
+		case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+			item->type = STRUCT_ITEM_INT;
+			p = struct_get_sized(p, end, 1 << (m - 0xd0), &item->value);
+			if (p != NULL)
+				item->value = struct_sign_extend(item->value, 1 << (m - 0xd0));
+			return p;
+		case 0xd9: case 0xda: case 0xdb:
+			item->type = STRUCT_ITEM_STR;
+			p = struct_get_sized(p, end, 1 << (m - 0xd9), &item->value);
+			break;
+		case 0xdc: case 0xdd:
+			item->type = STRUCT_ITEM_ARRAY;
+			return struct_get_sized(p, end, m == 0xdc ? 2 : 4, &item->value);
+		default:
+			// nil, maps and extensions have no representation in packed records
+			return NULL;
+		}
+	}
+
+	if (p == NULL || item->value > (uint64_t) (end - p))
+		return NULL;
+	item->data = p;
+	return p + item->value;
+}
+
+static const uint8_t *struct_get_cbor(const uint8_t *p, const uint8_t *end, struct_item *item)
+{
+	unsigned major, info;
+
+	if (p >= end)
+		return NULL;
+	major = *p >> 5;
+	info = *p++ & 0x1f;
+
+	if (major == STRUCT_CBOR_SIMPLE)
+	{
+		switch (info)
+		{
+		case 20:
+		case 21:
+			item->type = STRUCT_ITEM_BOOL;
+			item->value = info == 21;
+			return p;
+		case 26:
+			item->type = STRUCT_ITEM_FLOAT32;
+			return struct_get_sized(p, end, 4, &item->value);
+		case 27:
+			item->type = STRUCT_ITEM_FLOAT64;
+			return struct_get_sized(p, end, 8, &item->value);
+		default:
+			return NULL;
+		}
+	}
+
+	if (info < 24)
+		item->value = info;
+	else if (info <= 27)
+		p = struct_get_sized(p, end, 1 << (info - 24), &item->value);
+	else
+		return NULL;
+	if (p == NULL)
+		return NULL;
+
+	switch (major)
+	{
+	case STRUCT_CBOR_UINT:
+		item->type = STRUCT_ITEM_UINT;
+		return p;
+	case STRUCT_CBOR_NINT:
+		if ((int64_t) item->value < 0)
+			return NULL;
+		item->type = STRUCT_ITEM_INT;
+		item->value = ~item->value;
+		return p;
+	case STRUCT_CBOR_ARRAY:
+		item->type = STRUCT_ITEM_ARRAY;
+		return p;
+	case STRUCT_CBOR_BYTES:
+	case STRUCT_CBOR_TEXT:
+		item->type = major == STRUCT_CBOR_TEXT ? STRUCT_ITEM_STR : STRUCT_ITEM_BIN;
+		if (item->value > (uint64_t) (end - p))
+			return NULL;
+		item->data = p;
+		return p + item->value;
+	default:
+		// maps and tags have no representation in packed records
+		return NULL;
+	}
+}
+
+static inline const uint8_t *struct_get_item(const uint8_t *p, const uint8_t *end, int encoding,
+		struct_item *item)
+{
+	return encoding == STRUCT_CBOR ? struct_get_cbor(p, end, item) : struct_get_msgpack(p, end, item);
+}
+
+/**
+ * Count encoded fields of format
+ */
+static size_t struct_transcode_fields(const struct_format *format)
+{
+	size_t i, result = 0;
+
+	for (i = 0; i < format->count; i++)
+		if (format->fields[i].format != 'x' && format->fields[i].repeat > 0)
+			result++;
+	return result;
+}
+
+/**
+ * Encode single value of numeric field
+ */
+static inline int struct_write_value(uint8_t **p, uint8_t *end, int encoding, const struct_field *f,
+		size_t width, int byte_order, const uint8_t *src)
+{
+	uint64_t v = struct_load_uint(src, width, byte_order);
+
+	switch (f->format)
+	{
+	case '?':
+		return struct_write_item(p, end, encoding, STRUCT_ITEM_BOOL, v != 0);
+	case 'f':
+		return struct_write_item(p, end, encoding, STRUCT_ITEM_FLOAT32, v);
+	case 'd':
+		return struct_write_item(p, end, encoding, STRUCT_ITEM_FLOAT64, v);
+	default:
+		if (struct_format_signed(f->format))
+			return struct_write_item(p, end, encoding, STRUCT_ITEM_INT, struct_sign_extend(v, width));
+		return struct_write_item(p, end, encoding, STRUCT_ITEM_UINT, v);
+	}
+}
+
+/**
+ * Encode packed record as array of field values
+ * @return Pointer after encoded record or NULL when it does not fit
+ */
+static uint8_t *struct_write_record(uint8_t *p, uint8_t *end, int encoding, const struct_format *format,
+		size_t fields, const uint8_t *record)
+{
+	size_t i, n;
+
+	if (struct_write_item(&p, end, encoding, STRUCT_ITEM_ARRAY, fields) < 0)
+		return NULL;
+
+	for (i = 0; i < format->count; i++)
+	{
+		const struct_field *f = &format->fields[i];
+		const uint8_t *src = record + f->offset;
+		size_t width;
+
+		if (f->format == 'x' || f->repeat == 0)
+			continue;
+
+		if (f->format == 's' || f->format == 'T')
+		{
+			size_t length = f->format == 's' ? strnlen((const char *) src, f->size) : f->size;
+
+			if (struct_write_item(&p, end, encoding, f->format == 's' ? STRUCT_ITEM_STR : STRUCT_ITEM_BIN,
+					length) < 0 || (size_t) (end - p) < length)
+				return NULL;
+			memcpy(p, src, length);
+			p += length;
+			continue;
+		}
+
+		width = f->size / f->repeat;
+		if (f->repeat > 1 && struct_write_item(&p, end, encoding, STRUCT_ITEM_ARRAY, f->repeat) < 0)
+			return NULL;
+		for (n = 0; n < f->repeat; n++, src += width)
+			if (struct_write_value(&p, end, encoding, f, width, format->byte_order, src) < 0)
+				return NULL;
+	}
+
+	return p;
+}
+
+/**
+ * Store decoded numeric item to field value converting its type
+ * @return Zero on success or negative when item does not match field
+ */
+static int struct_read_value(uint8_t *dst, const struct_field *f, size_t width, int byte_order,
+		const struct_item *item)
+{
+	uint64_t v = item->value;
+	int type = item->type;
+
+	// non-negative signed integers are accepted by unsigned fields
+	if (type == STRUCT_ITEM_INT && (int64_t) v >= 0)
+		type = STRUCT_ITEM_UINT;
+
+	if (f->format == '?')
+	{
+		if (type != STRUCT_ITEM_BOOL)
+			return -1;
+	}
+	else if (f->format == 'f' || f->format == 'd')
+	{
+		float32 f32;
+		double64 d64;
+
+		switch (type)
+		{
+		case STRUCT_ITEM_FLOAT32:
+			f32.i = v;
+			d64.d = f32.f;
+			break;
+		case STRUCT_ITEM_FLOAT64:
+			d64.i = v;
+			break;
+		case STRUCT_ITEM_UINT:
+			d64.d = v;
+			break;
+		case STRUCT_ITEM_INT:
+			d64.d = (int64_t) v;
+			break;
+		default:
+			return -1;
+		}
+
+		if (f->format == 'f')
+		{
+			f32.f = d64.d;
+			v = f32.i;
+		}
+		else
+		{
+			v = d64.i;
+		}
+	}
+	else if (type == STRUCT_ITEM_UINT)
+	{
+		// value must fit into field type
+		if (width < sizeof(uint64_t) && v >> (8 * width - struct_format_signed(f->format)) != 0)
+			return -1;
+		if (width == sizeof(uint64_t) && struct_format_signed(f->format) && (int64_t) v < 0)
+			return -1;
+	}
+	else if (type == STRUCT_ITEM_INT)
+	{
+		if (!struct_format_signed(f->format) || struct_sign_extend(v, width) != (int64_t) v)
+			return -1;
+	}
+	else
+	{
+		return -1;
+	}
+
+	struct_store_uint(dst, width, byte_order, v);
+	return 0;
+}
+
+/**
+ * Decode array of field values to packed record
+ * @return Pointer after encoded record or NULL when failed
+ */
+static const uint8_t *struct_read_record(const uint8_t *p, const uint8_t *end, int encoding,
+		const struct_format *format, size_t fields, uint8_t *record)
+{
+	struct_item item;
+	size_t i, n;
+
+	memset(record, 0, format->size);
+
+	p = struct_get_item(p, end, encoding, &item);
+	if (p == NULL || item.type != STRUCT_ITEM_ARRAY || item.value != fields)
+		return NULL;
+
+	for (i = 0; i < format->count; i++)
+	{
+		const struct_field *f = &format->fields[i];
+		uint8_t *dst = record + f->offset;
+		size_t width, values;
+
+		if (f->format == 'x' || f->repeat == 0)
+			continue;
+
+		p = struct_get_item(p, end, encoding, &item);
+		if (p == NULL)
+			return NULL;
+
+		if (f->format == 's' || f->format == 'T')
+		{
+			if ((item.type != STRUCT_ITEM_STR && item.type != STRUCT_ITEM_BIN) || item.value > f->size)
+				return NULL;
+			memcpy(dst, item.data, item.value);
+			continue;
+		}
+
+		width = f->size / f->repeat;
+		values = 1;
+		if (f->repeat > 1)
+		{
+			// shorter arrays are padded by zeros
+			if (item.type != STRUCT_ITEM_ARRAY || item.value > f->repeat)
+				return NULL;
+			values = item.value;
+		}
+
+		for (n = 0; n < values; n++, dst += width)
+		{
+			if (f->repeat > 1)
+				p = struct_get_item(p, end, encoding, &item);
+			if (p == NULL || struct_read_value(dst, f, width, format->byte_order, &item) < 0)
+				return NULL;
+		}
+	}
+
+	return p;
+}
+
+/**
+ * Encode packed records
+ * @param array Non-zero to encode array of records, zero for single record
+ */
+static ssize_t struct_transcode_encode(void *buffer, size_t size, const struct_format *format,
+		const void *records, size_t count, int array, int encoding)
+{
+	uint8_t *p = buffer;
+	uint8_t *end = p + size;
+	const uint8_t *record = records;
+	size_t fields, i;
+
+	if (buffer == NULL || format == NULL || (records == NULL && count > 0))
+		return -1;
+
+	fields = struct_transcode_fields(format);
+	if (array && struct_write_item(&p, end, encoding, STRUCT_ITEM_ARRAY, count) < 0)
+		return -1;
+
+	for (i = 0; i < count; i++, record += format->size)
+	{
+		p = struct_write_record(p, end, encoding, format, fields, record);
+		if (p == NULL)
+			return -1;
+	}
+
+	return p - (uint8_t *) buffer;
+}
+
+/**
+ * Decode packed records
+ * @param array Non-zero to decode array of records, zero for single record
+ * @return Count of records for array, size of consumed data for single record or negative when failed
+ */
+static ssize_t struct_transcode_decode(void *records, size_t size, const struct_format *format,
+		const void *buffer, size_t buffer_size, int array, int encoding)
+{
+	const uint8_t *p = buffer;
+	const uint8_t *end = p + buffer_size;
+	uint8_t *record = records;
+	struct_item item;
+	size_t fields, count, i;
+
+	if (records == NULL || format == NULL || buffer == NULL)
+		return -1;
+
+	count = 1;
+	if (array)
+	{
+		p = struct_get_item(p, end, encoding, &item);
+		if (p == NULL || item.type != STRUCT_ITEM_ARRAY)
+			return -1;
+		count = item.value;
+	}
+	if (format->size > 0 && size / format->size < count)
+		return -1;
+
+	fields = struct_transcode_fields(format);
+	for (i = 0; i < count; i++, record += format->size)
+	{
+		p = struct_read_record(p, end, encoding, format, fields, record);
+		if (p == NULL)
+			return -1;
+	}
+
+	return array ? (ssize_t) count : p - (const uint8_t *) buffer;
+}
+
+//
+// Public Services
+//
+
+ssize_t struct_to_msgpack(void *buffer, size_t size, const struct_format *format, const void *record)
+{
+	return struct_transcode_encode(buffer, size, format, record, 1, 0, STRUCT_MSGPACK);
+}
+
+ssize_t struct_to_msgpack_array(void *buffer, size_t size, const struct_format *format,
+		const void *records, size_t count)
+{
+	return struct_transcode_encode(buffer, size, format, records, count, 1, STRUCT_MSGPACK);
+}
+
+ssize_t struct_from_msgpack(void *record, size_t size, const struct_format *format,
+		const void *buffer, size_t buffer_size)
+{
+	return struct_transcode_decode(record, size, format, buffer, buffer_size, 0, STRUCT_MSGPACK);
+}
+
+ssize_t struct_from_msgpack_array(void *records, size_t size, const struct_format *format,
+		const void *buffer, size_t buffer_size)
+{
+	return struct_transcode_decode(records, size, format, buffer, buffer_size, 1, STRUCT_MSGPACK);
+}
+
+ssize_t struct_to_cbor(void *buffer, size_t size, const struct_format *format, const void *record)
+{
+	return struct_transcode_encode(buffer, size, format, record, 1, 0, STRUCT_CBOR);
+}
+
+ssize_t struct_to_cbor_array(void *buffer, size_t size, const struct_format *format,
+		const void *records, size_t count)
+{
+	return struct_transcode_encode(buffer, size, format, records, count, 1, STRUCT_CBOR);
+}
+
+ssize_t struct_from_cbor(void *record, size_t size, const struct_format *format,
+		const void *buffer, size_t buffer_size)
+{
+	return struct_transcode_decode(record, size, format, buffer, buffer_size, 0, STRUCT_CBOR);
+}
+
+ssize_t struct_from_cbor_array(void *records, size_t size, const struct_format *format,
+		const void *buffer, size_t buffer_size)
+{
+	return struct_transcode_decode(records, size, format, buffer, buffer_size, 1, STRUCT_CBOR);
+}
@@ -0,0 +1,117 @@
+/**
+ * struct_transcode.h
+ * Transcoding of packed records to MessagePack and CBOR.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STRUCT_TRANSCODE_H_
+#define STRUCT_TRANSCODE_H_
+
+#include "struct.h"
+
+//
+// Public Services
+//
+
+/**
+ * Transcode packed record to MessagePack array of field values
+ * Padding and fields with zero repeat count are skipped, repeated numeric
+ * fields are nested arrays, 's' fields are strings up to first zero
+ * character, 'T' fields are binary bitsets and '?' fields are booleans.
+ * @param buffer Destination buffer
+ * @param size Size of destination buffer
+ * @param format Compiled format of record
+ * @param record Packed record
+ * @return Size of encoded data or negative when failed
+ */
+ssize_t struct_to_msgpack(void *buffer, size_t size, const struct_format *format, const void *record);
+
+/**
+ * Transcode array of packed records to MessagePack array of records
+ * @see struct_to_msgpack()
+ * @param buffer Destination buffer
+ * @param size Size of destination buffer
+ * @param format Compiled format of records
+ * @param records Packed records
+ * @param count Count of records
+ * @return Size of encoded data or negative when failed
+ */
+ssize_t struct_to_msgpack_array(void *buffer, size_t size, const struct_format *format,
+		const void *records, size_t count);
+
+/**
+ * Transcode MessagePack array of field values to packed record
+ * Integers must fit into field type, floating point fields accept any
+ * number and strings shorter than field are padded by zeros.
+ * @param record Destination buffer for packed record
+ * @param size Size of destination buffer
+ * @param format Compiled format of record
+ * @param buffer Encoded data
+ * @param buffer_size Size of encoded data
+ * @return Size of consumed encoded data or negative when failed
+ */
+ssize_t struct_from_msgpack(void *record, size_t size, const struct_format *format,
+		const void *buffer, size_t buffer_size);
+
+/**
+ * Transcode MessagePack array of records to packed records
+ * @see struct_from_msgpack()
+ * @param records Destination buffer for packed records
+ * @param size Size of destination buffer
+ * @param format Compiled format of records
+ * @param buffer Encoded data
+ * @param buffer_size Size of encoded data
+ * @return Count of records or negative when failed
+ */
+ssize_t struct_from_msgpack_array(void *records, size_t size, const struct_format *format,
+		const void *buffer, size_t buffer_size);
+
+/**
+ * Transcode packed record to CBOR array of field values
+ * @see struct_to_msgpack()
+ */
+ssize_t struct_to_cbor(void *buffer, size_t size, const struct_format *format, const void *record);
+
+/**
+ * Transcode array of packed records to CBOR array of records
+ * @see struct_to_msgpack_array()
+ */
+ssize_t struct_to_cbor_array(void *buffer, size_t size, const struct_format *format,
+		const void *records, size_t count);
+
+/**
+ * Transcode CBOR array of field values to packed record
+ * Indefinite length items, tags and half precision floats are not supported.
+ * @see struct_from_msgpack()
+ */
+ssize_t struct_from_cbor(void *record, size_t size, const struct_format *format,
+		const void *buffer, size_t buffer_size);
+
+/**
+ * Transcode CBOR array of records to packed records
+ * @see struct_from_msgpack_array()
+ */
+ssize_t struct_from_cbor_array(void *records, size_t size, const struct_format *format,
+		const void *buffer, size_t buffer_size);
+
+#endif /* STRUCT_TRANSCODE_H_ */
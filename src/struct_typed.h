@@ -0,0 +1,253 @@
+/**
+ * struct_typed.h
+ * Type checked packing macros for C11 compilers.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Mozzhuhin Andrey
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STRUCT_TYPED_H_
+#define STRUCT_TYPED_H_
+
+#include "struct.h"
+#include <stdbool.h>
+#include <string.h>
+
+//
+// Public Definitions
+//
+
+/**
+ * Pack values by type of each argument without variable arguments
+ * Arguments of types which can not be packed fail compilation, values of
+ * other types than format expects are rejected, floats are packed without
+ * promotion to double. From 1 to 16 values are supported.
+ * Format must be string literal, it is compiled on first call at each call
+ * site and kept for following calls, which pack like STRUCT_PACK_COMPILED().
+ * @param buffer Destination buffer
+ * @param size Size of destination buffer
+ * @param format Format pattern string literal
+ * @param ... Values to pack
+ * @return Size of packed data or negative when failed
+ */
+#define STRUCT_PACK(buffer, size, format, ...) \
+		STRUCT_PACK_COMPILED(buffer, size, STRUCT_TYPED_FORMAT(format), __VA_ARGS__)
+
+/**
+ * Unpack to pointers checking type of each destination against format
+ * @see STRUCT_PACK()
+ * @param buffer Source buffer
+ * @param size Size of source buffer
+ * @param format Format pattern string literal
+ * @param ... Pointers to destinations
+ * @return Size of unpacked data or negative when failed
+ */
+#define STRUCT_UNPACK(buffer, size, format, ...) \
+		STRUCT_UNPACK_COMPILED(buffer, size, STRUCT_TYPED_FORMAT(format), __VA_ARGS__)
+
+/**
+ * Pack values of record of compiled format by type of each argument
+ * Format is not parsed for each record, so packing is faster than by
+ * struct_pack() as well as type checked.
+ * @see STRUCT_PACK()
+ * @param buffer Destination buffer
+ * @param size Size of destination buffer
+ * @param format Compiled format
+ * @param ... Values to pack
+ * @return Size of packed record or negative when failed
+ */
+#define STRUCT_PACK_COMPILED(buffer, size, format, ...) \
+		struct_pack_compiled_values(buffer, size, format, \
+				(const struct_value[]) { STRUCT_TYPED_MAP(STRUCT_VALUE, __VA_ARGS__) }, \
+				STRUCT_TYPED_COUNT(__VA_ARGS__))
+
+/**
+ * Unpack record of compiled format to pointers checking type of each destination
+ * @see STRUCT_PACK_COMPILED()
+ * @param buffer Source buffer
+ * @param size Size of source buffer
+ * @param format Compiled format
+ * @param ... Pointers to destinations
+ * @return Size of unpacked record or negative when failed
+ */
+#define STRUCT_UNPACK_COMPILED(buffer, size, format, ...) \
+		struct_unpack_compiled_values(buffer, size, format, \
+				(const struct_value[]) { STRUCT_TYPED_MAP(STRUCT_DEST, __VA_ARGS__) }, \
+				STRUCT_TYPED_COUNT(__VA_ARGS__))
+
+/** Compiled format of string literal kept by call site, string concatenation rejects other formats */
+#define STRUCT_TYPED_FORMAT(format) __extension__ ({ \
+		static struct_format *struct_typed_cache; \
+		struct_typed_format(&struct_typed_cache, "" format ""); })
+
+/** Typed value to pack */
+#define STRUCT_VALUE(x) _Generic((x), \
+		bool: struct_value_uint, \
+		char: struct_value_int, \
+		signed char: struct_value_int, \
+		unsigned char: struct_value_uint, \
+		short: struct_value_int, \
+		unsigned short: struct_value_uint, \
+		int: struct_value_int, \
+		unsigned int: struct_value_uint, \
+		long: struct_value_int, \
+		unsigned long: struct_value_uint, \
+		long long: struct_value_int, \
+		unsigned long long: struct_value_uint, \
+		float: struct_value_float, \
+		double: struct_value_double, \
+		char *: struct_value_str, \
+		const char *: struct_value_str)(x)
+
+/** Typed destination to unpack */
+#define STRUCT_DEST(x) _Generic((x), \
+		bool *: struct_dest_uint, \
+		signed char *: struct_dest_int, \
+		unsigned char *: struct_dest_uint, \
+		short *: struct_dest_int, \
+		unsigned short *: struct_dest_uint, \
+		int *: struct_dest_int, \
+		unsigned int *: struct_dest_uint, \
+		long *: struct_dest_int, \
+		unsigned long *: struct_dest_uint, \
+		long long *: struct_dest_int, \
+		unsigned long long *: struct_dest_uint, \
+		float *: struct_dest_float, \
+		double *: struct_dest_double, \
+		char *: struct_dest_str)((x), sizeof(*(x)))
+
+/** Count arguments, up to 16 */
+#define STRUCT_TYPED_COUNT(...) STRUCT_TYPED_NTH(__VA_ARGS__, \
+		16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define STRUCT_TYPED_NTH(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, n, ...) n
+
+/** Apply macro to each argument, up to 16 */
+#define STRUCT_TYPED_MAP(m, ...) STRUCT_TYPED_CAT(STRUCT_TYPED_MAP_, STRUCT_TYPED_COUNT(__VA_ARGS__))(m, __VA_ARGS__)
+#define STRUCT_TYPED_CAT(a, b) STRUCT_TYPED_CAT_(a, b)
+#define STRUCT_TYPED_CAT_(a, b) a##b
+#define STRUCT_TYPED_MAP_1(m, x) m(x)
+#define STRUCT_TYPED_MAP_2(m, x, ...) m(x), STRUCT_TYPED_MAP_1(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_3(m, x, ...) m(x), STRUCT_TYPED_MAP_2(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_4(m, x, ...) m(x), STRUCT_TYPED_MAP_3(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_5(m, x, ...) m(x), STRUCT_TYPED_MAP_4(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_6(m, x, ...) m(x), STRUCT_TYPED_MAP_5(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_7(m, x, ...) m(x), STRUCT_TYPED_MAP_6(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_8(m, x, ...) m(x), STRUCT_TYPED_MAP_7(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_9(m, x, ...) m(x), STRUCT_TYPED_MAP_8(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_10(m, x, ...) m(x), STRUCT_TYPED_MAP_9(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_11(m, x, ...) m(x), STRUCT_TYPED_MAP_10(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_12(m, x, ...) m(x), STRUCT_TYPED_MAP_11(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_13(m, x, ...) m(x), STRUCT_TYPED_MAP_12(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_14(m, x, ...) m(x), STRUCT_TYPED_MAP_13(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_15(m, x, ...) m(x), STRUCT_TYPED_MAP_14(m, __VA_ARGS__)
+#define STRUCT_TYPED_MAP_16(m, x, ...) m(x), STRUCT_TYPED_MAP_15(m, __VA_ARGS__)
+
+//
+// Public Services
+//
+
+/**
+ * Get compiled format kept by call site, compile it on first use
+ * Format compiled concurrently by other thread is used instead of own one.
+ * Array modifier is rejected, since typed values have no pointers to arrays.
+ * @param cache Compiled format of call site, NULL before first use
+ * @param format Format pattern string
+ * @return Compiled format or NULL when format is invalid
+ */
+static inline const struct_format *struct_typed_format(struct_format **cache, const char *format)
+{
+	struct_format *compiled = __atomic_load_n(cache, __ATOMIC_ACQUIRE);
+	struct_format *expected = NULL;
+
+	if (compiled != NULL || strchr(format, '&') != NULL)
+		return compiled;
+
+	compiled = struct_compile(format);
+	if (compiled != NULL && !__atomic_compare_exchange_n(cache, &expected, compiled, 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+		struct_free(compiled);
+		compiled = expected;
+	}
+	return compiled;
+}
+
+static inline struct_value struct_value_int(int64_t v)
+{
+	struct_value result = { STRUCT_VALUE_INT, sizeof(v), { .i = v } };
+	return result;
+}
+
+static inline struct_value struct_value_uint(uint64_t v)
+{
+	struct_value result = { STRUCT_VALUE_UINT, sizeof(v), { .u = v } };
+	return result;
+}
+
+static inline struct_value struct_value_float(float v)
+{
+	struct_value result = { STRUCT_VALUE_FLOAT, sizeof(v), { .f = v } };
+	return result;
+}
+
+static inline struct_value struct_value_double(double v)
+{
+	struct_value result = { STRUCT_VALUE_DOUBLE, sizeof(v), { .d = v } };
+	return result;
+}
+
+static inline struct_value struct_value_str(const char *v)
+{
+	struct_value result = { STRUCT_VALUE_STR, 0, { .s = v } };
+	return result;
+}
+
+static inline struct_value struct_dest_int(void *p, size_t size)
+{
+	struct_value result = { STRUCT_VALUE_INT_PTR, size, { .p = p } };
+	return result;
+}
+
+static inline struct_value struct_dest_uint(void *p, size_t size)
+{
+	struct_value result = { STRUCT_VALUE_UINT_PTR, size, { .p = p } };
+	return result;
+}
+
+static inline struct_value struct_dest_float(float *p, size_t size)
+{
+	struct_value result = { STRUCT_VALUE_FLOAT_PTR, size, { .p = p } };
+	return result;
+}
+
+static inline struct_value struct_dest_double(double *p, size_t size)
+{
+	struct_value result = { STRUCT_VALUE_DOUBLE_PTR, size, { .p = p } };
+	return result;
+}
+
+static inline struct_value struct_dest_str(char *p, size_t size)
+{
+	struct_value result = { STRUCT_VALUE_STR_PTR, size, { .p = p } };
+	return result;
+}
+
+#endif /* STRUCT_TYPED_H_ */
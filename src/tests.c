@@ -25,11 +25,24 @@
  */
 
 #include "struct.h"
+#include "struct_arrow.h"
+#include "struct_codec.h"
+#include "struct_dict.h"
+#include "struct_index.h"
+#include "struct_inline.h"
+#include "struct_proto.h"
+#include "struct_registry.h"
+#include "struct_shuffle.h"
+#include "struct_stream.h"
+#include "struct_text.h"
+#include "struct_transcode.h"
+#include "struct_typed.h"
 #include <stdint.h>
 #include <limits.h>
 #include <float.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
 
 struct TestStructBasic
 {
@@ -466,6 +479,1140 @@ static void test_struct_pack_str_0(void)
 		printf("FAIL\n");
 }
 
+static void test_struct_pack_array_modifier(void)
+{
+	uint8_t buf[200];
+	uint16_t arr_h[21], res_h[21];
+	double arr_d[3] = { 1.5, -2.0, 1e100 }, res_d[3];
+	uint8_t arr_qm[3] = { 0, 7, 1 }, res_qm[3];
+	char c = 0;
+	ssize_t size1, size2, size3;
+	int res = 1;
+	size_t i;
+
+	for (i = 0; i < 21; i++)
+		arr_h[i] = i * 0x0101 + 1;
+
+	size1 = struct_pack(buf, sizeof(buf), ">c&21H&3d&3?", 'x', arr_h, arr_d, arr_qm);
+	for (i = 0; i < 21; i++)
+		res = res && buf[1 + 2 * i] == arr_h[i] >> 8 && buf[2 + 2 * i] == (arr_h[i] & 0xff);
+	size2 = struct_unpack(buf, sizeof(buf), ">c&21H&3d&3?", &c, res_h, res_d, res_qm);
+	size3 = struct_pack(buf, sizeof(buf), "&4s", "abcd");
+
+	printf("Pack array modifier test: ");
+	if (size1 == 1 + 42 + 24 + 3 && size2 == size1 && res && c == 'x' &&
+			memcmp(arr_h, res_h, sizeof(arr_h)) == 0 && memcmp(arr_d, res_d, sizeof(arr_d)) == 0 &&
+			res_qm[0] == 0 && res_qm[1] == 1 && res_qm[2] == 1 && buf[1 + 42 + 24 + 1] == 1 && size3 < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+}
+
+static void test_struct_pack_array(void)
+{
+	int16_t h[3] = { -1, 2, 300 }, res_h[3];
+	uint32_t arr_i[6] = { 1, 2, 3, 4, 5, 6 }, res_i[6];
+	char s[9] = "abcdefghi", res_s[9];
+	uint8_t buf[3 * 16], expected[16];
+	struct_format *format;
+	ssize_t size1, size2;
+	size_t n;
+	int res = 1;
+
+	format = struct_compile("@hx2I3s");
+	size1 = struct_pack_array(buf, sizeof(buf), format, 3, h, arr_i, s);
+	for (n = 0; n < 3; n++)
+	{
+		struct_pack(expected, sizeof(expected), "@hx2I3s", h[n], arr_i[2 * n], arr_i[2 * n + 1], &s[3 * n]);
+		res = res && memcmp(&buf[n * format->size], expected, format->size) == 0;
+	}
+	size2 = struct_unpack_array(buf, sizeof(buf), format, 3, res_h, res_i, res_s);
+
+	printf("Pack array of records test: ");
+	if (format->size == 15 && size1 == 45 && size2 == 45 && res &&
+			memcmp(h, res_h, sizeof(h)) == 0 && memcmp(arr_i, res_i, sizeof(arr_i)) == 0 &&
+			memcmp(s, res_s, sizeof(s)) == 0 &&
+			struct_pack_array(buf, 44, format, 3, h, arr_i, s) < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_free(format);
+}
+
+static void test_struct_pack_bits(void)
+{
+	uint8_t buf[200];
+	uint8_t flags[100], flags2[100], column[3 * 20], column2[3 * 20];
+	int8_t t[3] = { 5, 5, 5 };
+	uint16_t ids[3] = { 1, 2, 3 }, ids2[3];
+	struct_format *format = struct_compile("<H20T");
+	ssize_t size1, size2, size3, size4, size5, size6;
+	int bits_ok = 1;
+	size_t i;
+
+	for (i = 0; i < sizeof(flags); i++)
+		flags[i] = (i % 3 == 0) ? (uint8_t) i : 0;
+	for (i = 0; i < sizeof(column); i++)
+		column[i] = (i % 7 == 1);
+
+	size1 = struct_pack(buf, sizeof(buf), "<&100TB", flags, 0xAA);
+	for (i = 0; i < sizeof(flags); i++)
+		if (((buf[i / 8] >> (i % 8)) & 1) != (flags[i] != 0))
+			bits_ok = 0;
+	if (buf[12] >> 4 != 0 || buf[13] != 0xAA)
+		bits_ok = 0;
+	size2 = struct_unpack(buf, sizeof(buf), "<&100TB", flags2, &buf[199]);
+	for (i = 0; i < sizeof(flags); i++)
+		if (flags2[i] != (flags[i] != 0))
+			bits_ok = 0;
+
+	size3 = struct_pack(buf, sizeof(buf), "3T", 1, 0, 7);
+	size4 = struct_unpack(buf, sizeof(buf), "3T", &t[0], &t[1], &t[2]);
+	if (buf[0] != 0x05)
+		bits_ok = 0;
+
+	size5 = struct_pack_array(buf, sizeof(buf), format, 3, ids, column);
+	size6 = struct_unpack_array(buf, sizeof(buf), format, 3, ids2, column2);
+
+	printf("Pack bitset test: ");
+	if (size1 == 14 && size2 == 14 && bits_ok && size3 == 1 && size4 == 1 &&
+			t[0] == 1 && t[1] == 0 && t[2] == 1 && struct_calcsize("@b17T") == 4 &&
+			format != NULL && format->size == 5 && size5 == 15 && size6 == 15 &&
+			memcmp(ids, ids2, sizeof(ids)) == 0 && memcmp(column, column2, sizeof(column)) == 0 &&
+			struct_calcsize("{T}") < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_free(format);
+}
+
+static void test_struct_pack_optional(void)
+{
+	uint8_t buf[100];
+	uint64_t mask = 0;
+	int16_t h[3] = { -1, -1, -1 };
+	char str[5] = "xxxx";
+	double d = 0;
+	uint32_t I = 0;
+	uint8_t B = 0;
+	ssize_t size1, size2, size3, size4;
+
+	size1 = struct_pack(buf, sizeof(buf), "<I{3h4sd}B", 7, (uint64_t) 0x19, (int16_t) 100, "abc", 2.5, 9);
+	size2 = struct_unpack(buf, sizeof(buf), "<I{3h4sd}B", &I, &mask, &h[0], &h[1], &h[2], str, sizeof(str), &d, &B);
+	size3 = struct_pack(buf, sizeof(buf), "<{3h}", (uint64_t) 0x08);
+	buf[0] = 0x80;
+	size4 = struct_unpack(buf, sizeof(buf), "<{3h}", &mask, &h[0], &h[1], &h[2]);
+
+	printf("Pack optional fields test: ");
+	if (size1 == 4 + 1 + 2 + 4 + 8 + 1 && size2 == size1 && I == 7 && mask == 0x19 &&
+			h[0] == 100 && h[1] == 0 && h[2] == 0 && strcmp(str, "abc") == 0 && d == 2.5 && B == 9 &&
+			struct_calcsize("<I{3h4sd}B") == 4 + 1 + 6 + 4 + 8 + 1 &&
+			size3 < 0 && size4 < 0 && struct_calcsize("{h") < 0 && struct_calcsize("h}") < 0 &&
+			struct_calcsize("{{h}}") < 0 && struct_calcsize("{x}") < 0 && struct_compile("{h}") == NULL)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+}
+
+static void test_struct_pack_typed(void)
+{
+	uint8_t buf1[64], buf2[64], buf3[64];
+	struct_format *format = struct_compile("@bhIfd5s?3T");
+	int8_t b = 0;
+	int16_t h = 0;
+	uint32_t I = 0;
+	float f = 0;
+	double d = 0;
+	char s[6] = "";
+	bool t = false;
+	long l = 0;
+	int32_t i = 0;
+	uint8_t T[3] = { 0 };
+	ssize_t size1, size2, size3, size4, size5, size6, size7;
+	int n;
+
+	size1 = struct_pack(buf1, sizeof(buf1), "@bhIfd5s?3T", -1, 300, 70000, 1.5, 2.5, "hello", 1, 1, 0, 1);
+
+	// format is compiled by first call and kept for following calls
+	for (n = 0; n < 2; n++)
+		size2 = STRUCT_PACK(buf2, sizeof(buf2), "@bhIfd5s?3T", (int8_t) -1, 300, 70000u, 1.5f, 2.5, "hello",
+				true, 1, 0, 1);
+	size3 = STRUCT_UNPACK(buf2, sizeof(buf2), "@bhIfd5s?3T", &b, &h, &I, &f, &d, s, &t, &T[0], &T[1], &T[2]);
+	size4 = STRUCT_UNPACK(buf2, sizeof(buf2), "<l", &l);
+	size5 = STRUCT_UNPACK(buf2, sizeof(buf2), "<l", &i);
+
+	// compiled format takes the same values
+	size6 = STRUCT_PACK_COMPILED(buf3, sizeof(buf3), format, (int8_t) -1, 300, 70000u, 1.5f, 2.5, "hello", true,
+			1, 0, 1);
+	memset(s, 0, sizeof(s));
+	size7 = STRUCT_UNPACK_COMPILED(buf3, sizeof(buf3), format, &b, &h, &I, &f, &d, s, &t, &T[0], &T[1], &T[2]);
+
+	printf("Pack typed values test: ");
+	if (size1 == 31 && size2 == size1 && memcmp(buf1, buf2, size1) == 0 && size3 == size1 &&
+			b == -1 && h == 300 && I == 70000 && f == 1.5f && d == 2.5 && strcmp(s, "hello") == 0 && t &&
+			T[0] == 1 && T[1] == 0 && T[2] == 1 && size4 < 0 && size5 == 4 && i == 0x012c00ff &&
+			STRUCT_PACK(buf2, sizeof(buf2), "<h", "str") < 0 &&
+			STRUCT_PACK(buf2, sizeof(buf2), "<hh", 1) < 0 &&
+			STRUCT_PACK(buf2, sizeof(buf2), "<h", 1, 2) < 0 &&
+			STRUCT_PACK(buf2, sizeof(buf2), "<&2h", 1, 2) < 0 &&
+			STRUCT_PACK(buf2, 1, "<h", 1) < 0 &&
+			size6 == size1 && memcmp(buf1, buf3, size1) == 0 && size7 == size1 && strcmp(s, "hello") == 0 &&
+			T[2] == 1 && STRUCT_PACK_COMPILED(buf3, sizeof(buf3), format, 1) < 0 &&
+			STRUCT_UNPACK_COMPILED(buf3, sizeof(buf3), format, &b, &b, &I, &f, &d, s, &t, &T[0], &T[1], &T[2]) < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_free(format);
+}
+
+static void test_struct_calcsize_inline(void)
+{
+	const char *formats[] = { "hhl", "<Ih8s2xd2f3H?Q", "@bq", "bd", "b0i", "=b3i", "<&16H", "&4x", "0h", "<12345b",
+			"b h", "h ", "{h}", "bbbbbbbbbbbbbbbbbbh", "@20T h", "!Q", "y", "", "1000s" };
+	size_t i;
+	int res = 1;
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+		if (struct_calcsize_inline(formats[i]) != (struct_calcsize)(formats[i]))
+			res = 0;
+
+	printf("Inline calcsize test: ");
+	if (res && struct_calcsize_inline("@bq") == 16)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+}
+
+static void test_struct_compile(void)
+{
+	struct_format *format;
+	int res;
+
+	format = struct_compile("ci 3h0l 4s");
+
+	printf("Compile format test: ");
+	res = format != NULL && format->count == 5 && format->size == 20 &&
+			format->fields[0].format == 'c' && format->fields[0].offset == 0 &&
+			format->fields[1].format == 'i' && format->fields[1].offset == 4 &&
+			format->fields[2].repeat == 3 && format->fields[2].offset == 8 &&
+			format->fields[2].size == 6 && format->fields[3].offset == 16 &&
+			format->fields[4].offset == 16 && format->fields[4].size == 4 &&
+			struct_compile("abc") == NULL && struct_compile("1") == NULL;
+	if (res)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_free(format);
+}
+
+static void test_struct_pack_gather(void)
+{
+	struct order
+	{
+		double price;
+		uint32_t id;
+		char name[12];
+		int16_t qty;
+		uint8_t flags[10];
+	} orders[5], result[5];
+	uint8_t buf[5 * 18], expected[18];
+	struct_format *format = struct_compile("<I8sh2x10T");
+	struct_column columns[5] = {
+			{ &orders[0].id, sizeof(orders[0]), 0 },
+			{ orders[0].name, sizeof(orders[0]), 0 },
+			{ &orders[0].qty, sizeof(orders[0]), 0 },
+			{ NULL, 0, 0 },
+			{ orders[0].flags, sizeof(orders[0]), 0 }
+	};
+	ssize_t size1, size2;
+	size_t i, n;
+	int res = 1;
+
+	memset(orders, 0, sizeof(orders));
+	for (i = 0; i < 5; i++)
+	{
+		orders[i].id = 1000 + i;
+		snprintf(orders[i].name, sizeof(orders[i].name), "order%zu", i);
+		orders[i].qty = -(int16_t) i;
+		for (n = 0; n < 10; n++)
+			orders[i].flags[n] = (i + n) % 3 == 0;
+	}
+
+	size1 = struct_pack_gather(buf, sizeof(buf), format, 5, columns);
+	for (i = 0; i < 5; i++)
+	{
+		struct_pack(expected, sizeof(expected), "<I8sh2x&10T", orders[i].id, orders[i].name, orders[i].qty,
+				orders[i].flags);
+		res = res && memcmp(&buf[i * 18], expected, sizeof(expected)) == 0;
+	}
+
+	// scatter to other objects
+	memset(result, 0, sizeof(result));
+	for (i = 0; i < 5; i++)
+		if (columns[i].base != NULL)
+			columns[i].base = (uint8_t *) columns[i].base - (uint8_t *) orders + (uint8_t *) result;
+	size2 = struct_unpack_scatter(buf, sizeof(buf), format, 5, columns);
+	for (i = 0; i < 5; i++)
+		res = res && result[i].id == orders[i].id && memcmp(result[i].name, orders[i].name, 8) == 0 &&
+				result[i].qty == orders[i].qty && memcmp(result[i].flags, orders[i].flags, 10) == 0;
+
+	printf("Pack gather test: ");
+	if (res && size1 == 5 * 18 && size2 == 5 * 18 && struct_pack_gather(buf, 17, format, 1, columns) < 0 &&
+			struct_pack_gather(buf, sizeof(buf), format, 1, NULL) < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_free(format);
+}
+
+static void test_struct_unpack_convert(void)
+{
+	struct sample
+	{
+		int64_t level;
+		uint64_t count;
+		double value;
+		int64_t history[9];
+		int8_t flag;
+	} samples[3], result[3];
+	uint8_t buf[3 * 44], expected[44];
+	struct_format *format = struct_compile(">hBf9ib");
+	struct_column columns[5] = {
+			{ &samples[0].level, sizeof(samples[0]), 'q' },
+			{ &samples[0].count, sizeof(samples[0]), 'Q' },
+			{ &samples[0].value, sizeof(samples[0]), 'd' },
+			{ samples[0].history, sizeof(samples[0]), 'q' },
+			{ &samples[0].flag, sizeof(samples[0]), '?' }
+	};
+	int16_t shorts[20], shorts2[20];
+	int8_t bytes[17];
+	int64_t wide[20];
+	float floats[6] = { 0.5f, -1.25f, 3.0f, 1e10f, -0.0f, 7.75f };
+	double doubles[6];
+	struct_format *format2 = struct_compile("<20h");
+	struct_format *format3 = struct_compile("<f");
+	struct_format *format4 = struct_compile("<17b");
+	struct_column column2 = { wide, 0, 'q' };
+	struct_column column3 = { doubles, sizeof(doubles[0]), 'd' };
+	ssize_t size1, size2;
+	size_t i, n;
+	int res = 1;
+
+	memset(samples, 0, sizeof(samples));
+	for (i = 0; i < 3; i++)
+	{
+		samples[i].level = -300 - (int64_t) i;
+		samples[i].count = 250 + i;
+		samples[i].value = 0.25 * i - 1;
+		for (n = 0; n < 9; n++)
+			samples[i].history[n] = (int64_t) (n * 100000) - 400000 + i;
+		samples[i].flag = i;
+	}
+
+	// integers are narrowed when packed, big endian fields are swapped
+	size1 = struct_pack_gather(buf, sizeof(buf), format, 3, columns);
+	for (i = 0; i < 3; i++)
+	{
+		struct_pack(expected, sizeof(expected), ">hBf&9ib", (int) samples[i].level, (int) samples[i].count,
+				samples[i].value, (int32_t[]) { samples[i].history[0], samples[i].history[1],
+				samples[i].history[2], samples[i].history[3], samples[i].history[4], samples[i].history[5],
+				samples[i].history[6], samples[i].history[7], samples[i].history[8] }, (int) (samples[i].flag != 0));
+		res = res && memcmp(&buf[i * 44], expected, sizeof(expected)) == 0;
+	}
+
+	// and widened back when unpacked
+	memset(result, 0xff, sizeof(result));
+	for (i = 0; i < 5; i++)
+		columns[i].base = (uint8_t *) columns[i].base - (uint8_t *) samples + (uint8_t *) result;
+	size2 = struct_unpack_scatter(buf, sizeof(buf), format, 3, columns);
+	for (i = 0; i < 3; i++)
+	{
+		res = res && result[i].level == samples[i].level && result[i].count == samples[i].count &&
+				result[i].value == samples[i].value && result[i].flag == (samples[i].flag != 0);
+		for (n = 0; n < 9; n++)
+			res = res && result[i].history[n] == samples[i].history[n];
+	}
+
+	// contiguous values are widened by vector instructions
+	for (i = 0; i < 20; i++)
+		shorts[i] = (int16_t) (i * 3000 - 30000);
+	struct_pack_array(buf, sizeof(buf), format2, 1, shorts);
+	res = res && struct_unpack_scatter(buf, sizeof(buf), format2, 1, &column2) == 40;
+	for (i = 0; i < 20; i++)
+		res = res && wide[i] == shorts[i];
+	column2.type = 'h';
+	column2.base = shorts2;
+	res = res && struct_unpack_scatter(buf, sizeof(buf), format2, 1, &column2) == 40 &&
+			memcmp(shorts, shorts2, sizeof(shorts)) == 0;
+
+	for (i = 0; i < 17; i++)
+		bytes[i] = (int8_t) (i * 15 - 120);
+	struct_pack_array(buf, sizeof(buf), format4, 1, bytes);
+	column2.type = 'q';
+	column2.base = wide;
+	res = res && struct_unpack_scatter(buf, sizeof(buf), format4, 1, &column2) == 17;
+	for (i = 0; i < 17; i++)
+		res = res && wide[i] == bytes[i];
+
+	struct_pack_array(buf, sizeof(buf), format3, 6, floats);
+	res = res && struct_unpack_scatter(buf, sizeof(buf), format3, 6, &column3) == 24;
+	for (i = 0; i < 6; i++)
+		res = res && doubles[i] == floats[i];
+
+	// floating point values are not unpacked to integers
+	column3.type = 'q';
+	res = res && struct_unpack_scatter(buf, sizeof(buf), format3, 6, &column3) < 0;
+	column3.type = 's';
+	res = res && struct_pack_gather(buf, sizeof(buf), format3, 6, &column3) < 0;
+
+	printf("Unpack convert test: ");
+	if (res && size1 == 3 * 44 && size2 == 3 * 44)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_free(format4);
+	struct_free(format3);
+	struct_free(format2);
+	struct_free(format);
+}
+
+static void test_struct_validate_array(void)
+{
+	struct_format *format = struct_compile("<I?3xh6s10T");
+	uint8_t buf[40 * 18];
+	uint8_t bits[10] = { 1, 0, 1 };
+	size_t i;
+	int res;
+
+	for (i = 0; i < 40; i++)
+		struct_pack(&buf[i * format->size], format->size, "<I?3xh6s&10T", i, i % 2, -(int) i, i % 3 ? "abc" : "abcdef",
+				bits);
+	res = struct_validate_array(format, buf, sizeof(buf), 40, STRUCT_VALIDATE_ALL) == 40 &&
+			struct_validate_array(format, buf, sizeof(buf) - 1, 40, STRUCT_VALIDATE_ALL) == 39;
+
+	// invalid boolean
+	buf[33 * 18 + 4] = 2;
+	res = res && struct_validate_array(format, buf, sizeof(buf), 40, STRUCT_VALIDATE_ALL) == 33 &&
+			struct_validate_array(format, buf, sizeof(buf), 40, STRUCT_VALIDATE_PADDING) == 40;
+
+	// non-zero pad byte and unused bit of bitset
+	buf[20 * 18 + 6] = 1;
+	res = res && struct_validate_array(format, buf, sizeof(buf), 40, STRUCT_VALIDATE_ALL) == 20;
+	buf[7 * 18 + 17] = 0x80;
+	res = res && struct_validate_array(format, buf, sizeof(buf), 40, STRUCT_VALIDATE_ALL) == 7 &&
+			struct_validate_array(format, buf, sizeof(buf), 40, STRUCT_VALIDATE_BOOLS) == 33;
+
+	// garbage after string terminator and string without terminator
+	buf[2 * 18 + 14] = 'x';
+	res = res && struct_validate_array(format, buf, sizeof(buf), 40, STRUCT_VALIDATE_STRINGS) == 2 &&
+			struct_validate_array(format, buf, sizeof(buf), 40, STRUCT_VALIDATE_TERMINATED) == 0 &&
+			struct_validate_array(format, buf, sizeof(buf), 40, 0) == 40;
+
+	printf("Validate array test: ");
+	if (res && struct_validate_array(format, NULL, 0, 1, 0) < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_free(format);
+}
+
+static void test_struct_pad(void)
+{
+	uint32_t ids[3] = { 1, 2, 3 };
+	int16_t values[3] = { -1, -2, -3 };
+	uint8_t buf[3 * 64], expected[3 * 6];
+	struct_format *format = struct_compile("<Ih");
+	struct_format *padded = struct_pad(format, 64);
+	ssize_t size1, size2;
+
+	memset(buf, 0xff, sizeof(buf));
+	struct_pack_array(expected, sizeof(expected), format, 3, ids, values);
+	size1 = struct_pack_array(buf, sizeof(buf), padded, 3, ids, values);
+	size2 = struct_compact(buf, sizeof(buf), buf, padded, format, 3);
+
+	printf("Pad records test: ");
+	if (padded != NULL && padded->size == 64 && padded->count == 3 && size1 == 3 * 64 && buf[64 + 63] == 0 &&
+			size2 == 3 * 6 && memcmp(buf, expected, sizeof(expected)) == 0 &&
+			struct_pad(format, 0) == NULL && struct_compact(buf, 17, buf, padded, format, 3) < 0 &&
+			struct_compact(buf, sizeof(buf), buf, format, padded, 1) < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_free(padded);
+	struct_free(format);
+}
+
+static void test_struct_tune(void)
+{
+	static uint32_t arr_i[1000], res_i[1000];
+	static uint16_t arr_h[3 * 1000], res_h[3 * 1000];
+	static uint8_t arr_t[10 * 1000], res_t[10 * 1000];
+	static uint8_t buf[1000 * 13], expected[1000 * 13];
+	static uint8_t bytes[40], res_bytes[40];
+	struct_format *format = struct_compile(">I3Hx10T");
+	struct_format *wide;
+	char fmt[2 * 40 + 1];
+	ssize_t size1, size2;
+	size_t i;
+	int strategy, res = 1;
+
+	for (i = 0; i < 1000; i++)
+		arr_i[i] = i * 0x01010101u;
+	for (i = 0; i < 3 * 1000; i++)
+		arr_h[i] = i;
+	for (i = 0; i < 10 * 1000; i++)
+		arr_t[i] = i % 3 == 0;
+
+	// result of each strategy must not differ from default one
+	struct_pack_array(expected, sizeof(expected), format, 1000, arr_i, arr_h, arr_t);
+	strategy = struct_tune(format);
+	format->strategy = STRUCT_STRATEGY_BLOCKS;
+	size1 = struct_pack_array(buf, sizeof(buf), format, 1000, arr_i, arr_h, arr_t);
+	size2 = struct_unpack_array(buf, sizeof(buf), format, 1000, res_i, res_h, res_t);
+	res = size1 == 1000 * 13 && size2 == size1 && memcmp(buf, expected, sizeof(buf)) == 0 &&
+			memcmp(arr_i, res_i, sizeof(arr_i)) == 0 && memcmp(arr_h, res_h, sizeof(arr_h)) == 0 &&
+			memcmp(arr_t, res_t, sizeof(arr_t)) == 0;
+
+	// small blocks end in the middle of records, prefetch reaches end of records
+	format->block = 100;
+	format->prefetch = 1000;
+	memset(buf, 0, sizeof(buf));
+	size1 = struct_pack_array(buf, sizeof(buf), format, 1000, arr_i, arr_h, arr_t);
+	res = res && size1 == 1000 * 13 && memcmp(buf, expected, sizeof(buf)) == 0;
+	memset(res_i, 0, sizeof(res_i));
+	size2 = struct_unpack_array(buf, sizeof(buf), format, 1000, res_i, res_h, res_t);
+	res = res && size2 == 1000 * 13 && memcmp(arr_i, res_i, sizeof(arr_i)) == 0;
+
+	// formats with many fields keep pointers to values out of stack
+	for (i = 0; i < 40; i++)
+	{
+		fmt[2 * i] = 'B';
+		fmt[2 * i + 1] = ' ';
+		bytes[i] = i + 1;
+	}
+	fmt[2 * 40] = '\0';
+	wide = struct_compile(fmt);
+	struct_tune(wide);
+	size1 = struct_pack_array(buf, sizeof(buf), wide, 1, &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4],
+			&bytes[5], &bytes[6], &bytes[7], &bytes[8], &bytes[9], &bytes[10], &bytes[11], &bytes[12], &bytes[13],
+			&bytes[14], &bytes[15], &bytes[16], &bytes[17], &bytes[18], &bytes[19], &bytes[20], &bytes[21],
+			&bytes[22], &bytes[23], &bytes[24], &bytes[25], &bytes[26], &bytes[27], &bytes[28], &bytes[29],
+			&bytes[30], &bytes[31], &bytes[32], &bytes[33], &bytes[34], &bytes[35], &bytes[36], &bytes[37],
+			&bytes[38], &bytes[39]);
+	struct_unpack_array(buf, sizeof(buf), wide, 1, res_bytes, &res_bytes[1], &res_bytes[2], &res_bytes[3],
+			&res_bytes[4], &res_bytes[5], &res_bytes[6], &res_bytes[7], &res_bytes[8], &res_bytes[9],
+			&res_bytes[10], &res_bytes[11], &res_bytes[12], &res_bytes[13], &res_bytes[14], &res_bytes[15],
+			&res_bytes[16], &res_bytes[17], &res_bytes[18], &res_bytes[19], &res_bytes[20], &res_bytes[21],
+			&res_bytes[22], &res_bytes[23], &res_bytes[24], &res_bytes[25], &res_bytes[26], &res_bytes[27],
+			&res_bytes[28], &res_bytes[29], &res_bytes[30], &res_bytes[31], &res_bytes[32], &res_bytes[33],
+			&res_bytes[34], &res_bytes[35], &res_bytes[36], &res_bytes[37], &res_bytes[38], &res_bytes[39]);
+
+	printf("Tune array strategy test: ");
+	if (res && (strategy == STRUCT_STRATEGY_COLUMNS || strategy == STRUCT_STRATEGY_BLOCKS) &&
+			wide != NULL && wide->count == 40 && size1 == 40 && memcmp(buf, bytes, sizeof(bytes)) == 0 &&
+			memcmp(res_bytes, bytes, sizeof(bytes)) == 0 && struct_tune(NULL) < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_free(wide);
+	struct_free(format);
+}
+
+static void test_struct_pack_stream(void)
+{
+	const size_t count = 400000;
+	struct_format *format = struct_compile("<3QB");
+	uint64_t *q = malloc(count * 3 * sizeof(uint64_t));
+	uint8_t *b = malloc(count);
+	uint8_t *buf = malloc(count * 25 + 1), *expected = malloc(count * 25);
+	ssize_t size;
+	size_t i;
+
+	for (i = 0; i < count * 3; i++)
+		q[i] = i * 0x0101010101ull;
+	for (i = 0; i < count; i++)
+		b[i] = i;
+
+	// streamed output starts at odd address and blocks end in the middle of vectors
+	format->strategy = STRUCT_STRATEGY_BLOCKS;
+	struct_pack_array(expected, count * 25, format, count, q, b);
+	format->strategy = STRUCT_STRATEGY_STREAM;
+	size = struct_pack_array(buf + 1, count * 25, format, count, q, b);
+
+	printf("Pack array stream test: ");
+	if (size == (ssize_t) (count * 25) && memcmp(buf + 1, expected, count * 25) == 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	free(expected);
+	free(buf);
+	free(b);
+	free(q);
+	struct_free(format);
+}
+
+static void test_struct_estimate(void)
+{
+	struct_format *format = struct_compile(">Ih8s2x?3T");
+	struct_format *native = struct_compile("<Ih");
+	struct_cost cost, calibrated, empty;
+	int res1, res2, res3;
+
+	res1 = struct_estimate(format, 0, &cost);
+	res2 = struct_estimate(native, 1, &calibrated);
+	res3 = struct_estimate(NULL, 0, &empty);
+
+	printf("Estimate cost test: ");
+	if (res1 == 0 && cost.bytes == 4 + 2 + 8 + 2 + 1 + 1 + 3 && cost.stores == 1 + 1 + 1 + 1 + 1 + 1 &&
+			cost.swaps == 2 && cost.branches == 5 + 1 + 3 && cost.pack_ns == 0 &&
+			res2 == 0 && calibrated.swaps == 0 && calibrated.bytes == 6 &&
+			calibrated.pack_ns > 0 && calibrated.unpack_ns > 0 && res3 < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_free(native);
+	struct_free(format);
+}
+
+static void test_struct_alloc(void)
+{
+	const size_t size = 3 * 1024 * 1024 + 1;
+	uint8_t *plain = struct_alloc(size, 0);
+	uint8_t *huge = struct_alloc(size, STRUCT_ALLOC_HUGE);
+	uint8_t *page = struct_alloc(2 * 1024 * 1024, STRUCT_ALLOC_HUGE);
+	uint8_t record[14], result[14];
+	struct_writer *writer;
+	struct_reader *reader;
+	ssize_t read = 0;
+	FILE *f;
+	int res;
+
+	// huge page buffers start at huge page
+	res = plain != NULL && huge != NULL && page != NULL && (uintptr_t) plain % 4096 == 0 &&
+			(uintptr_t) huge % (2 * 1024 * 1024) == 0 && (uintptr_t) page % (2 * 1024 * 1024) == 0 &&
+			plain[0] == 0 && plain[size - 1] == 0 && huge[0] == 0 && huge[size - 1] == 0 &&
+			page[2 * 1024 * 1024 - 1] == 0;
+	if (res)
+	{
+		memset(plain, 1, size);
+		memset(huge, 2, size);
+		res = plain[size - 1] == 1 && huge[size - 1] == 2;
+	}
+	struct_alloc_free(page, 2 * 1024 * 1024, STRUCT_ALLOC_HUGE);
+	struct_alloc_free(huge, size, STRUCT_ALLOC_HUGE);
+	struct_alloc_free(plain, size, 0);
+	struct_alloc_free(NULL, 0, 0);
+
+	// writer with huge page buffers writes same stream
+	struct_pack(record, sizeof(record), "<Iqh", 1, (int64_t) 2, 3);
+	f = tmpfile();
+	writer = struct_writer_open(f, "<Iqh", 64 * 1024, NULL, STRUCT_STREAM_HUGE_PAGES | STRUCT_STREAM_SHUFFLE);
+	struct_writer_write(writer, record, 1);
+	struct_writer_close(writer);
+	rewind(f);
+	reader = struct_reader_open(f, "<Iqh", NULL);
+	read = struct_reader_read(reader, result, 1);
+	struct_reader_close(reader);
+	fclose(f);
+
+	printf("Allocate buffer test: ");
+	if (res && writer != NULL && read == 1 && memcmp(record, result, sizeof(record)) == 0 &&
+			struct_alloc(SIZE_MAX - 1, 0) == NULL)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+}
+
+static void test_struct_registry(void)
+{
+	const char *formats[] = { "<Ih8s2xd2f3H?Q", "@bhhhq", ">hhhh", "ci 3h0l 4s", "<H20T", "", "=b0i",
+			"@l", "<l", "70000s", "<IHHd8s" };
+	const size_t count = sizeof(formats) / sizeof(formats[0]);
+	struct_registry *registry = struct_registry_create();
+	const struct_format *kept;
+	struct_format *expanded;
+	char fmt[32];
+	size_t i, n, memory;
+	int res = 1;
+
+	for (i = 0; i < count; i++)
+	{
+		struct_format *compiled = struct_compile(formats[i]);
+		ssize_t id = struct_registry_add(registry, formats[i]);
+
+		expanded = struct_registry_format(registry, id);
+		res = res && id == (ssize_t) i && expanded != NULL && expanded->size == compiled->size &&
+				expanded->count == compiled->count && expanded->byte_order == compiled->byte_order &&
+				struct_registry_size(registry, id) == (ssize_t) compiled->size;
+		for (n = 0; res && n < compiled->count; n++)
+			res = expanded->fields[n].format == compiled->fields[n].format &&
+					expanded->fields[n].repeat == compiled->fields[n].repeat &&
+					expanded->fields[n].offset == compiled->fields[n].offset &&
+					expanded->fields[n].size == compiled->fields[n].size;
+
+		struct_free(expanded);
+		struct_free(compiled);
+	}
+
+	// formats with common suffix share ops
+	for (i = 0; i < 1000; i++)
+	{
+		snprintf(fmt, sizeof(fmt), "<%zusIHHd8s", i + 1);
+		if (struct_registry_add(registry, fmt) != (ssize_t) (count + i))
+			res = 0;
+	}
+	memory = struct_registry_memory(registry);
+
+	// kept formats are expanded once and counted as used memory
+	kept = struct_registry_compiled(registry, 0);
+	expanded = struct_registry_format(registry, 0);
+	res = res && kept != NULL && expanded != NULL && kept->count == expanded->count &&
+			memcmp(kept->fields, expanded->fields, kept->count * sizeof(kept->fields[0])) == 0 &&
+			struct_registry_compiled(registry, 0) == kept && struct_registry_memory(registry) > memory &&
+			struct_registry_compiled(registry, 9) != NULL && struct_registry_compiled(registry, 9)->size == 70000 &&
+			struct_registry_compiled(registry, count + 1000) == NULL;
+	struct_free(expanded);
+
+	printf("Format registry test: ");
+	if (res && memory < 1000 * 64 && struct_registry_add(registry, "abc") < 0 &&
+			struct_registry_format(registry, count + 1000) == NULL && struct_registry_size(registry, count + 1000) < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_registry_free(registry);
+}
+
+static void test_struct_bind(void)
+{
+	const char *fmt = "@BBHi8sd";
+	const size_t bound[] = { 0, 1, 2 };
+	struct_format *format = struct_compile(fmt);
+	struct_template *template = NULL;
+	uint8_t values[32], buf1[32], buf2[32];
+	ssize_t size1 = -1, size2 = -1;
+
+	if (format != NULL)
+	{
+		struct_pack(values, sizeof(values), fmt, 2, 17, 0x8001, 0, "", 0.0);
+		template = struct_bind(format, bound, 3, values);
+		size1 = struct_pack(buf1, sizeof(buf1), fmt, 2, 17, 0x8001, -5, "abc", 2.5);
+		size2 = struct_pack_template(buf2, sizeof(buf2), template, -5, "abc", 2.5);
+	}
+
+	printf("Bind format fields test: ");
+	if (template != NULL && size1 == 24 && size2 == size1 && memcmp(buf1, buf2, size1) == 0 &&
+			struct_pack_template(buf2, size1 - 1, template, -5, "abc", 2.5) < 0 &&
+			struct_bind(format, (const size_t[]) { 6 }, 1, values) == NULL)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_template_free(template);
+	struct_free(format);
+}
+
+static void test_struct_index(void)
+{
+	char records_path[] = "/tmp/struct-tests-XXXXXX";
+	char index_path[] = "/tmp/struct-tests-XXXXXX";
+	int16_t keys[] = { 7, -3, 100, 7, 0, -3, 7, 42 };
+	struct_format *format;
+	struct_index *index = NULL;
+	uint8_t buf[8];
+	size_t records[4];
+	ssize_t built = -1, res1 = -1, res2 = -1, res3 = -1, res4 = -1;
+	size_t i;
+	FILE *f;
+	int fd;
+
+	format = struct_compile(">Ih");
+	fd = mkstemp(records_path);
+	close(fd);
+	fd = mkstemp(index_path);
+	close(fd);
+
+	f = fopen(records_path, "wb");
+	for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+	{
+		struct_pack(buf, sizeof(buf), ">Ih", (uint32_t) i, keys[i]);
+		fwrite(buf, format->size, 1, f);
+	}
+	fclose(f);
+
+	built = struct_index_build(index_path, records_path, format, 1);
+	index = struct_index_open(index_path);
+	if (index != NULL)
+	{
+		res1 = struct_index_lookup(index, 7, records, 4);
+		res2 = struct_index_lookup(index, (uint64_t) -3, &records[3], 1);
+		res3 = struct_index_lookup(index, 5, records, 4);
+		res4 = struct_index_lookup(index, 42, NULL, 0);
+	}
+
+	printf("Secondary index test: ");
+	if (built == 8 && res1 == 3 && records[0] == 0 && records[1] == 3 && records[2] == 6 &&
+			res2 == 2 && records[3] == 1 && res3 == 0 && res4 == 1 &&
+			struct_index_build(index_path, records_path, format, 0) == 8 &&
+			struct_index_open(records_path) == NULL)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_index_close(index);
+	struct_free(format);
+	unlink(records_path);
+	unlink(index_path);
+}
+
+static void test_struct_dict(void)
+{
+	const char *symbols[] = { "EURUSD", "USDJPY", "EURUSD", "GBPUSD", "USDJPY", "EURUSD" };
+	uint8_t records[6 * 26], decoded[sizeof(records)], block[512];
+	// block of 100 records of format without strings truncated to 4 bytes of first record
+	const uint8_t truncated[8] = { 100, 0, 0, 0, 1, 2, 3, 4 };
+	struct_format *format, *numbers;
+	ssize_t size, count = -1, eurusd = -1, missing = 0;
+	int res = 1;
+	size_t i;
+
+	format = struct_compile("<I16sh4s");
+	numbers = struct_compile("<I");
+	for (i = 0; i < 6; i++)
+		struct_pack(&records[i * format->size], format->size, "<I16sh4s",
+				(uint32_t) i, symbols[i], (int16_t) -i, i % 2 ? "BUY" : "SELL");
+
+	size = struct_dict_encode(block, sizeof(block), format, records, 6);
+	if (size > 0)
+	{
+		count = struct_dict_decode(decoded, sizeof(decoded), format, block, size);
+		eurusd = struct_dict_find(block, size, format, 1, "EURUSD");
+		missing = struct_dict_find(block, size, format, 1, "EUR");
+		for (i = 0; i < 6; i++)
+			res = res && (struct_dict_index(block, size, format, i, 1) == eurusd) ==
+					(strcmp(symbols[i], "EURUSD") == 0);
+	}
+
+	printf("Dictionary encoding test: ");
+	if (size > 0 && size < struct_dict_bound(format, 6) && size < (ssize_t) sizeof(records) &&
+			count == 6 && memcmp(records, decoded, sizeof(records)) == 0 &&
+			eurusd == 0 && missing < 0 && res &&
+			struct_dict_decode(decoded, sizeof(decoded), format, block, size - 1) < 0 &&
+			struct_dict_decode(decoded, sizeof(decoded), numbers, truncated, sizeof(truncated)) < 0 &&
+			struct_dict_decode(decoded, sizeof(decoded), numbers, truncated, 4) < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_free(numbers);
+	struct_free(format);
+}
+
+static void test_struct_codec_lz(void)
+{
+	uint8_t src[4096], compressed[4096 + 64], decompressed[4096];
+	ssize_t size1, size2, res1, res2;
+	uint32_t seed = 1;
+	size_t i;
+
+	// half of data is repetitive, half is pseudo random
+	for (i = 0; i < sizeof(src); i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		src[i] = i < sizeof(src) / 2 ? (uint8_t) "struct"[i % 6] : (uint8_t) (seed >> 24);
+	}
+
+	size1 = struct_codec_lz.compress(compressed, sizeof(compressed), src, sizeof(src));
+	res1 = struct_codec_lz.decompress(decompressed, sizeof(decompressed), compressed, size1);
+	size2 = struct_codec_lz.compress(compressed, sizeof(compressed), src, 0);
+	res2 = struct_codec_lz.decompress(decompressed, sizeof(decompressed), compressed, size2);
+
+	printf("LZ codec test: ");
+	if (size1 > 0 && size1 < (ssize_t) sizeof(src) * 3 / 4 && res1 == sizeof(src) &&
+			memcmp(src, decompressed, sizeof(src)) == 0 && size2 == 1 && res2 == 0 &&
+			struct_codec_lz.decompress(decompressed, sizeof(decompressed) - 1, compressed, size1) < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+}
+
+static void test_struct_stream(void)
+{
+	// stream of 256 records per block followed by block with too many records, block with
+	// unknown flag and compressed block exceeding codec bound, data of one record is zeroed
+	static const uint8_t forged[][16 + 14] = {
+			{ 0, 1, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0x0e, 0x0e, 0, 0 },
+			{ 0, 1, 0, 0, 1, 0, 0, 0, 4, 0, 0, 0, 14, 0, 0, 0 },
+			{ 0, 1, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 0xff, 0xff, 0xff, 0xff } };
+	uint8_t records[1000 * 14], result[1000 * 14];
+	struct_writer *writer;
+	struct_reader *reader;
+	uint32_t a = 0;
+	int64_t b = 0;
+	int16_t c = 0;
+	long stream_size;
+	ssize_t read = 0, unpacked = 0;
+	size_t i;
+	FILE *f;
+
+	for (i = 0; i < 1000; i++)
+		struct_pack(&records[i * 14], 14, "<Iqh", (uint32_t) i, (int64_t) i * 1000, (int16_t) (i % 7));
+
+	f = tmpfile();
+	writer = struct_writer_open(f, "<Iqh", 256, &struct_codec_lz, STRUCT_STREAM_SHUFFLE);
+	struct_writer_pack(writer, (uint32_t) 0, (int64_t) 0, (int16_t) 0);
+	struct_writer_write(writer, &records[14], 999);
+	struct_writer_close(writer);
+	stream_size = ftell(f);
+
+	rewind(f);
+	reader = struct_reader_open(f, "<Iqh", &struct_codec_lz);
+	read = struct_reader_read(reader, result, 999);
+	unpacked = struct_reader_unpack(reader, &a, &b, &c);
+	struct_reader_close(reader);
+	fclose(f);
+
+	for (i = 0; i < sizeof(forged) / sizeof(forged[0]); i++)
+	{
+		f = tmpfile();
+		fwrite(forged[i], sizeof(forged[i]), 1, f);
+		rewind(f);
+		reader = struct_reader_open(f, "<Iqh", &struct_codec_lz);
+		if (reader == NULL || struct_reader_read(reader, result, 1) >= 0)
+			unpacked = -1;
+		struct_reader_close(reader);
+		fclose(f);
+	}
+
+	printf("Compressed stream test: ");
+	if (stream_size > 0 && stream_size < (long) sizeof(records) / 2 &&
+			read == 999 && memcmp(records, result, 999 * 14) == 0 &&
+			unpacked == 14 && a == 999 && b == 999000 && c == 999 % 7)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+}
+
+static void test_struct_shuffle(void)
+{
+	const char *formats[] = { "<hc", "<Iqh", "<16s", "<qq3sIIIIIc", "<B" };
+	const size_t counts[] = { 1, 15, 16, 33, 100 };
+	uint8_t src[100 * 40 + 1], shuffled[sizeof(src)], result[sizeof(src)];
+	int res = 1;
+	size_t f, n, i, j;
+
+	for (i = 0; i < sizeof(src); i++)
+		src[i] = i * 7 + (i >> 8);
+
+	for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+	{
+		struct_format *format = struct_compile(formats[f]);
+
+		for (n = 0; n < sizeof(counts) / sizeof(counts[0]); n++)
+		{
+			size_t count = counts[n];
+
+			memset(result, 0xff, sizeof(result));
+			res = res && struct_shuffle(shuffled, src, format, count) == (ssize_t) (count * format->size);
+			for (i = 0; i < count; i++)
+				for (j = 0; j < format->size; j++)
+					res = res && shuffled[j * count + i] == src[i * format->size + j];
+			res = res && struct_unshuffle(result, shuffled, format, count) == (ssize_t) (count * format->size) &&
+					memcmp(result, src, count * format->size) == 0 && result[count * format->size] == 0xff;
+		}
+		struct_free(format);
+	}
+
+	printf("Byte plane shuffle test: ");
+	if (res)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+}
+
+static void test_struct_text(void)
+{
+	const char *str = "The quick brown fox jumps over the lazy dog!";
+	const char *base64 = "VGhlIHF1aWNrIGJyb3duIGZveCBqdW1wcyBvdmVyIHRoZSBsYXp5IGRvZyESNA==";
+	const char *hex = "54686520717569636b2062726f776e20666f78206a756d7073206f76657220746865206c617a7920646f67211234";
+	char text[100], result[45];
+	uint16_t v = 0;
+	ssize_t len1, len2, res1, res2, res3;
+
+	len1 = struct_pack_base64(text, sizeof(text), ">44sH", str, 0x1234);
+	res1 = len1 == (ssize_t) strlen(base64) && strcmp(text, base64) == 0;
+	len2 = struct_pack_hex(text, sizeof(text), ">44sH", str, 0x1234);
+	res2 = len2 == (ssize_t) strlen(hex) && strcmp(text, hex) == 0;
+
+	res3 = struct_unpack_base64(base64, strlen(base64), ">44sH", result, sizeof(result), &v) == 46 &&
+			strcmp(result, str) == 0 && v == 0x1234;
+	v = 0;
+	res3 = res3 && struct_unpack_hex(hex, strlen(hex), ">44sH", result, sizeof(result), &v) == 46 &&
+			strcmp(result, str) == 0 && v == 0x1234;
+
+	printf("Base64 and hex text test: ");
+	if (res1 && res2 && res3 &&
+			struct_pack_base64(text, strlen(base64), ">44sH", str, 0x1234) < 0 &&
+			struct_unpack_base64("VGhl!", 5, "c", &result[0]) < 0 &&
+			struct_unpack_hex("5g", 2, "c", &result[0]) < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+}
+
+static void test_struct_proto(void)
+{
+	const unsigned numbers[] = { 1, 2, 3, 0, 4, 5, 6, 7, 8 };
+	const uint8_t expected[] = { 0x08, 0x96, 0x01, 0x10, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01,
+			0x1a, 0x07, 't', 'e', 's', 't', 'i', 'n', 'g' };
+	// unknown field 9, unpacked repeated field 6 interleaved with out of order field 1
+	const uint8_t unpacked[] = { 0x48, 0x05, 0x30, 0x01, 0x08, 0x2a, 0x30, 0x02 };
+	// four elements of field 6 with three values
+	const uint8_t overflow[] = { 0x30, 0x01, 0x08, 0x01, 0x30, 0x02, 0x08, 0x01, 0x30, 0x03, 0x08, 0x01, 0x30, 0x04 };
+	uint8_t record[64], decoded[64], message[128];
+	struct_format *format = struct_compile(">Ih8s2xd2f3H?Q");
+	struct_proto *proto = struct_proto_create(format, numbers);
+	ssize_t size1, size2, size3, size4;
+	uint32_t I = 0;
+	uint16_t H[3] = { 0 };
+
+	struct_pack(record, sizeof(record), ">Ih8s2xd2f3H?Q", 150, -1, "testing", 0.0, 0.0f, 0.0f, 0, 0, 0, 0, 0);
+	size1 = struct_proto_encode(message, sizeof(message), proto, record);
+	size2 = size1 > (ssize_t) sizeof(expected) && memcmp(message, expected, sizeof(expected)) == 0 ? 0 : -1;
+
+	struct_pack(record, sizeof(record), ">Ih8s2xd2f3H?Q", 1, -300, "abc", -2.5, 1.5f, 0.0f, 1, 300, 0, 1,
+			0xffffffffffffffffULL);
+	size3 = struct_proto_encode(message, sizeof(message), proto, record);
+	if (size3 > 0)
+		size4 = struct_proto_decode(decoded, sizeof(decoded), proto, message, size3);
+	else
+		size4 = -1;
+
+	printf("Protocol buffers encoding test: ");
+	if (proto != NULL && size2 == 0 && size4 == (ssize_t) format->size &&
+			memcmp(record, decoded, format->size) == 0 && size3 <= struct_proto_bound(proto) &&
+			struct_proto_encode(message, size3 - 1, proto, record) < 0 &&
+			struct_proto_decode(decoded, sizeof(decoded), proto, message, size3 - 1) < 0 &&
+			struct_proto_decode(decoded, sizeof(decoded), proto, overflow, sizeof(overflow)) < 0 &&
+			struct_proto_decode(decoded, sizeof(decoded), proto, unpacked, sizeof(unpacked)) == (ssize_t) format->size &&
+			struct_unpack(decoded, sizeof(decoded), ">I14x2x12x3H", &I, &H[0], &H[1], &H[2]) > 0 &&
+			I == 42 && H[0] == 1 && H[1] == 2 && H[2] == 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_proto_free(proto);
+	struct_free(format);
+}
+
+static void test_struct_transcode(void)
+{
+	const uint8_t msgpack[] = { 0x93, 0xff, 0xcc, 0xc8, 0xc3 };
+	const uint8_t cbor[] = { 0x83, 0x20, 0x18, 0xc8, 0xf5 };
+	const uint8_t overflow[] = { 0x93, 0x00, 0xcd, 0x01, 0x2c, 0xc2 };
+	const char *fmt = ">Ih8s2xd2f3H?QbT";
+	struct_format *small = struct_compile("<hB?");
+	struct_format *format = struct_compile(fmt);
+	uint8_t record[4], records[2 * 64], decoded[2 * 64], encoded[256];
+	ssize_t size1, size2, size3, size4, size5, size6;
+
+	struct_pack(record, sizeof(record), "<hB?", -1, 200, 1);
+	size1 = struct_to_msgpack(encoded, sizeof(encoded), small, record);
+	size2 = size1 == sizeof(msgpack) && memcmp(encoded, msgpack, sizeof(msgpack)) == 0 ? 0 : -1;
+	size3 = struct_to_cbor(encoded, sizeof(encoded), small, record);
+	size4 = size3 == sizeof(cbor) && memcmp(encoded, cbor, sizeof(cbor)) == 0 ? 0 : -1;
+
+	struct_pack(records, format->size, fmt, 1, -300, "abc", -2.5, 1.5f, 0.0f, 1, 300, 4464, 1,
+			0xffffffffffffffffULL, -5, 1);
+	struct_pack(records + format->size, format->size, fmt, 200, -32, "abcdefgh", 1e300, 1.5f, -0.0f, 0, 0,
+			65535, 0, 12345ULL, 127, 0);
+	size5 = struct_to_msgpack_array(encoded, sizeof(encoded), format, records, 2);
+	if (struct_from_msgpack_array(decoded, sizeof(decoded), format, encoded, size5) != 2 ||
+			memcmp(records, decoded, 2 * format->size) != 0 ||
+			struct_to_msgpack_array(encoded, size5 - 1, format, records, 2) >= 0)
+		size5 = -1;
+	size6 = struct_to_cbor_array(encoded, sizeof(encoded), format, records, 2);
+	if (struct_from_cbor_array(decoded, sizeof(decoded), format, encoded, size6) != 2 ||
+			memcmp(records, decoded, 2 * format->size) != 0 ||
+			struct_from_cbor_array(decoded, sizeof(decoded), format, encoded, size6 - 1) >= 0)
+		size6 = -1;
+
+	printf("MessagePack and CBOR transcoding test: ");
+	if (size2 == 0 && size4 == 0 && size5 > 0 && size6 > 0 &&
+			struct_from_msgpack(record, sizeof(record), small, msgpack, sizeof(msgpack)) == sizeof(msgpack) &&
+			struct_from_cbor(decoded, sizeof(decoded), small, cbor, sizeof(cbor)) == sizeof(cbor) &&
+			memcmp(record, decoded, small->size) == 0 &&
+			struct_from_msgpack(record, sizeof(record), small, overflow, sizeof(overflow)) < 0)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_free(small);
+	struct_free(format);
+}
+
+static void test_struct_arrow(void)
+{
+	const char *fmt = ">Ih8s2x3H?";
+	struct_format *format = struct_compile(fmt);
+	uint8_t records[3 * 24];
+	struct ArrowArray array;
+	struct ArrowSchema schema;
+	ssize_t count;
+	int res = 0;
+
+	struct_pack(records, format->size, fmt, 1, -300, "abc", 1, 2, 3, 1);
+	struct_pack(records + format->size, format->size, fmt, 2, 7, "", 4, 5, 6, 0);
+	struct_pack(records + 2 * format->size, format->size, fmt, 3, -1, "abcdefgh", 7, 8, 9, 1);
+
+	// strings hold any bytes, only trailing zero padding is trimmed
+	memcpy(records + 6, "a\0\xff", 3);
+
+	count = struct_arrow_export(format, records, 3, &array, &schema);
+	if (count == 3)
+	{
+		const uint32_t *I = array.children[0]->buffers[1];
+		const int16_t *h = array.children[1]->buffers[1];
+		const int32_t *offsets = array.children[2]->buffers[1];
+		const char *str = array.children[2]->buffers[2];
+		const uint16_t *H = array.children[3]->children[0]->buffers[1];
+		const uint8_t *b = array.children[4]->buffers[1];
+
+		res = strcmp(schema.format, "+s") == 0 && schema.n_children == 5 && array.n_children == 5 &&
+				strcmp(schema.children[0]->format, "I") == 0 && strcmp(schema.children[1]->format, "s") == 0 &&
+				strcmp(schema.children[2]->format, "z") == 0 && strcmp(schema.children[3]->format, "+w:3") == 0 &&
+				strcmp(schema.children[3]->children[0]->format, "S") == 0 &&
+				strcmp(schema.children[4]->format, "b") == 0 && strcmp(schema.children[4]->name, "f5") == 0 &&
+				I[0] == 1 && I[2] == 3 && h[0] == -300 && h[2] == -1 &&
+				offsets[0] == 0 && offsets[1] == 3 && offsets[2] == 3 && offsets[3] == 11 &&
+				memcmp(str, "a\0\xff" "abcdefgh", 11) == 0 && H[0] == 1 && H[4] == 5 && H[8] == 9 &&
+				array.children[3]->children[0]->length == 9 && b[0] == 0x05;
+
+		array.release(&array);
+		schema.release(&schema);
+		res = res && array.release == NULL && schema.release == NULL;
+	}
+
+	printf("Arrow export test: ");
+	if (res)
+		printf("PASS\n");
+	else
+		printf("FAIL\n");
+
+	struct_free(format);
+}
+
 int main(int argc, char *argv[])
 {
 	test_struct_pack_basic_min();
@@ -493,5 +1640,36 @@ int main(int argc, char *argv[])
 
 	test_struct_pack_str_0();
 
+	test_struct_pack_array_modifier();
+	test_struct_pack_array();
+	test_struct_pack_optional();
+	test_struct_pack_bits();
+
+	test_struct_pack_typed();
+	test_struct_calcsize_inline();
+	test_struct_compile();
+	test_struct_pack_gather();
+	test_struct_unpack_convert();
+	test_struct_validate_array();
+	test_struct_pad();
+	test_struct_tune();
+	test_struct_pack_stream();
+	test_struct_estimate();
+	test_struct_alloc();
+	test_struct_bind();
+	test_struct_registry();
+	test_struct_index();
+	test_struct_dict();
+
+	test_struct_shuffle();
+	test_struct_codec_lz();
+	test_struct_stream();
+
+	test_struct_text();
+
+	test_struct_proto();
+	test_struct_transcode();
+	test_struct_arrow();
+
 	return 0;
 }